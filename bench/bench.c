@@ -0,0 +1,762 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "v2p.h"
+#include "synth.h"
+#include "stream.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#endif
+
+#ifdef BENCH_SINGLE_HEADER
+// The whole library in this translation unit, reading through synth_read directly
+#define V2P_READ_FUNC synth_read
+#define V2P_IMPLEMENTATION
+#include "v2p_single.h"
+#endif
+
+static uint64_t
+rand64(uint64_t *state) {
+    // xorshift64
+    uint64_t x = *state;
+    x ^= x << 13U;
+    x ^= x >> 7U;
+    x ^= x << 17U;
+    return *state = x;
+}
+
+static double
+now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Sign-extends a linear address of the given width
+static uint64_t
+canonical(const uint64_t virt_addr, const uint8_t width) {
+    uint8_t shift = 64 - width;
+    return (uint64_t) ((int64_t) (virt_addr << shift) >> shift);
+}
+
+//---------------------------------------------------------
+// 4-level vs 5-level walk latency
+//---------------------------------------------------------
+enum {
+    REGIONS = 512,
+    PAGES_PER_REGION = 32,
+    LOOKUPS = 1 << 20,
+};
+
+static bool
+bench_walk(const char *name, const paging_mode_t level, const uint8_t width) {
+    synth_t s;
+    if (!synth_init(&s, 64ULL << 20U, level)) {
+        return false;
+    }
+    synth_use(&s);
+
+    // Pages clustered in 2MB regions spread over the whole address space
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    uint64_t *pages = malloc(REGIONS * PAGES_PER_REGION * sizeof(uint64_t));
+    for (int i = 0; i < REGIONS; ++i) {
+        uint64_t region = canonical(rand64(&seed) & ~((1ULL << 21U) - 1), width);
+        for (int j = 0; j < PAGES_PER_REGION; ++j) {
+            pages[i * PAGES_PER_REGION + j] = region | ((uint64_t) j << 12U);
+            synth_map(&s, region | ((uint64_t) j << 12U), (uint64_t) (i * PAGES_PER_REGION + j) << 12U, PAGE_4KB);
+        }
+    }
+
+    uint64_t *lookups = malloc(LOOKUPS * sizeof(uint64_t));
+    for (int i = 0; i < LOOKUPS; ++i) {
+        lookups[i] = pages[rand64(&seed) % (REGIONS * PAGES_PER_REGION)] | (i & 0xfffU);
+    }
+
+    config_t cfg = synth_config(&s);
+    uint64_t sum = 0;
+    s.reads = 0;
+    double start = now_ns();
+    for (int i = 0; i < LOOKUPS; ++i) {
+        uint64_t phys = 0;
+        uint32_t page_fault = 0;
+        va2pa64(lookups[i], &cfg, &phys, &page_fault);
+        sum += phys;
+    }
+    double elapsed = now_ns() - start;
+
+    printf("%-12s %8.2f ns/walk %6.2f reads/walk  (tables: %llu KB, checksum %llx)\n",
+           name, elapsed / LOOKUPS, (double) s.reads / LOOKUPS,
+           (unsigned long long) (s.next >> 10U), (unsigned long long) sum);
+
+    free(lookups);
+    free(pages);
+    synth_free(&s);
+    return true;
+}
+
+//---------------------------------------------------------
+// Translation suite: 32-bit layouts x address streams
+//---------------------------------------------------------
+enum {
+    SUITE_TRANSLATIONS = 1 << 18,
+};
+
+// Timestamps of single translations: the serialized TSC on x86-64, nanoseconds elsewhere
+static uint64_t
+suite_ticks() {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+#else
+    return (uint64_t) now_ns();
+#endif
+}
+
+static double
+suite_ticks_per_ns() {
+    double start = now_ns();
+    uint64_t ticks = suite_ticks();
+    while (now_ns() - start < 20e6) {
+    }
+    return (double) (suite_ticks() - ticks) / (now_ns() - start);
+}
+
+static int
+cmp_ticks(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return x < y ? -1 : (x > y);
+}
+
+typedef struct suite_result {
+    const char *mode;
+    const char *layout;
+    const char *stream;
+    size_t pages;
+    uint64_t tables_kb;
+
+    double ns_per_translation;
+    double reads_per_translation;
+    double fault_rate;
+
+    // latencies of single translations, timer overhead subtracted
+    double p50_ns;
+    double p90_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+} suite_result_t;
+
+static void
+suite_print(FILE *const json, const suite_result_t *const r, const bool first) {
+    printf("%-6s %-10s %-10s %7.2f ns %6.1f Mtr/s  p50 %6.1f  p90 %6.1f  p99 %6.1f  p99.9 %7.1f ns"
+           "  %5.2f reads  %5.1f%% faults\n",
+           r->mode, r->layout, r->stream, r->ns_per_translation, 1e3 / r->ns_per_translation,
+           r->p50_ns, r->p90_ns, r->p99_ns, r->p999_ns, r->reads_per_translation, r->fault_rate * 100);
+    if (json == NULL) {
+        return;
+    }
+    fprintf(json, "%s\n    {\"mode\": \"%s\", \"layout\": \"%s\", \"stream\": \"%s\", "
+                  "\"pages\": %zu, \"tables_kb\": %llu, \"translations\": %d, "
+                  "\"ns_per_translation\": %.3f, \"translations_per_sec\": %.0f, "
+                  "\"p50_ns\": %.1f, \"p90_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, \"max_ns\": %.1f, "
+                  "\"reads_per_translation\": %.4f, \"fault_rate\": %.4f}",
+            first ? "" : ",", r->mode, r->layout, r->stream, r->pages, (unsigned long long) r->tables_kb,
+            SUITE_TRANSLATIONS, r->ns_per_translation, 1e9 / r->ns_per_translation,
+            r->p50_ns, r->p90_ns, r->p99_ns, r->p999_ns, r->max_ns, r->reads_per_translation, r->fault_rate);
+}
+
+// Translates the stream twice with va2pa: back to back for the throughput and
+// the reads, then timing every translation for the latency percentiles
+static void
+suite_run(synth_t *const s, const uint64_t *const addrs, uint64_t *const samples, const double ticks_per_ns,
+          suite_result_t *const r) {
+    config_t cfg = synth_config(s);
+    uint64_t sum = 0;
+    uint64_t faults = 0;
+    s->reads = 0;
+    double start = now_ns();
+    for (int i = 0; i < SUITE_TRANSLATIONS; ++i) {
+        uint64_t phys = 0;
+        uint32_t page_fault = 0;
+        faults += va2pa((uint32_t) addrs[i], &cfg, &phys, &page_fault) != SUCCESS;
+        sum += phys;
+    }
+    r->ns_per_translation = (now_ns() - start) / SUITE_TRANSLATIONS;
+    r->reads_per_translation = (double) s->reads / SUITE_TRANSLATIONS;
+    r->fault_rate = (double) faults / SUITE_TRANSLATIONS;
+
+    // The cheapest of many empty measurements is the overhead of the timer itself
+    uint64_t overhead = UINT64_MAX;
+    for (int i = 0; i < 1000; ++i) {
+        uint64_t t = suite_ticks();
+        uint64_t d = suite_ticks() - t;
+        overhead = d < overhead ? d : overhead;
+    }
+    for (int i = 0; i < SUITE_TRANSLATIONS; ++i) {
+        uint64_t phys = 0;
+        uint32_t page_fault = 0;
+        uint64_t t = suite_ticks();
+        va2pa((uint32_t) addrs[i], &cfg, &phys, &page_fault);
+        uint64_t d = suite_ticks() - t;
+        samples[i] = d > overhead ? d - overhead : 0;
+        sum += phys;
+    }
+    qsort(samples, SUITE_TRANSLATIONS, sizeof(uint64_t), cmp_ticks);
+    r->p50_ns = samples[SUITE_TRANSLATIONS / 2] / ticks_per_ns;
+    r->p90_ns = samples[SUITE_TRANSLATIONS / 10 * 9] / ticks_per_ns;
+    r->p99_ns = samples[SUITE_TRANSLATIONS / 100 * 99] / ticks_per_ns;
+    r->p999_ns = samples[SUITE_TRANSLATIONS / 1000 * 999] / ticks_per_ns;
+    r->max_ns = samples[SUITE_TRANSLATIONS - 1] / ticks_per_ns;
+
+    // keeps the translations from being optimized out
+    if (sum == 1) {
+        printf("\n");
+    }
+}
+
+// Every layout of LEGACY and PAE tables translated in every stream order,
+// written to json as well if it is not NULL
+static bool
+bench_suite(FILE *const json) {
+    uint64_t *pages = malloc(SYNTH_WINDOW_PAGES * sizeof(uint64_t));
+    uint64_t *addrs = malloc(SUITE_TRANSLATIONS * sizeof(uint64_t));
+    uint64_t *samples = malloc(SUITE_TRANSLATIONS * sizeof(uint64_t));
+    if (pages == NULL || addrs == NULL || samples == NULL) {
+        free(samples);
+        free(addrs);
+        free(pages);
+        return false;
+    }
+    double ticks_per_ns = suite_ticks_per_ns();
+
+    bool ok = true;
+    bool first = true;
+    paging_mode_t levels[] = {LEGACY, PAE};
+    const char *mode_names[] = {"legacy", "pae"};
+    for (int l = 0; l < sizeof(levels) / sizeof(paging_mode_t); ++l) {
+        for (int layout = 0; layout < SYNTH_LAYOUTS; ++layout) {
+            synth_t s;
+            if (!synth_init(&s, 16ULL << 20U, levels[l])) {
+                ok = false;
+                continue;
+            }
+            synth_use(&s);
+            size_t n_pages = synth_generate(&s, (synth_layout_t) layout, 0x9e3779b97f4a7c15ULL, pages);
+            if (n_pages == 0) {
+                synth_free(&s);
+                ok = false;
+                continue;
+            }
+
+            for (int stream = 0; stream < STREAM_KINDS; ++stream) {
+                if (!stream_fill((stream_kind_t) stream, pages, n_pages, 0x2545f4914f6cdd1dULL + stream,
+                                 addrs, SUITE_TRANSLATIONS)) {
+                    ok = false;
+                    continue;
+                }
+                suite_result_t r = {
+                        .mode=mode_names[l],
+                        .layout=SYNTH_LAYOUT_NAMES[layout],
+                        .stream=STREAM_NAMES[stream],
+                        .pages=n_pages,
+                        .tables_kb=s.next >> 10U,
+                };
+                suite_run(&s, addrs, samples, ticks_per_ns, &r);
+                suite_print(json, &r, first);
+                first = false;
+            }
+            synth_free(&s);
+        }
+    }
+
+    free(samples);
+    free(addrs);
+    free(pages);
+    return ok;
+}
+
+//---------------------------------------------------------
+// Batch throughput vs walks in flight
+//---------------------------------------------------------
+enum {
+    BATCH_LOOKUPS = 1 << 22,
+};
+
+static bool
+bench_interleaved() {
+    // Whole first gigabyte of PAE in 4KB pages: 2MB of page tables
+    synth_t s;
+    if (!synth_init(&s, 8ULL << 20U, PAE)) {
+        return false;
+    }
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (uint64_t virt_addr = 0; virt_addr < (1ULL << 30U); virt_addr += 4096) {
+        if (!synth_map(&s, virt_addr, (rand64(&seed) & 0xffffff000ULL), PAGE_4KB)) {
+            synth_free(&s);
+            return false;
+        }
+    }
+
+    uint32_t *lookups = malloc(BATCH_LOOKUPS * sizeof(uint32_t));
+    uint64_t *phys = malloc(BATCH_LOOKUPS * sizeof(uint64_t));
+    error_t *errors = malloc(BATCH_LOOKUPS * sizeof(error_t));
+    uint32_t *page_faults = malloc(BATCH_LOOKUPS * sizeof(uint32_t));
+    for (int i = 0; i < BATCH_LOOKUPS; ++i) {
+        lookups[i] = (uint32_t) rand64(&seed) & 0x3fffffffU;
+    }
+
+    config_t cfg = synth_config(&s);
+    cfg.mem_base = s.mem;
+    cfg.mem_size = s.size;
+
+    // Fault in the result arrays before timing
+    va2pa_batch_interleaved(lookups, BATCH_LOOKUPS, &cfg, 1, phys, errors, page_faults);
+
+    size_t in_flights[] = {1, 2, 4, 8, 12, 16, 24, 32, 64};
+    for (int f = 0; f < sizeof(in_flights) / sizeof(size_t); ++f) {
+        double start = now_ns();
+        va2pa_batch_interleaved(lookups, BATCH_LOOKUPS, &cfg, in_flights[f], phys, errors, page_faults);
+        double elapsed = now_ns() - start;
+
+        uint64_t sum = 0;
+        for (int i = 0; i < BATCH_LOOKUPS; ++i) {
+            sum += phys[i];
+        }
+        printf("pae in flight %-3zu %6.2f ns/walk %7.2f Mwalks/s  (checksum %llx)\n",
+               in_flights[f], elapsed / BATCH_LOOKUPS, BATCH_LOOKUPS / elapsed * 1e3, (unsigned long long) sum);
+    }
+
+    free(page_faults);
+    free(errors);
+    free(phys);
+    free(lookups);
+    synth_free(&s);
+    return true;
+}
+
+//---------------------------------------------------------
+// Whole-tree enumeration vs threads
+//---------------------------------------------------------
+static bool
+count_mapping(const mapping_t *mapping, void *arg) {
+    ++*(uint64_t *) arg;
+    return true;
+}
+
+static bool
+bench_scan() {
+    // A few dense regions and many sparse ones
+    synth_t s;
+    if (!synth_init(&s, 256ULL << 20U, IA32E)) {
+        return false;
+    }
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 4096; ++i) {
+        uint64_t region = canonical(rand64(&seed) & ~((1ULL << 21U) - 1), 48);
+        int pages = i % 256 == 0 ? 512 * 64 : 8;
+        for (int j = 0; j < pages; ++j) {
+            synth_map(&s, region + ((uint64_t) j << 12U), (uint64_t) j << 12U, PAGE_4KB);
+        }
+    }
+
+    config_t cfg = synth_config(&s);
+    cfg.mem_base = s.mem;
+    cfg.mem_size = s.size;
+
+    uint32_t threads[] = {1, 2, 4, 8};
+    for (int t = 0; t < sizeof(threads) / sizeof(uint32_t); ++t) {
+        uint64_t n = 0;
+        double start = now_ns();
+        v2p_enumerate_parallel(&cfg, threads[t], count_mapping, &n);
+        double elapsed = now_ns() - start;
+        printf("scan %u threads %8.2f ms  (%llu mappings, tables: %llu KB)\n",
+               threads[t], elapsed / 1e6, (unsigned long long) n, (unsigned long long) (s.next >> 10U));
+    }
+
+    synth_free(&s);
+    return true;
+}
+
+//---------------------------------------------------------
+// Full enumeration vs snapshot updates
+//---------------------------------------------------------
+static bool
+count_range(const diff_range_t *range, void *arg) {
+    ++*(uint64_t *) arg;
+    return true;
+}
+
+static bool
+bench_snapshot() {
+    synth_t s;
+    if (!synth_init(&s, 256ULL << 20U, IA32E)) {
+        return false;
+    }
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < 4096; ++i) {
+        uint64_t region = canonical(rand64(&seed) & ~((1ULL << 21U) - 1), 48);
+        int pages = i % 256 == 0 ? 512 * 64 : 8;
+        for (int j = 0; j < pages; ++j) {
+            synth_map(&s, region + ((uint64_t) j << 12U), (uint64_t) j << 12U, PAGE_4KB);
+        }
+    }
+
+    config_t cfg = synth_config(&s);
+    cfg.mem_base = s.mem;
+    cfg.mem_size = s.size;
+
+    uint64_t n = 0;
+    double start = now_ns();
+    v2p_enumerate_parallel(&cfg, 1, count_mapping, &n);
+    printf("snapshot: enumerate      %8.2f ms\n", (now_ns() - start) / 1e6);
+
+    snapshot_t *snapshot = NULL;
+    start = now_ns();
+    v2p_snapshot_take(&cfg, &snapshot);
+    printf("snapshot: take           %8.2f ms\n", (now_ns() - start) / 1e6);
+    if (snapshot == NULL) {
+        synth_free(&s);
+        return false;
+    }
+
+    int churn[] = {0, 16, 1024};
+    for (int c = 0; c < sizeof(churn) / sizeof(int); ++c) {
+        for (int i = 0; i < churn[c]; ++i) {
+            uint64_t virt_addr = canonical(rand64(&seed) & ~((1ULL << 12U) - 1), 48);
+            synth_map(&s, virt_addr, rand64(&seed) & 0xffffff000ULL, PAGE_4KB);
+        }
+        uint64_t ranges = 0;
+        start = now_ns();
+        v2p_snapshot_update(snapshot, &cfg, count_range, &ranges);
+        printf("snapshot: update %4d new %8.2f ms  (%llu ranges)\n",
+               churn[c], (now_ns() - start) / 1e6, (unsigned long long) ranges);
+    }
+
+    v2p_snapshot_free(snapshot);
+    synth_free(&s);
+    return true;
+}
+
+//---------------------------------------------------------
+// Shared translation cache throughput vs threads
+//---------------------------------------------------------
+enum {
+    SHARED_PAGES = 1 << 16,
+    SHARED_LOOKUPS = 1 << 22,
+    SHARED_MAX_THREADS = 8,
+};
+
+typedef struct shared_worker {
+    const config_t *cfg;
+    shared_tlb_t *tlb;
+    const uint64_t *addrs;
+    uint64_t sum;
+} shared_worker_t;
+
+static void *
+shared_lookups(void *arg) {
+    shared_worker_t *w = arg;
+    for (int i = 0; i < SHARED_LOOKUPS; ++i) {
+        uint64_t phys = 0;
+        uint32_t page_fault = 0;
+        if (w->tlb != NULL) {
+            va2pa_shared_tlb(w->addrs[i], w->cfg, w->tlb, &phys, &page_fault);
+        } else {
+            va2pa(w->addrs[i], w->cfg, &phys, &page_fault);
+        }
+        w->sum += phys;
+    }
+    return NULL;
+}
+
+// Every thread translates its own Zipfian stream over the same tables,
+// the lookups of all threads hitting one cache once it is warm
+static bool
+bench_shared_tlb() {
+    synth_t s;
+    uint64_t *pages = malloc(SYNTH_WINDOW_PAGES * sizeof(uint64_t));
+    uint64_t *addrs = malloc((uint64_t) SHARED_MAX_THREADS * SHARED_LOOKUPS * sizeof(uint64_t));
+    if (pages == NULL || addrs == NULL || !synth_init(&s, 16ULL << 20U, LEGACY)) {
+        free(addrs);
+        free(pages);
+        return false;
+    }
+    synth_use(&s);
+    size_t n_pages = synth_generate(&s, SYNTH_ALL_4KB, 0x9e3779b97f4a7c15ULL, pages);
+    n_pages = n_pages < SHARED_PAGES ? n_pages : SHARED_PAGES;
+    for (int t = 0; t < SHARED_MAX_THREADS; ++t) {
+        stream_fill(STREAM_ZIPF, pages, n_pages, 0x2545f4914f6cdd1dULL + t,
+                    addrs + (uint64_t) t * SHARED_LOOKUPS, SHARED_LOOKUPS);
+    }
+
+    // Read from memory directly, synth_read counts its reads without atomics
+    config_t cfg = synth_config(&s);
+    cfg.mem_base = s.mem;
+    cfg.mem_size = s.size;
+    shared_tlb_t *tlb = v2p_shared_tlb_init(2 * SHARED_PAGES);
+
+    printf("shared tlb: %ld cpus online\n", sysconf(_SC_NPROCESSORS_ONLN));
+    double base[2] = {0, 0};
+    for (uint32_t n_threads = 1; n_threads <= SHARED_MAX_THREADS; n_threads *= 2) {
+        for (int cached = 1; cached >= 0; --cached) {
+            shared_worker_t workers[SHARED_MAX_THREADS];
+            pthread_t threads[SHARED_MAX_THREADS];
+            double start = now_ns();
+            for (uint32_t t = 0; t < n_threads; ++t) {
+                workers[t] = (shared_worker_t) {
+                        .cfg=&cfg,
+                        .tlb=cached ? tlb : NULL,
+                        .addrs=addrs + (uint64_t) t * SHARED_LOOKUPS,
+                };
+                pthread_create(&threads[t], NULL, shared_lookups, &workers[t]);
+            }
+            uint64_t sum = 0;
+            for (uint32_t t = 0; t < n_threads; ++t) {
+                pthread_join(threads[t], NULL);
+                sum += workers[t].sum;
+            }
+            double mops = (double) n_threads * SHARED_LOOKUPS / ((now_ns() - start) / 1e3);
+            if (n_threads == 1) {
+                base[cached] = mops;
+            }
+            printf("shared tlb: %u threads %-6s %8.2f M/s  x%.2f  (checksum %llx)\n",
+                   n_threads, cached ? "cached" : "walk", mops, mops / base[cached], (unsigned long long) sum);
+        }
+    }
+
+    v2p_shared_tlb_free(tlb);
+    synth_free(&s);
+    free(addrs);
+    free(pages);
+    return true;
+}
+
+//---------------------------------------------------------
+// Flat tables vs walks
+//---------------------------------------------------------
+enum {
+    FLAT_LOOKUPS = 1 << 22,
+};
+
+static bool
+bench_flat() {
+    synth_t s;
+    uint64_t *pages = malloc(SYNTH_WINDOW_PAGES * sizeof(uint64_t));
+    uint64_t *addrs = malloc(FLAT_LOOKUPS * sizeof(uint64_t));
+    if (pages == NULL || addrs == NULL || !synth_init(&s, 16ULL << 20U, PAE)) {
+        free(addrs);
+        free(pages);
+        return false;
+    }
+    synth_use(&s);
+    size_t n_pages = synth_generate(&s, SYNTH_FRAGMENTED, 0x9e3779b97f4a7c15ULL, pages);
+    stream_fill(STREAM_RANDOM, pages, n_pages, 0x2545f4914f6cdd1dULL, addrs, FLAT_LOOKUPS);
+    config_t cfg = synth_config(&s);
+    cfg.mem_base = s.mem;
+    cfg.mem_size = s.size;
+
+    uint64_t sum = 0;
+    double start = now_ns();
+    for (int i = 0; i < FLAT_LOOKUPS; ++i) {
+        uint64_t phys = 0;
+        uint32_t page_fault = 0;
+        va2pa(addrs[i], &cfg, &phys, &page_fault);
+        sum += phys;
+    }
+    printf("flat: walk          %8.2f ns/translation  (checksum %llx)\n",
+           (now_ns() - start) / FLAT_LOOKUPS, (unsigned long long) sum);
+
+    const char *names[] = {"4KB pages", "huge pages"};
+    for (int huge = 0; huge < 2; ++huge) {
+        flat_table_t flat;
+        start = now_ns();
+        if (v2p_flat_build(&cfg, huge, &flat) != SUCCESS) {
+            continue;
+        }
+        double built = now_ns() - start;
+
+        sum = 0;
+        start = now_ns();
+        for (int i = 0; i < FLAT_LOOKUPS; ++i) {
+            uint64_t phys = 0;
+            uint32_t page_fault = 0;
+            v2p_flat_translate(&flat, addrs[i], &phys, &page_fault);
+            sum += phys;
+        }
+        printf("flat: %-12s  %8.2f ns/translation  (built in %.2f ms, checksum %llx)\n",
+               names[huge], (now_ns() - start) / FLAT_LOOKUPS, built / 1e6, (unsigned long long) sum);
+        v2p_flat_free(&flat);
+    }
+
+    synth_free(&s);
+    free(addrs);
+    free(pages);
+    return true;
+}
+
+//---------------------------------------------------------
+// Blocking pread vs io_uring walks of an on-disk dump
+//---------------------------------------------------------
+enum {
+    DUMP_LOOKUPS = 100000,
+};
+
+static int dump_fd = -1;
+
+static int32_t
+dump_pread(void *buf, const uint32_t size, const uint64_t physical_addr) {
+    return (int32_t) pread(dump_fd, buf, size, (off_t) physical_addr);
+}
+
+static uint64_t dump_sum = 0;
+
+static void
+dump_done(void *user_data, uint64_t virt_addr, error_t err, uint64_t phys_addr, uint32_t page_fault) {
+    dump_sum += phys_addr;
+}
+
+static bool
+bench_async() {
+    synth_t s;
+    if (!synth_init(&s, 64ULL << 20U, IA32E)) {
+        return false;
+    }
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    uint64_t *lookups = malloc(DUMP_LOOKUPS * sizeof(uint64_t));
+    for (int i = 0; i < DUMP_LOOKUPS; ++i) {
+        lookups[i] = canonical(rand64(&seed) & ~0xfffULL, 48);
+        synth_map(&s, lookups[i], (uint64_t) i << 12U, PAGE_4KB);
+    }
+
+    char path[] = "/tmp/v2p_bench_XXXXXX";
+    dump_fd = mkstemp(path);
+    if (dump_fd < 0 || write(dump_fd, s.mem, s.next) != (ssize_t) s.next) {
+        free(lookups);
+        synth_free(&s);
+        return false;
+    }
+    config_t cfg = synth_config(&s);
+    cfg.read_func = dump_pread;
+
+    uint64_t sum = 0;
+    double start = now_ns();
+    for (int i = 0; i < DUMP_LOOKUPS; ++i) {
+        uint64_t phys = 0;
+        uint32_t page_fault = 0;
+        va2pa64(lookups[i], &cfg, &phys, &page_fault);
+        sum += phys;
+    }
+    double elapsed = now_ns() - start;
+    printf("pread        %8.2f ns/walk  (checksum %llx)\n", elapsed / DUMP_LOOKUPS, (unsigned long long) sum);
+
+    // Read latency per level of the walks backed by memory and by the file
+    v2p_profile_t *profile = calloc(1, sizeof(v2p_profile_t));
+    config_t profiled[] = {synth_config(&s), cfg};
+    const char *names[] = {"memory", "pread"};
+    synth_use(&s);
+    for (int b = 0; profile != NULL && b < sizeof(profiled) / sizeof(config_t); ++b) {
+        v2p_profile_reset(profile);
+        profiled[b].profile = profile;
+        for (int i = 0; i < DUMP_LOOKUPS; ++i) {
+            uint64_t phys = 0;
+            uint32_t page_fault = 0;
+            va2pa64(lookups[i], &profiled[b], &phys, &page_fault);
+        }
+        printf("%s read latency:\n", names[b]);
+        v2p_profile_dump(profile, stdout);
+    }
+    free(profile);
+
+    uint32_t depths[] = {64, 1024, 4096};
+    for (int d = 0; d < sizeof(depths) / sizeof(uint32_t); ++d) {
+        uring_file_t *u = v2p_uring_open(path, depths[d]);
+        if (u == NULL) {
+            printf("io_uring not available\n");
+            break;
+        }
+        async_backend_t backend = v2p_uring_backend(u);
+        async_walker_t *w = v2p_async_init(&cfg, &backend, depths[d], dump_done);
+
+        dump_sum = 0;
+        start = now_ns();
+        for (int i = 0; i < DUMP_LOOKUPS; ++i) {
+            while (v2p_async_submit(w, lookups[i], NULL) != SUCCESS) {
+                v2p_async_poll(w);
+            }
+        }
+        v2p_async_drain(w);
+        elapsed = now_ns() - start;
+        printf("uring %-6u %8.2f ns/walk  (checksum %llx)\n",
+               depths[d], elapsed / DUMP_LOOKUPS, (unsigned long long) dump_sum);
+
+        v2p_async_free(w);
+        v2p_uring_close(u);
+    }
+
+    close(dump_fd);
+    unlink(path);
+    free(lookups);
+    synth_free(&s);
+    return true;
+}
+
+// bench [suite] [--json path]
+//   suite       - run only the translation suite
+//   --json path - also write the results of the suite to path as JSON
+int
+main(int argc, char **argv) {
+    bool suite_only = false;
+    const char *json_path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "suite") == 0) {
+            suite_only = true;
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [suite] [--json path]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    FILE *json = NULL;
+    if (json_path != NULL) {
+        json = fopen(json_path, "w");
+        if (json == NULL) {
+            perror(json_path);
+            return 1;
+        }
+#ifdef BENCH_SINGLE_HEADER
+        fprintf(json, "{\n  \"build\": \"single_header\",\n  \"results\": [");
+#else
+        fprintf(json, "{\n  \"build\": \"library\",\n  \"results\": [");
+#endif
+    }
+
+    bool ok = bench_suite(json);
+    if (json != NULL) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+    if (suite_only) {
+        return ok ? 0 : 1;
+    }
+
+    ok &= bench_walk("ia32e", IA32E, 48);
+    ok &= bench_walk("la57", LA57, 57);
+    ok &= bench_interleaved();
+    ok &= bench_shared_tlb();
+    ok &= bench_flat();
+    ok &= bench_async();
+    ok &= bench_scan();
+    ok &= bench_snapshot();
+
+    return ok ? 0 : 1;
+}
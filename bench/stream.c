@@ -0,0 +1,91 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "stream.h"
+
+const char *const STREAM_NAMES[STREAM_KINDS] = {"sequential", "random", "strided", "zipf"};
+
+static uint64_t
+stream_rand(uint64_t *const state) {
+    // xorshift64
+    uint64_t x = *state;
+    x ^= x << 13U;
+    x ^= x >> 7U;
+    x ^= x << 17U;
+    return *state = x;
+}
+
+// Zipfian ranks by inverting the cumulative distribution, ranks mapped
+// to pages through a random permutation
+static bool
+stream_zipf(const uint64_t *const pages, const size_t n_pages, uint64_t *const seed, uint64_t *const addrs, const size_t n) {
+    double *cdf = malloc(n_pages * sizeof(double));
+    size_t *order = malloc(n_pages * sizeof(size_t));
+    if (cdf == NULL || order == NULL) {
+        free(order);
+        free(cdf);
+        return false;
+    }
+
+    double sum = 0;
+    for (size_t k = 0; k < n_pages; ++k) {
+        sum += 1.0 / pow((double) (k + 1), STREAM_ZIPF_S);
+        cdf[k] = sum;
+        order[k] = k;
+    }
+    for (size_t k = n_pages; k-- > 1;) {
+        size_t j = stream_rand(seed) % (k + 1);
+        size_t t = order[k];
+        order[k] = order[j];
+        order[j] = t;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        double u = (double) (stream_rand(seed) >> 11U) / (double) (1ULL << 53U) * sum;
+        size_t lo = 0;
+        size_t hi = n_pages - 1;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (cdf[mid] < u) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        addrs[i] = pages[order[lo]] | (stream_rand(seed) & 0xfffU);
+    }
+
+    free(order);
+    free(cdf);
+    return true;
+}
+
+bool
+stream_fill(const stream_kind_t kind,
+            const uint64_t *const pages,
+            const size_t n_pages,
+            uint64_t seed,
+            uint64_t *const addrs,
+            const size_t n) {
+    seed |= 1U;
+    if (kind == STREAM_ZIPF) {
+        return stream_zipf(pages, n_pages, &seed, addrs, n);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        size_t k;
+        switch (kind) {
+            case STREAM_SEQUENTIAL:
+                k = i % n_pages;
+                break;
+            case STREAM_RANDOM:
+                k = stream_rand(&seed) % n_pages;
+                break;
+            case STREAM_STRIDED:
+            default:
+                k = (i * STREAM_STRIDE) % n_pages;
+                break;
+        }
+        addrs[i] = pages[k] | (stream_rand(&seed) & 0xfffU);
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Orders in which the suite translates the pages of a layout
+typedef enum stream_kind {
+    // the pages in ascending order
+    STREAM_SEQUENTIAL,
+
+    // uniformly random pages
+    STREAM_RANDOM,
+
+    // every STREAM_STRIDE-th page, wrapping around, so that consecutive
+    // translations go through different page tables
+    STREAM_STRIDED,
+
+    // pages drawn with Zipfian popularity (s = STREAM_ZIPF_S), the popular ones scattered
+    STREAM_ZIPF,
+
+    STREAM_KINDS,
+} stream_kind_t;
+
+#define STREAM_STRIDE 513
+#define STREAM_ZIPF_S 0.99
+
+extern const char *const STREAM_NAMES[STREAM_KINDS];
+
+// Fills addrs with n addresses inside the n_pages 4KB pages at pages, in the order of kind,
+// each at a random offset within its page. Returns false if out of memory.
+bool
+stream_fill(stream_kind_t kind, const uint64_t *pages, size_t n_pages, uint64_t seed, uint64_t *addrs, size_t n);
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "synth.h"
+
+synth_t *synth_current = NULL;
+
+static const uint64_t PRESENT = 1U;
+static const uint64_t WRITABLE = 1U << 1U;
+static const uint64_t PAGE_SIZE = 1U << 7U;
+
+static uint64_t
+alloc_frame(synth_t *const s) {
+    // Legacy directory entries have bit 21 reserved with PSE-36 (see legacy_reserved_masks),
+    // so the page tables skip the frames with that bit set
+    if (s->level == LEGACY && (s->next & (1ULL << 21U)) != 0) {
+        s->next += 1ULL << 21U;
+    }
+    if (s->next + 4096 > s->size) {
+        return 0;
+    }
+    uint64_t frame = s->next;
+    s->next += 4096;
+    return frame;
+}
+
+bool
+synth_init(synth_t *const s, const uint64_t size, const paging_mode_t level) {
+    memset(s, 0, sizeof(*s));
+    s->mem = calloc(size, 1);
+    if (s->mem == NULL) {
+        return false;
+    }
+    s->size = size;
+    s->level = level;
+
+    // Keep frame 0 unused, so a zero entry never points to a table.
+    // PAE walks ignore cr3 and read the PDPTE of the first gigabyte at
+    // physical address 0 (see pae_pdpte_addr), so frame 0 is its table.
+    s->next = 4096;
+    s->root_addr = level == PAE ? 0 : alloc_frame(s);
+    return true;
+}
+
+void
+synth_free(synth_t *const s) {
+    free(s->mem);
+    memset(s, 0, sizeof(*s));
+}
+
+// Returns the table referenced by the entry of entry_size bytes at entry_addr, allocating it if needed
+static uint64_t
+next_table(synth_t *const s, const uint64_t entry_addr, const uint32_t entry_size) {
+    uint64_t entry = 0;
+    memcpy(&entry, s->mem + entry_addr, entry_size);
+    if (entry & PRESENT) {
+        return entry & 0x000ffffffffff000ULL;
+    }
+
+    uint64_t table = alloc_frame(s);
+    if (table != 0) {
+        entry = table | PRESENT | WRITABLE;
+        memcpy(s->mem + entry_addr, &entry, entry_size);
+    }
+    return table;
+}
+
+bool
+synth_map(synth_t *const s, const uint64_t virt_addr, const uint64_t phys_addr, const page_size_t page_size) {
+    uint8_t top;
+    uint32_t entry_size = sizeof(uint64_t);
+    uint8_t index_bits = 9;
+    switch (s->level) {
+        case IA32E:
+            top = 39;
+            break;
+        case LA57:
+            top = 48;
+            break;
+        case PAE:
+            // The PDPTEs of the other gigabytes would be read at 1GB and up
+            if (virt_addr >> 30U != 0) {
+                return false;
+            }
+            top = 30;
+            break;
+        case LEGACY:
+            if (virt_addr >> 32U != 0 || phys_addr >> 32U != 0) {
+                return false;
+            }
+            top = 22;
+            entry_size = sizeof(uint32_t);
+            index_bits = 10;
+            break;
+        default:
+            return false;
+    }
+
+    uint64_t index_mask = (1ULL << index_bits) - 1;
+    uint64_t table = s->root_addr;
+    for (uint8_t shift = top; shift > page_size; shift -= index_bits) {
+        table = next_table(s, table + ((virt_addr >> shift) & index_mask) * entry_size, entry_size);
+        if (table == 0) {
+            return false;
+        }
+    }
+
+    uint64_t leaf = phys_addr | PRESENT | WRITABLE;
+    if (page_size != PAGE_4KB) {
+        leaf |= PAGE_SIZE;
+    }
+    memcpy(s->mem + table + ((virt_addr >> page_size) & index_mask) * entry_size, &leaf, entry_size);
+    return true;
+}
+
+const char *const SYNTH_LAYOUT_NAMES[SYNTH_LAYOUTS] = {"dense", "sparse", "all_4kb", "mixed", "fragmented"};
+
+static uint64_t
+synth_rand(uint64_t *const state) {
+    // xorshift64
+    uint64_t x = *state;
+    x ^= x << 13U;
+    x ^= x >> 7U;
+    x ^= x << 17U;
+    return *state = x;
+}
+
+// random 4KB frame below 4GB, reachable from LEGACY entries
+static uint64_t
+synth_frame(uint64_t *const seed) {
+    return synth_rand(seed) & 0xfffff000ULL;
+}
+
+size_t
+synth_generate(synth_t *const s, const synth_layout_t layout, uint64_t seed, uint64_t *const pages) {
+    page_size_t large = s->level == LEGACY ? PAGE_4MB : PAGE_2MB;
+    uint32_t region_pages = 1U << (large - PAGE_4KB);
+    uint32_t regions = SYNTH_WINDOW_PAGES / region_pages;
+    seed |= 1U;
+
+    // one flag per 4KB page of the window, collected into pages at the end
+    uint8_t *mapped = calloc(SYNTH_WINDOW_PAGES, 1);
+    if (mapped == NULL) {
+        return 0;
+    }
+    bool ok = true;
+    switch (layout) {
+        case SYNTH_DENSE:
+            // 64MB from 256MB on
+            for (uint32_t i = 0; i < 16384 && ok; ++i) {
+                ok = synth_map(s, (65536ULL + i) << 12U, 0x80000000ULL + ((uint64_t) i << 12U), PAGE_4KB);
+                mapped[65536 + i] = 1;
+            }
+            break;
+        case SYNTH_SPARSE:
+            for (uint32_t r = 0; r < regions && ok; ++r) {
+                uint32_t page = r * region_pages + (uint32_t) (synth_rand(&seed) % region_pages);
+                ok = synth_map(s, (uint64_t) page << 12U, synth_frame(&seed), PAGE_4KB);
+                mapped[page] = 1;
+            }
+            break;
+        case SYNTH_ALL_4KB:
+            for (uint32_t page = 0; page < SYNTH_WINDOW_PAGES && ok; ++page) {
+                ok = synth_map(s, (uint64_t) page << 12U, synth_frame(&seed), PAGE_4KB);
+                mapped[page] = 1;
+            }
+            break;
+        case SYNTH_MIXED:
+            for (uint32_t r = 0; r < regions && ok; ++r) {
+                uint64_t virt_addr = (uint64_t) r << large;
+                if (r % 2 == 0) {
+                    ok = synth_map(s, virt_addr, synth_frame(&seed) & ~((1ULL << large) - 1), large);
+                } else {
+                    for (uint32_t i = 0; i < region_pages && ok; ++i) {
+                        ok = synth_map(s, virt_addr + ((uint64_t) i << 12U), synth_frame(&seed), PAGE_4KB);
+                    }
+                }
+                memset(mapped + r * region_pages, 1, region_pages);
+            }
+            break;
+        case SYNTH_FRAGMENTED:
+        default:
+            for (uint32_t r = 0; r < regions && ok; ++r) {
+                uint32_t runs = (uint32_t) (synth_rand(&seed) % 9);
+                for (uint32_t k = 0; k < runs && ok; ++k) {
+                    uint32_t len = 1 + (uint32_t) (synth_rand(&seed) % 64);
+                    uint32_t first = r * region_pages + (uint32_t) (synth_rand(&seed) % (region_pages - len));
+                    for (uint32_t page = first; page < first + len && ok; ++page) {
+                        ok = synth_map(s, (uint64_t) page << 12U, synth_frame(&seed), PAGE_4KB);
+                        mapped[page] = 1;
+                    }
+                }
+            }
+            break;
+    }
+
+    size_t n = 0;
+    for (uint32_t page = 0; page < SYNTH_WINDOW_PAGES && ok; ++page) {
+        if (mapped[page]) {
+            pages[n++] = (uint64_t) page << 12U;
+        }
+    }
+    free(mapped);
+    return ok ? n : 0;
+}
+
+void
+synth_use(synth_t *const s) {
+    synth_current = s;
+}
+
+config_t
+synth_config(const synth_t *const s) {
+    config_t cfg = {
+            .level=s->level,
+            .root_addr=s->root_addr,
+            .read_func=synth_read,
+            .pse=true,
+            .pse36=s->level == LEGACY,
+            .pat=true,
+            .nxe=true,
+            .maxphyaddr=52,
+    };
+    return cfg;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "v2p.h"
+
+// Synthetic physical memory holding generated page tables
+typedef struct synth {
+    uint8_t *mem;
+    uint64_t size;
+
+    // next free frame
+    uint64_t next;
+
+    // cr3 of the generated tables
+    uint64_t root_addr;
+    paging_mode_t level;
+
+    // number of synth_read calls
+    uint64_t reads;
+} synth_t;
+
+// Allocates size bytes of physical memory with an empty top-level table for level
+bool
+synth_init(synth_t *s, uint64_t size, paging_mode_t level);
+
+void
+synth_free(synth_t *s);
+
+// Maps the page of page_size at virt_addr to phys_addr, allocating the tables on the way.
+// Supports IA32E, LA57, LEGACY (below 4GB) and the first gigabyte of PAE.
+// Returns false if the memory for the tables ran out.
+bool
+synth_map(synth_t *s, uint64_t virt_addr, uint64_t phys_addr, page_size_t page_size);
+
+// Page-table layouts of the translation suite
+typedef enum synth_layout {
+    // one region of physically contiguous 4KB pages
+    SYNTH_DENSE,
+
+    // a single 4KB page in every large-page region
+    SYNTH_SPARSE,
+
+    // every page in 4KB pages
+    SYNTH_ALL_4KB,
+
+    // large pages (2MB for PAE, 4MB for LEGACY) alternating with regions of 4KB pages
+    SYNTH_MIXED,
+
+    // random runs of 4KB pages with holes between them, mapped to random frames
+    SYNTH_FRAGMENTED,
+
+    SYNTH_LAYOUTS,
+} synth_layout_t;
+
+extern const char *const SYNTH_LAYOUT_NAMES[SYNTH_LAYOUTS];
+
+// number of 4KB pages in the window the layouts are generated in:
+// the first gigabyte, which is all synth_map can map with PAE
+#define SYNTH_WINDOW_PAGES (1U << 18U)
+
+// Generates layout in the empty LEGACY or PAE tables of s and stores the virtual address
+// of every mapped 4KB page (large pages split into 4KB ones) in ascending order in pages,
+// which must hold SYNTH_WINDOW_PAGES. Returns their number, 0 if the memory ran out.
+size_t
+synth_generate(synth_t *s, synth_layout_t layout, uint64_t seed, uint64_t *pages);
+
+// memory selected by synth_use
+extern synth_t *synth_current;
+
+// read_func over the memory of synth_use, defined here so that
+// the header-only build can inline it into the walk
+static inline int32_t
+synth_read(void *buf, const uint32_t size, const uint64_t physical_addr) {
+    ++synth_current->reads;
+    if (physical_addr + size > synth_current->size) {
+        return 0;
+    }
+    memcpy(buf, synth_current->mem + physical_addr, size);
+    return size;
+}
+
+// Selects the memory synth_read reads from
+void
+synth_use(synth_t *s);
+
+// config_t translating through s
+config_t
+synth_config(const synth_t *s);
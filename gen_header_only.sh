@@ -1,2 +1,57 @@
-quom src/v2p.c v2p_single.h -I include
-sed -i '' '1s/^/#pragma once /' v2p_single.h
+#!/bin/sh
+# Generates the stb-style single header: the declarations of include/v2p.h,
+# followed by the whole library when V2P_IMPLEMENTATION is defined.
+#
+# usage: gen_header_only.sh [output]   (run from the repository root)
+set -e
+
+out=${1:-v2p_single.h}
+
+# in dependency order
+headers="src/internal.h src/stats.h src/utils.h src/translator.h src/legacy.h src/pae.h src/ia32e.h src/simd.h src/scan.h"
+sources="src/utils.c src/stats.c src/profile.c src/translator.c src/legacy.c src/pae.c src/ia32e.c src/v2p.c
+         src/tlb.c src/shared_tlb.c src/flat.c src/simd.c src/batch.c src/range.c src/enumerate.c src/dump.c src/async.c src/uring.c src/scan.c src/rmap.c src/snapshot.c"
+
+# local includes are pasted in place, so they are dropped
+strip() {
+    sed -e '/^#pragma once/d' -e '/^#include "/d' "$1"
+}
+
+{
+    cat <<'HEADER'
+// v2p_single.h - generated by gen_header_only.sh, do not edit.
+//
+// Define V2P_IMPLEMENTATION in one translation unit before including this file
+// to compile the library into it. All internal functions are static inline there,
+// so the compiler can inline whole walks into the caller. Optional switches,
+// defined before the include:
+//   V2P_READ_FUNC   - function called instead of config_t.read_func,
+//                     so that the physical-memory read is inlined too
+//   V2P_READ_CTX_FUNC - the same for config_t.read_ctx_func, called with config_t.ctx
+//   V2P_ONLY_LEGACY, V2P_ONLY_PAE, V2P_ONLY_IA32E
+//                   - build a single paging mode without the mode dispatch
+//   V2P_STATS       - count walks, reads and faults per thread (v2p_stats_get)
+//
+// The implementation uses mmap, madvise and syscall flags that strict -std=c11
+// hides, so it defines _DEFAULT_SOURCE (not _GNU_SOURCE, whose errno.h declares
+// an error_t of its own). Include this file before any system header in that
+// translation unit, or define _DEFAULT_SOURCE for it on the command line.
+#if defined(V2P_IMPLEMENTATION) && !defined(V2P_SINGLE_HEADER) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+HEADER
+    strip include/v2p.h
+    echo
+    echo '#if defined(V2P_IMPLEMENTATION) && !defined(V2P_SINGLE_HEADER)'
+    echo '#define V2P_SINGLE_HEADER'
+    for f in $headers $sources; do
+        echo
+        echo "//---------------------------------------------------------"
+        echo "// $f"
+        echo "//---------------------------------------------------------"
+        strip "$f"
+    done
+    echo
+    echo '#endif // V2P_IMPLEMENTATION'
+} > "$out"
@@ -1,18 +1,40 @@
-#pragma once
+#ifndef V2P_H
+#define V2P_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef enum paging_mode {
     LEGACY = 2,
     PAE = 3,
+    IA32E = 4,
+
+    // IA-32e paging with 57-bit linear addresses (CR4.LA57 = 1)
+    LA57 = 5,
 } paging_mode_t;
 
+// paging-structure levels, named after the entry that is read at them
+typedef enum paging_level {
+    LEVEL_PTE = 1,
+    LEVEL_PDE = 2,
+    LEVEL_PDPTE = 3,
+    LEVEL_PML4E = 4,
+    LEVEL_PML5E = 5,
+} paging_level_t;
+
 typedef enum error {
     SUCCESS = 0,
     PAGE_FAULT = -1,
     READ_FAULT = -2,
     INVALID_TRANSLATION_TYPE = -3,
+    INSUFFICIENT_BUFFER = -4,
+    NON_CANONICAL_ADDRESS = -5,
 } error_t;
 
 typedef enum page_fault {
@@ -20,6 +42,14 @@ typedef enum page_fault {
     RESERVED_BIT_VIOLATION = (1U << 3U),
 } page_fault_t;
 
+// size of the page a translation ended in, as the number of page-offset bits
+typedef enum page_size {
+    PAGE_4KB = 12,
+    PAGE_2MB = 21,
+    PAGE_4MB = 22,
+    PAGE_1GB = 30,
+} page_size_t;
+
 // TODO: move to legacy.c/pae.c
 enum flags {
     // PDE
@@ -39,16 +69,74 @@ enum flags {
 // функция вернет количество прочитанных байт (меньшее или 0 означает ошибку - выход за пределы памяти)
 typedef int32_t (*pread_func_t)(void *buf, const uint32_t size, const uint64_t physical_addr);
 
+// pread_func_t called with config_t.ctx, so that a backend keeps its state there
+// instead of in globals (e.g. one backend and cache per thread)
+typedef int32_t (*pread_ctx_func_t)(void *ctx, void *buf, uint32_t size, uint64_t physical_addr);
+
+// one read of a vectored read
+typedef struct read_req {
+    void *buf;
+    uint32_t size;
+    uint64_t physical_addr;
+} read_req_t;
+
+// vectored read: performs n reads at once and stores the result of each
+// in results[i], with the same meaning as the return value of pread_func_t
+typedef void (*preadv_func_t)(const read_req_t *reqs, uint32_t n, int32_t *results);
+
+// preadv_func_t called with config_t.ctx
+typedef void (*preadv_ctx_func_t)(void *ctx, const read_req_t *reqs, uint32_t n, int32_t *results);
+
+// returns the host pointer physical memory at physical_addr is resident at and stores
+// in len how many bytes from there on are contiguous in host memory,
+// or NULL if the address is not backed by host memory
+typedef const void *(*pmap_func_t)(uint64_t physical_addr, uint64_t *len);
+
+// pmap_func_t called with config_t.ctx
+typedef const void *(*pmap_ctx_func_t)(void *ctx, uint64_t physical_addr, uint64_t *len);
+
+// read-latency profile of the paging-structure reads, see PROFILER below
+typedef struct v2p_profile v2p_profile_t;
+
+// Walks keep no state outside of their arguments: any number of them may run at once,
+// each with its own config_t, backend and ctx (the ones sharing a config_t only share
+// what its functions do). All callbacks, read, readv and map, have a variant taking ctx.
+// The optional V2P_STATS counters and profiles are per thread or atomic, and so are
+// the cached cpuid results (detect_features, SIMD kernel).
 typedef struct config {
     // paging mode
     paging_mode_t level;
 
     // cr3
-    uint32_t root_addr;
+    uint64_t root_addr;
 
     // function which reads from physical-address
     pread_func_t read_func;
 
+    // optional read taking ctx, used instead of read_func if set
+    pread_ctx_func_t read_ctx_func;
+    void *ctx;
+
+    // optional vectored read, used instead of read_func when several
+    // entries or tables can be fetched at once
+    preadv_func_t readv_func;
+
+    // optional vectored read taking ctx, used instead of readv_func if set
+    preadv_ctx_func_t readv_ctx_func;
+
+    // optional direct map of physical memory: entries are read through the returned
+    // pointers (cached per 4KB table when walking many entries of a table),
+    // read_func is only called for addresses that are not mapped
+    pmap_func_t map_func;
+
+    // optional direct map taking ctx, used instead of map_func if set
+    pmap_ctx_func_t map_ctx_func;
+
+    // optional physical memory mapped into the address space (e.g. with v2p_dump_open):
+    // if set, entries are read from mem_base[0, mem_size) instead of calling read_func
+    const void *mem_base;
+    uint64_t mem_size;
+
     // page-size extensions for 32-bit paging
     bool pse;
 
@@ -78,6 +166,12 @@ typedef struct config {
 
     // physical-address width supported by the processor
     uint8_t maxphyaddr;
+
+    // take pat and maxphyaddr from cpuid instead
+    bool detect_features;
+
+    // optional: the reads of the single walks are timed with rdtsc into this profile
+    v2p_profile_t *profile;
 } config_t;
 
 
@@ -91,3 +185,517 @@ typedef struct config {
 error_t
 va2pa(uint32_t virt_addr, const config_t *cfg, uint64_t *phys_addr, uint32_t *page_fault);
 
+// va2pa for 64-bit linear addresses. In IA32E and LA57 modes virt_addr must be canonical
+// (NON_CANONICAL_ADDRESS otherwise), in 32-bit modes its upper half is ignored.
+error_t
+va2pa64(uint64_t virt_addr, const config_t *cfg, uint64_t *phys_addr, uint32_t *page_fault);
+
+// Resumes an IA32E or LA57 walk of virt_addr from entry, a present and already checked
+// entry read at level that references the next paging structure
+// (e.g. LEVEL_PML4E resumes from the read of the PDPTE).
+error_t
+va2pa64_resume(uint64_t virt_addr,
+               paging_level_t level,
+               uint64_t entry,
+               const config_t *cfg,
+               uint64_t *phys_addr,
+               uint32_t *page_fault);
+
+// Translates n addresses at once, reading and checking every distinct
+// paging-structure entry only once per batch. All the entries of a level
+// are fetched with one readv_func call if it is set.
+// Results are stored per address in phys_addrs, errors and page_faults
+// (page_faults[i] is meaningful only if errors[i] == PAGE_FAULT).
+// Returns INVALID_TRANSLATION_TYPE for an unsupported cfg->level, SUCCESS otherwise.
+error_t
+va2pa_batch(const uint32_t *virt_addrs,
+            size_t n,
+            const config_t *cfg,
+            uint64_t *phys_addrs,
+            error_t *errors,
+            uint32_t *page_faults);
+
+// Translates n addresses keeping up to in_flight walks (at most 64) interleaved:
+// the next entry of every walk is prefetched, and the other walks advance while
+// it is being loaded. Meant for large tables in host memory (mem_base or map_func),
+// where a single walk stalls on each of its dependent loads.
+// Results and return values are the same as the ones of va2pa_batch.
+error_t
+va2pa_batch_interleaved(const uint32_t *virt_addrs,
+                        size_t n,
+                        const config_t *cfg,
+                        size_t in_flight,
+                        uint64_t *phys_addrs,
+                        error_t *errors,
+                        uint32_t *page_faults);
+
+// physically contiguous part of a translated virtual range
+typedef struct extent {
+    uint64_t phys_addr;
+    uint64_t len;
+} extent_t;
+
+// Translates [virt_addr, virt_addr + len) into at most max_extents physical extents,
+// merging physically adjacent pages. Every paging-structure entry is read once,
+// consecutive entries of a table are read with a single read_func call.
+// n_extents - number of extents stored
+// done - number of bytes described by the extents; on error it is the offset
+// of the first byte that could not be translated (INSUFFICIENT_BUFFER if
+// the extents ran out), so translation can be resumed from virt_addr + done.
+// The range is truncated at the end of the 32-bit address space.
+error_t
+va2pa_range(uint32_t virt_addr,
+            uint64_t len,
+            const config_t *cfg,
+            extent_t *extents,
+            size_t max_extents,
+            size_t *n_extents,
+            uint64_t *done,
+            uint32_t *page_fault);
+
+//---------------------------------------------------------
+// TRANSLATOR
+//---------------------------------------------------------
+// config_t compiled for repeated translation: the reserved-bit masks of
+// every level and the walker of the paging mode are selected once
+typedef struct translator translator_t;
+
+// Copies cfg and precomputes everything its walks depend on.
+// Returns NULL if out of memory. Changing cfg afterwards has no effect on the translator.
+translator_t *
+v2p_translator_init(const config_t *cfg);
+
+void
+v2p_translator_free(translator_t *tr);
+
+// va2pa64 with a translator
+error_t
+v2p_translate(const translator_t *tr, uint64_t virt_addr, uint64_t *phys_addr, uint32_t *page_fault);
+
+//---------------------------------------------------------
+// ENUMERATION
+//---------------------------------------------------------
+// present mapping of a page
+typedef struct mapping {
+    uint64_t virt_addr;
+    uint64_t phys_addr;
+    page_size_t page_size;
+
+    // the leaf paging-structure entry with its physical-address bits cleared
+    uint64_t flags;
+} mapping_t;
+
+// called for every mapping, returning false stops the enumeration
+typedef bool (*mapping_visitor_t)(const mapping_t *mapping, void *arg);
+
+// Visits every present mapping reachable from cfg->root_addr in ascending
+// virtual-address order. Each page directory and page table is fetched with one
+// read_func call of the whole table (the page tables of a directory in groups
+// with one readv_func call if it is set); entries failing the same checks as
+// va2pa are skipped together with their subtree.
+// Returns READ_FAULT if some table could not be read (its subtree is skipped too).
+error_t
+v2p_enumerate(const config_t *cfg, mapping_visitor_t visit, void *arg);
+
+// v2p_enumerate on n_threads threads (0 - one per online cpu), also for IA32E and LA57.
+// The tables referenced by each table are scanned as separate tasks, which idle
+// threads steal from busy ones. Every thread keeps the mappings it found and sorts
+// them, then visit is called from the calling thread in ascending virtual-address
+// order (upper-half 64-bit addresses last). The read functions of cfg must be
+// thread-safe. Returns INSUFFICIENT_BUFFER if out of memory, otherwise as v2p_enumerate.
+error_t
+v2p_enumerate_parallel(const config_t *cfg, uint32_t n_threads, mapping_visitor_t visit, void *arg);
+
+//---------------------------------------------------------
+// TRANSLATION CACHE
+//---------------------------------------------------------
+#define TLB_WAYS 4
+#define TLB_4KB_SETS 64
+#define TLB_LARGE_SETS 16
+#define TLB_PDPTE_SETS 4
+#define TLB_PDE_SETS 16
+
+typedef struct tlb_entry {
+    // physical address of the first byte of the page,
+    // or the paging-structure entry itself for the paging-structure caches
+    uint64_t value;
+
+    // bits of the linear address the entry covers (virt_addr >> page size)
+    uint32_t tag;
+
+    // cr3 the translation was made with
+    uint64_t root_addr;
+
+    // paging mode the translation was made with
+    paging_mode_t level;
+
+    bool valid;
+} tlb_entry_t;
+
+typedef struct tlb_set {
+    tlb_entry_t ways[TLB_WAYS];
+
+    // way to be evicted by the next fill
+    uint8_t victim;
+} tlb_set_t;
+
+// Set-associative cache of successful translations, owned by the caller.
+// Only the results of va2pa are cached, so the cache must be flushed
+// whenever the tables or the config_t flags it was filled with change.
+typedef struct tlb {
+    tlb_set_t sets_4kb[TLB_4KB_SETS];
+    tlb_set_t sets_2mb[TLB_LARGE_SETS];
+    tlb_set_t sets_4mb[TLB_LARGE_SETS];
+
+    // Paging-structure caches: already validated PDPTEs (tagged with bits 31:30)
+    // and PDEs referencing a page table (tagged with bits 31:21, or 31:22 for LEGACY),
+    // so a leaf miss only reads the levels below them
+    tlb_set_t pdpte_cache[TLB_PDPTE_SETS];
+    tlb_set_t pde_cache[TLB_PDE_SETS];
+} tlb_t;
+
+// drops every cached translation
+void
+v2p_tlb_init(tlb_t *tlb);
+
+// same as va2pa, but the translation is looked up in tlb first and
+// successful walks are stored in it
+error_t
+va2pa_tlb(uint32_t virt_addr, const config_t *cfg, tlb_t *tlb, uint64_t *phys_addr, uint32_t *page_fault);
+
+// invlpg: drops the translations of the page containing virt_addr for every cr3
+// and, like the processor does, the whole paging-structure caches
+void
+v2p_tlb_invlpg(tlb_t *tlb, uint32_t virt_addr);
+
+// drops every cached translation
+void
+v2p_tlb_flush(tlb_t *tlb);
+
+// mov to cr3: drops every translation cached for root_addr
+void
+v2p_tlb_flush_root(tlb_t *tlb, uint64_t root_addr);
+
+//---------------------------------------------------------
+// SHARED TRANSLATION CACHE
+//---------------------------------------------------------
+// Direct-mapped cache of successful 4KB-page translations shared by any number of
+// threads: lookups never write and never wait, fills racing for an entry are dropped
+// instead of blocking, and a flush invalidates every entry at once by advancing
+// an epoch. Like tlb_t, it must be flushed when the tables or the config_t flags change.
+typedef struct shared_tlb shared_tlb_t;
+
+// Cache of n_entries (rounded up to a power of two) entries, NULL if out of memory
+shared_tlb_t *
+v2p_shared_tlb_init(uint32_t n_entries);
+
+void
+v2p_shared_tlb_free(shared_tlb_t *tlb);
+
+// same as va2pa, but the translation is looked up in tlb first and
+// successful walks are stored in it; safe to call from many threads at once
+error_t
+va2pa_shared_tlb(uint32_t virt_addr, const config_t *cfg, shared_tlb_t *tlb, uint64_t *phys_addr, uint32_t *page_fault);
+
+// drops the translation of the page containing virt_addr for every cr3
+void
+v2p_shared_tlb_invlpg(shared_tlb_t *tlb, uint32_t virt_addr);
+
+// drops every cached translation in O(1), walks in progress do not fill stale entries
+void
+v2p_shared_tlb_flush(shared_tlb_t *tlb);
+
+//---------------------------------------------------------
+// PHYSICAL MEMORY DUMPS
+//---------------------------------------------------------
+// raw physical-memory image mapped with mmap
+typedef struct dump {
+    const void *base;
+    uint64_t size;
+    int fd;
+} dump_t;
+
+// expected access pattern, passed to madvise
+typedef enum dump_access {
+    // single translations jumping between tables
+    DUMP_RANDOM,
+
+    // enumeration and range translation walking tables in order
+    DUMP_SEQUENTIAL,
+} dump_access_t;
+
+// Maps the raw physical-memory image at path read-only, byte i of the file being
+// physical address i. Returns READ_FAULT if the file could not be opened or mapped.
+error_t
+v2p_dump_open(const char *path, dump_access_t access, dump_t *dump);
+
+// Changes the madvise hint of an open dump
+void
+v2p_dump_advise(const dump_t *dump, dump_access_t access);
+
+// Makes cfg read the paging structures straight from the dump
+void
+v2p_dump_attach(const dump_t *dump, config_t *cfg);
+
+void
+v2p_dump_close(dump_t *dump);
+
+//---------------------------------------------------------
+// FLAT TABLES
+//---------------------------------------------------------
+// number of 4KB pages of the 32-bit address space
+#define V2P_FLAT_PAGES (1U << 20U)
+
+// Result of va2pa for every 4KB page of a LEGACY or PAE address space (8MB), so that
+// a translation is one load: entries[virt_addr >> 12] is the physical address of the
+// page with bit 0 set, or, with bit 0 clear, -error_t in bits 3:1 and the page-fault
+// code in bits 63:32. Must be built again whenever the tables or the config_t change.
+typedef struct flat_table {
+    uint64_t *entries;
+} flat_table_t;
+
+// Walks every page of cfg once, reading each paging-structure entry once, into flat.
+// huge_pages asks for the table to be backed by transparent huge pages (MADV_HUGEPAGE).
+// Returns INVALID_TRANSLATION_TYPE for other paging modes, INSUFFICIENT_BUFFER if
+// out of memory. Reads that fail are stored as READ_FAULT entries.
+error_t
+v2p_flat_build(const config_t *cfg, bool huge_pages, flat_table_t *flat);
+
+// va2pa of the config flat was built with
+error_t
+v2p_flat_translate(const flat_table_t *flat, uint32_t virt_addr, uint64_t *phys_addr, uint32_t *page_fault);
+
+void
+v2p_flat_free(flat_table_t *flat);
+
+//---------------------------------------------------------
+// ASYNCHRONOUS WALKS
+//---------------------------------------------------------
+// Physical reads completing out of band.
+// submit queues a read of size bytes at physical_addr into buf, identified by tag;
+// it returns false if no more reads can be queued until the next reap.
+// reap sends every queued read, waits until at least one read is finished and
+// stores the tags and results (as the return value of pread_func_t) of at most
+// max finished reads, returning their number; 0 means the backend failed.
+// Reads submitted before a failure may still finish and be returned by later reaps.
+typedef struct async_backend {
+    void *arg;
+    bool (*submit)(void *arg, void *buf, uint32_t size, uint64_t physical_addr, uint64_t tag);
+    uint32_t (*reap)(void *arg, uint64_t *tags, int32_t *results, uint32_t max);
+} async_backend_t;
+
+// Called once per finished walk with the results of va2pa64
+// (page_fault is meaningful only if err == PAGE_FAULT)
+typedef void (*walk_done_func_t)(void *user_data, uint64_t virt_addr, error_t err, uint64_t phys_addr, uint32_t page_fault);
+
+// Walks suspended on their pending reads
+typedef struct async_walker async_walker_t;
+
+// Up to max_walks concurrent walks with the paging mode and flags of cfg,
+// reading through backend instead of the read functions of cfg.
+// Returns NULL for an unsupported cfg->level or if out of memory.
+async_walker_t *
+v2p_async_init(const config_t *cfg, const async_backend_t *backend, uint32_t max_walks, walk_done_func_t done);
+
+// Reaps the reads still in flight first, so that the backend (still open)
+// does not complete them into freed memory
+void
+v2p_async_free(async_walker_t *w);
+
+// Starts the walk of virt_addr, done is called with user_data when it ends
+// (right away for non-canonical addresses). Returns INSUFFICIENT_BUFFER if
+// max_walks walks are already in progress, SUCCESS otherwise.
+error_t
+v2p_async_submit(async_walker_t *w, uint64_t virt_addr, void *user_data);
+
+// Submits the reads of every walk waiting for one with a single reap, then
+// resumes the walks whose reads finished. done may submit new walks.
+// If the backend fails, every walk in progress ends with READ_FAULT; the ones
+// with a read submitted keep their slot until a later reap returns the read.
+// Returns the number of walks still in progress.
+uint32_t
+v2p_async_poll(async_walker_t *w);
+
+// Polls until every walk is finished
+void
+v2p_async_drain(async_walker_t *w);
+
+// Raw physical-memory image (byte i of the file being physical address i)
+// read with io_uring
+typedef struct uring_file uring_file_t;
+
+// Opens path with a ring of depth reads in flight (clamped by the kernel).
+// Returns NULL if the file could not be opened or io_uring is not available.
+uring_file_t *
+v2p_uring_open(const char *path, uint32_t depth);
+
+// Backend for v2p_async_init reading from the file of u
+async_backend_t
+v2p_uring_backend(uring_file_t *u);
+
+void
+v2p_uring_close(uring_file_t *u);
+
+//---------------------------------------------------------
+// REVERSE MAP
+//---------------------------------------------------------
+// page of len bytes at phys_addr mapped at virt_addr
+typedef struct rmap_range {
+    uint64_t virt_addr;
+    uint64_t phys_addr;
+    uint64_t len;
+} rmap_range_t;
+
+// Physical-to-virtual index of the mappings of a table tree: one array per page
+// size sorted by physical address, a large page being a single entry
+typedef struct rmap rmap_t;
+
+// Builds the reverse map of every mapping v2p_enumerate_parallel would visit.
+// Returns INVALID_TRANSLATION_TYPE for an unsupported cfg->level, INSUFFICIENT_BUFFER
+// if out of memory (*rmap is NULL then) and READ_FAULT if some table could not be
+// read (the map of the readable tables is built).
+error_t
+v2p_rmap_build(const config_t *cfg, rmap_t **rmap);
+
+void
+v2p_rmap_free(rmap_t *rmap);
+
+// Stores in ranges every page containing phys_addr, at most max_ranges of them,
+// with O(log n) searches. Returns INSUFFICIENT_BUFFER if there are more.
+error_t
+v2p_rmap_lookup(const rmap_t *rmap, uint64_t phys_addr, rmap_range_t *ranges, uint32_t max_ranges, uint32_t *n_ranges);
+
+// Replaces the pages intersecting [virt_addr, virt_addr + len) with the ones walked
+// from cfg again, only the tables of that subtree are read. Errors are the ones of
+// v2p_rmap_build; on INSUFFICIENT_BUFFER the map is left unchanged.
+error_t
+v2p_rmap_rebuild(rmap_t *rmap, const config_t *cfg, uint64_t virt_addr, uint64_t len);
+
+// number of pages in the map
+size_t
+v2p_rmap_size(const rmap_t *rmap);
+
+//---------------------------------------------------------
+// SNAPSHOTS
+//---------------------------------------------------------
+typedef enum diff_kind {
+    DIFF_ADDED,
+    DIFF_REMOVED,
+
+    // mapped before and after by a page of the same size, to another physical
+    // address or with other flags (the accessed and dirty bits aside). A change
+    // of the page size is reported as DIFF_REMOVED of the old page followed by
+    // DIFF_ADDED of the new ones
+    DIFF_REMAPPED,
+} diff_kind_t;
+
+// virtual range [virt_addr, virt_addr + len) whose pages changed the same way
+typedef struct diff_range {
+    diff_kind_t kind;
+    uint64_t virt_addr;
+    uint64_t len;
+} diff_range_t;
+
+// called for every changed range, returning false stops the reports (not the update)
+typedef bool (*diff_visitor_t)(const diff_range_t *range, void *arg);
+
+// Copy of every paging structure reachable from cr3 with a hash of its contents
+typedef struct snapshot snapshot_t;
+
+// Reads every table reachable from cfg->root_addr into a new snapshot.
+// Returns INVALID_TRANSLATION_TYPE for an unsupported cfg->level, INSUFFICIENT_BUFFER
+// if out of memory (*snapshot is NULL then) and READ_FAULT if some table could not
+// be read (its unread entries are recorded as not present).
+error_t
+v2p_snapshot_take(const config_t *cfg, snapshot_t **snapshot);
+
+// Reads the tables again and reports the ranges that changed since the snapshot in
+// ascending virtual-address order, merging adjacent ranges of the same kind; the
+// snapshot then describes the current tables. Every table is read and hashed, but
+// only the entries of tables whose hash changed are decoded and compared, so the
+// cost beyond the reads is proportional to the churn. cfg->level must be the one
+// the snapshot was taken with (INVALID_TRANSLATION_TYPE otherwise). Returns
+// INSUFFICIENT_BUFFER if out of memory, after which the snapshot lacks the subtrees
+// it could not copy (they are reported as added by the next update), otherwise
+// as v2p_snapshot_take.
+error_t
+v2p_snapshot_update(snapshot_t *snapshot, const config_t *cfg, diff_visitor_t visit, void *arg);
+
+void
+v2p_snapshot_free(snapshot_t *snapshot);
+
+//---------------------------------------------------------
+// STATISTICS
+//---------------------------------------------------------
+// Counters of the single walks (va2pa, va2pa64, v2p_translate and the walks batches
+// fall back to), kept per thread only if the library is compiled with V2P_STATS
+typedef struct v2p_stats {
+    uint64_t walks;
+
+    // paging-structure entries read by the walks
+    uint64_t walk_reads;
+
+    // physical-memory reads of the whole library (read_func, map_func or mem_base)
+    uint64_t reads;
+
+    // walks by the level of the last entry they read, indexed by paging_level_t
+    uint64_t ended_at[LEVEL_PML5E + 1];
+
+    // successful walks by the size of the page they ended in
+    uint64_t pages_4kb;
+    uint64_t pages_2mb;
+    uint64_t pages_4mb;
+    uint64_t pages_1gb;
+
+    // failed walks by reason
+    uint64_t not_present;
+    uint64_t reserved_bit;
+    uint64_t read_faults;
+    uint64_t non_canonical;
+} v2p_stats_t;
+
+// Sums the counters of every thread, the ones that exited included.
+// Returns false (with stats zeroed) if the library was compiled without V2P_STATS.
+bool
+v2p_stats_get(v2p_stats_t *stats);
+
+//---------------------------------------------------------
+// PROFILER
+//---------------------------------------------------------
+// Buckets of a level: values below 8 exactly, then every power of two
+// split into 8 linear buckets (at most 12.5% wider than their lower bound)
+#define V2P_PROFILE_BUCKETS 496
+
+// Log-linear histograms of the cycles a read of the backend (read_func, map_func
+// or mem_base, whichever cfg uses) took, per paging level of the read entry.
+// Filled from any number of threads by the single walks of the configs pointing at it.
+struct v2p_profile {
+    // one in every sample_every reads is timed (every read if 0 or 1)
+    uint32_t sample_every;
+
+    uint64_t samples[LEVEL_PML5E + 1];
+    uint64_t buckets[LEVEL_PML5E + 1][V2P_PROFILE_BUCKETS];
+};
+
+// Clears the histograms, sample_every is kept
+void
+v2p_profile_reset(v2p_profile_t *profile);
+
+// Adds a read of an entry at level that took cycles, e.g. one timed by the caller's backend
+void
+v2p_profile_record(v2p_profile_t *profile, paging_level_t level, uint64_t cycles);
+
+// Upper bound of the bucket holding the given percentile (0-100) of the reads at level,
+// 0 if there are none
+uint64_t
+v2p_profile_percentile(const v2p_profile_t *profile, paging_level_t level, double percentile);
+
+// Prints the number of samples and p50/p90/p99/p99.9/max cycles of every level read
+void
+v2p_profile_dump(const v2p_profile_t *profile, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // V2P_H
@@ -0,0 +1,300 @@
+#pragma once
+
+// C++17 front-end: the walks of va2pa as templates over the paging mode, the
+// paging features and the backend reading physical memory. Everything a walk
+// depends on is a compile-time constant, so the reserved-bit masks fold into
+// immediates and the reads of the backend are inlined into the walk.
+//
+//     v2p::memory_backend mem{dump.base, dump.size};
+//     error_t err = v2p::translate<PAE, v2p::features<true, false, true, true>>(mem, cr3, va, &phys, &page_fault);
+//
+// Results are the same as the ones of va2pa64 with the equivalent config_t.
+
+#include <cstdint>
+#include <cstring>
+
+#include "v2p.h"
+
+namespace v2p {
+
+// CR4.PSE, PSE-36, PAT, IA32_EFER.NXE and MAXPHYADDR of config_t
+template <bool Pse = true, bool Pse36 = false, bool Pat = true, bool Nxe = true, uint8_t MaxPhyAddr = 52>
+struct features {
+    static constexpr bool pse = Pse;
+    static constexpr bool pse36 = Pse36;
+    static constexpr bool pat = Pat;
+    static constexpr bool nxe = Nxe;
+    static constexpr uint8_t maxphyaddr = MaxPhyAddr;
+};
+
+// A backend is any type with
+//     template <typename T> bool read(uint64_t physical_addr, T *value) const;
+// reading sizeof(T) bytes of physical memory, false on failure.
+
+// physical memory mapped at base, e.g. with v2p_dump_open
+struct memory_backend {
+    const void *base;
+    uint64_t size;
+
+    template <typename T>
+    bool
+    read(const uint64_t physical_addr, T *const value) const {
+        if (physical_addr >= size || sizeof(T) > size - physical_addr) {
+            return false;
+        }
+        std::memcpy(value, static_cast<const uint8_t *>(base) + physical_addr, sizeof(T));
+        return true;
+    }
+};
+
+// read_func of the C API
+struct callback_backend {
+    pread_func_t read_func;
+
+    template <typename T>
+    bool
+    read(const uint64_t physical_addr, T *const value) const {
+        return read_func(value, sizeof(T), physical_addr) > 0;
+    }
+};
+
+// read_ctx_func of the C API with its ctx
+struct callback_ctx_backend {
+    pread_ctx_func_t read_func;
+    void *ctx;
+
+    template <typename T>
+    bool
+    read(const uint64_t physical_addr, T *const value) const {
+        return read_func(ctx, value, sizeof(T), physical_addr) > 0;
+    }
+};
+
+namespace detail {
+
+// comp_mask of utils.h
+constexpr uint64_t
+mask(const uint8_t l, const uint8_t r) {
+    uint64_t a = r != 0 ? ~((1ULL << r) - 1) : ~0ULL;
+    uint64_t b = l == 63 ? ~0ULL : (1ULL << (l + 1U)) - 1;
+    return a & b;
+}
+
+constexpr bool
+bit(const uint64_t x, const uint8_t n) {
+    return (x >> n) & 1U;
+}
+
+constexpr uint8_t
+min(const uint8_t a, const uint8_t b) {
+    return a < b ? a : b;
+}
+
+constexpr bool
+is_canonical(const uint64_t virt_addr, const uint8_t width) {
+    uint64_t upper = virt_addr & mask(63, width - 1);
+    return upper == 0 || upper == mask(63, width - 1);
+}
+
+// Reserved bits of present entries, as in legacy_reserved_masks,
+// pae_reserved_masks and ia32e_reserved_masks
+template <paging_mode_t Mode, typename F>
+struct reserved {
+    static constexpr uint64_t
+    pse_pde() {
+        if constexpr (!F::pse) {
+            return 0;
+        } else if constexpr (F::pse36) {
+            return mask(21, min(40, F::maxphyaddr) - 19);
+        } else {
+            return mask(21, 13);
+        }
+    }
+
+    static constexpr uint64_t
+    common() {
+        // bits 62:M for PAE, 51:M for IA-32e, XD without NXE
+        uint64_t m = mask(Mode == PAE ? 62 : 51, F::maxphyaddr);
+        return F::nxe ? m : m | mask(63, 63);
+    }
+
+    static constexpr uint64_t pml4e = common() | mask(7, 7);
+    static constexpr uint64_t pdpte = common();
+    static constexpr uint64_t pdpte_1gb = common() | mask(29, 13) | (F::pat ? 0 : mask(12, 12));
+
+    static constexpr uint64_t pde = Mode == LEGACY ? pse_pde() : common();
+    static constexpr uint64_t pde_large = Mode == LEGACY
+                                          ? pse_pde() | (F::pse && !F::pat ? mask(12, 12) : 0)
+                                          : common() | mask(20, 13) | (F::pat ? 0 : mask(12, 12));
+
+    static constexpr uint64_t pte = Mode == LEGACY
+                                    ? (F::pse && !F::pat ? mask(7, 7) : 0)
+                                    : common() | (F::pat ? 0 : mask(7, 7));
+};
+
+// Present flag and reserved bits of an entry
+inline error_t
+check(const uint64_t entry, const uint64_t reserved_mask, uint32_t *const page_fault) {
+    if (!bit(entry, 0)) {
+        *page_fault = NOT_PRESENT;
+        return PAGE_FAULT;
+    }
+    if (entry & reserved_mask) {
+        *page_fault = RESERVED_BIT_VIOLATION;
+        return PAGE_FAULT;
+    }
+    return SUCCESS;
+}
+
+template <typename F, typename Backend>
+error_t
+walk_legacy(const Backend &backend,
+            const uint64_t root_addr,
+            const uint32_t virt_addr,
+            uint64_t *const phys_addr,
+            uint32_t *const page_fault) {
+    using r = reserved<LEGACY, F>;
+
+    uint32_t pde;
+    uint64_t pde_addr = (root_addr & mask(31, 12)) | ((virt_addr >> 20U) & mask(11, 2));
+    if (!backend.read(pde_addr, &pde)) {
+        return READ_FAULT;
+    }
+    error_t err = check(pde, bit(pde, PS_PDE4MB) ? r::pde_large : r::pde, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+    if (F::pse && bit(pde, PS_PDE4MB)) {
+        *phys_addr = ((uint64_t) (pde & mask(20, 13)) << 19U) | (pde & mask(31, 22)) | (virt_addr & mask(21, 0));
+        return SUCCESS;
+    }
+
+    uint32_t pte;
+    uint64_t pte_addr = (pde & mask(31, 12)) | ((virt_addr >> 10U) & mask(11, 2));
+    if (!backend.read(pte_addr, &pte)) {
+        return READ_FAULT;
+    }
+    err = check(pte, r::pte, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+    *phys_addr = (pte & mask(31, 12)) | (virt_addr & mask(11, 0));
+    return SUCCESS;
+}
+
+template <typename F, typename Backend>
+error_t
+walk_pae(const Backend &backend,
+         const uint32_t virt_addr,
+         uint64_t *const phys_addr,
+         uint32_t *const page_fault) {
+    using r = reserved<PAE, F>;
+
+    // Bits 31:30 of the linear address select a PDPTE register (read like va2pa_pae does)
+    uint64_t pdpte;
+    if (!backend.read(virt_addr & mask(31, 30), &pdpte)) {
+        return READ_FAULT;
+    }
+    error_t err = check(pdpte, 0, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    uint64_t pde;
+    if (!backend.read((pdpte & mask(51, 12)) | ((virt_addr >> 18U) & mask(11, 3)), &pde)) {
+        return READ_FAULT;
+    }
+    err = check(pde, bit(pde, 7) ? r::pde_large : r::pde, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+    if (bit(pde, 7)) {
+        *phys_addr = (pde & mask(51, 21)) | (virt_addr & mask(20, 0));
+        return SUCCESS;
+    }
+
+    uint64_t pte;
+    if (!backend.read((pde & mask(51, 12)) | ((virt_addr >> 9U) & mask(11, 3)), &pte)) {
+        return READ_FAULT;
+    }
+    err = check(pte, r::pte, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+    *phys_addr = (pte & mask(51, 12)) | (virt_addr & mask(11, 0));
+    return SUCCESS;
+}
+
+template <paging_mode_t Mode, typename F, typename Backend>
+error_t
+walk_ia32e(const Backend &backend,
+           const uint64_t root_addr,
+           const uint64_t virt_addr,
+           uint64_t *const phys_addr,
+           uint32_t *const page_fault) {
+    using r = reserved<Mode, F>;
+    constexpr uint8_t top_shift = Mode == LA57 ? 48 : 39;
+
+    if (!is_canonical(virt_addr, Mode == LA57 ? 57 : 48)) {
+        return NON_CANONICAL_ADDRESS;
+    }
+
+    // PML5E (LA57 only) and PML4E
+    uint64_t entry = root_addr;
+    for (uint8_t shift = top_shift; shift >= 39; shift -= 9) {
+        uint64_t addr = (entry & mask(51, 12)) | (((virt_addr >> shift) << 3U) & mask(11, 3));
+        if (!backend.read(addr, &entry)) {
+            return READ_FAULT;
+        }
+        error_t err = check(entry, r::pml4e, page_fault);
+        if (err != SUCCESS) {
+            return err;
+        }
+    }
+
+    // PDPTE, PDE and PTE, the first two of which may map a page
+    constexpr uint8_t shifts[] = {30, 21, 12};
+    for (uint8_t shift : shifts) {
+        uint64_t addr = (entry & mask(51, 12)) | (((virt_addr >> shift) << 3U) & mask(11, 3));
+        if (!backend.read(addr, &entry)) {
+            return READ_FAULT;
+        }
+        bool maps_page = shift == 12 || bit(entry, 7);
+        uint64_t reserved_mask = shift == 30 ? (maps_page ? r::pdpte_1gb : r::pdpte)
+                                 : shift == 21 ? (maps_page ? r::pde_large : r::pde)
+                                 : r::pte;
+        error_t err = check(entry, reserved_mask, page_fault);
+        if (err != SUCCESS) {
+            return err;
+        }
+        if (maps_page) {
+            *phys_addr = (entry & mask(51, shift)) | (virt_addr & mask(shift - 1, 0));
+            return SUCCESS;
+        }
+    }
+    return SUCCESS;
+}
+
+} // namespace detail
+
+// va2pa64 for the config_t of Mode and F, reading through backend.
+// In 32-bit modes the upper half of virt_addr is ignored.
+template <paging_mode_t Mode, typename F = features<>, typename Backend>
+error_t
+translate(const Backend &backend,
+          const uint64_t root_addr,
+          const uint64_t virt_addr,
+          uint64_t *const phys_addr,
+          uint32_t *const page_fault) {
+    static_assert(Mode == LEGACY || Mode == PAE || Mode == IA32E || Mode == LA57, "unsupported paging mode");
+
+    if constexpr (Mode == LEGACY) {
+        return detail::walk_legacy<F>(backend, root_addr, (uint32_t) virt_addr, phys_addr, page_fault);
+    } else if constexpr (Mode == PAE) {
+        return detail::walk_pae<F>(backend, (uint32_t) virt_addr, phys_addr, page_fault);
+    } else {
+        return detail::walk_ia32e<Mode, F>(backend, root_addr, virt_addr, phys_addr, page_fault);
+    }
+}
+
+} // namespace v2p
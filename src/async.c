@@ -0,0 +1,437 @@
+#include <stdlib.h>
+
+#include "v2p.h"
+#include "translator.h"
+#include "legacy.h"
+#include "pae.h"
+#include "ia32e.h"
+#include "utils.h"
+
+// Paging-structure level of a suspended walk in terms of the per-level steps.
+// maps_page is NULL for levels that always (phys set) or never (phys NULL) map a page.
+typedef struct async_level {
+    uint32_t entry_size;
+    uint64_t (*addr)(const translator_t *tr, uint64_t parent, uint64_t virt_addr);
+    error_t (*check)(uint64_t entry, const translator_t *tr, uint32_t *page_fault);
+    bool (*maps_page)(uint64_t entry, const translator_t *tr);
+    uint64_t (*phys)(uint64_t entry, uint64_t virt_addr);
+} async_level_t;
+
+//---------------------------------------------------------
+// LEGACY
+//---------------------------------------------------------
+static uint64_t
+async_legacy_pde_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return legacy_pde_addr(tr, (uint32_t) virt_addr);
+}
+
+static error_t
+async_legacy_check_pde(const uint64_t entry, const translator_t *const tr, uint32_t *const page_fault) {
+    return legacy_check_pde((uint32_t) entry, tr, page_fault);
+}
+
+static bool
+async_legacy_pde_maps_page(const uint64_t entry, const translator_t *const tr) {
+    return legacy_pde_maps_page((uint32_t) entry, tr);
+}
+
+static uint64_t
+async_legacy_pde_phys(const uint64_t entry, const uint64_t virt_addr) {
+    return legacy_pde_phys((uint32_t) entry, (uint32_t) virt_addr);
+}
+
+static uint64_t
+async_legacy_pte_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return legacy_pte_addr((uint32_t) parent, (uint32_t) virt_addr);
+}
+
+static error_t
+async_legacy_check_pte(const uint64_t entry, const translator_t *const tr, uint32_t *const page_fault) {
+    return legacy_check_pte((uint32_t) entry, tr, page_fault);
+}
+
+static uint64_t
+async_legacy_pte_phys(const uint64_t entry, const uint64_t virt_addr) {
+    return legacy_pte_phys((uint32_t) entry, (uint32_t) virt_addr);
+}
+
+static const async_level_t ASYNC_LEGACY_LEVELS[] = {
+        {sizeof(uint32_t), async_legacy_pde_addr, async_legacy_check_pde, async_legacy_pde_maps_page, async_legacy_pde_phys},
+        {sizeof(uint32_t), async_legacy_pte_addr, async_legacy_check_pte, NULL,                       async_legacy_pte_phys},
+};
+
+//---------------------------------------------------------
+// PAE
+//---------------------------------------------------------
+static uint64_t
+async_pae_pdpte_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return pae_pdpte_addr(tr, (uint32_t) virt_addr);
+}
+
+static uint64_t
+async_pae_pde_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return pae_pde_addr(parent, (uint32_t) virt_addr);
+}
+
+static bool
+async_pae_pde_maps_page(const uint64_t entry, const translator_t *const tr) {
+    return pae_pde_maps_page(entry);
+}
+
+static uint64_t
+async_pae_pde_phys(const uint64_t entry, const uint64_t virt_addr) {
+    return pae_pde_phys(entry, (uint32_t) virt_addr);
+}
+
+static uint64_t
+async_pae_pte_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return pae_pte_addr(parent, (uint32_t) virt_addr);
+}
+
+static uint64_t
+async_pae_pte_phys(const uint64_t entry, const uint64_t virt_addr) {
+    return pae_pte_phys(entry, (uint32_t) virt_addr);
+}
+
+static const async_level_t ASYNC_PAE_LEVELS[] = {
+        {sizeof(uint64_t), async_pae_pdpte_addr, pae_check_pdpte, NULL,                    NULL},
+        {sizeof(uint64_t), async_pae_pde_addr,   pae_check_pde,   async_pae_pde_maps_page, async_pae_pde_phys},
+        {sizeof(uint64_t), async_pae_pte_addr,   pae_check_pte,   NULL,                    async_pae_pte_phys},
+};
+
+//---------------------------------------------------------
+// IA32E, LA57
+//---------------------------------------------------------
+static uint64_t
+async_pml5e_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return ia32e_pml5e_addr(tr, virt_addr);
+}
+
+// top level of 4-level paging, read from cr3
+static uint64_t
+async_pml4e_root_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return ia32e_pml4e_addr(tr->cfg.root_addr, virt_addr);
+}
+
+static uint64_t
+async_pml4e_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return ia32e_pml4e_addr(parent, virt_addr);
+}
+
+static uint64_t
+async_pdpte_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return ia32e_pdpte_addr(parent, virt_addr);
+}
+
+static bool
+async_pdpte_maps_page(const uint64_t entry, const translator_t *const tr) {
+    return ia32e_pdpte_maps_page(entry);
+}
+
+static uint64_t
+async_pde_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return ia32e_pde_addr(parent, virt_addr);
+}
+
+static bool
+async_pde_maps_page(const uint64_t entry, const translator_t *const tr) {
+    return ia32e_pde_maps_page(entry);
+}
+
+static uint64_t
+async_pte_addr(const translator_t *const tr, const uint64_t parent, const uint64_t virt_addr) {
+    return ia32e_pte_addr(parent, virt_addr);
+}
+
+#define ASYNC_IA32E_LOWER_LEVELS \
+        {sizeof(uint64_t), async_pdpte_addr, ia32e_check_pdpte, async_pdpte_maps_page, ia32e_pdpte_phys}, \
+        {sizeof(uint64_t), async_pde_addr,   ia32e_check_pde,   async_pde_maps_page,   ia32e_pde_phys},   \
+        {sizeof(uint64_t), async_pte_addr,   ia32e_check_pte,   NULL,                  ia32e_pte_phys}
+
+static const async_level_t ASYNC_IA32E_LEVELS[] = {
+        {sizeof(uint64_t), async_pml4e_root_addr, ia32e_check_pml4e, NULL, NULL},
+        ASYNC_IA32E_LOWER_LEVELS,
+};
+
+static const async_level_t ASYNC_LA57_LEVELS[] = {
+        {sizeof(uint64_t), async_pml5e_addr, ia32e_check_pml5e, NULL, NULL},
+        {sizeof(uint64_t), async_pml4e_addr, ia32e_check_pml4e, NULL, NULL},
+        ASYNC_IA32E_LOWER_LEVELS,
+};
+
+#undef ASYNC_IA32E_LOWER_LEVELS
+
+//---------------------------------------------------------
+// WALKER
+//---------------------------------------------------------
+typedef enum walk_state {
+    WALK_FREE,
+
+    // waiting for its next read to be submitted
+    WALK_READY,
+
+    // read submitted, waiting for it to be reaped
+    WALK_READING,
+
+    // stuck on a backend that stopped completing reads, until done is called
+    WALK_FAILED,
+    WALK_FAILED_READING,
+
+    // failed while its read was submitted: the backend may still complete the
+    // read into buf, so the walk is only freed once the read is reaped
+    WALK_ABANDONED,
+} walk_state_t;
+
+typedef struct async_walk {
+    walk_state_t state;
+    uint64_t virt_addr;
+    void *user_data;
+    const async_level_t *level;
+
+    // entry of the previous level, and the buffer of the pending read
+    uint64_t entry;
+    uint64_t entry_addr;
+    uint64_t buf;
+} async_walk_t;
+
+struct async_walker {
+    translator_t tr;
+    const async_level_t *levels;
+    async_backend_t backend;
+    walk_done_func_t done;
+
+    async_walk_t *walks;
+    uint32_t max_walks;
+    uint32_t n_active;
+
+    // reads submitted and not reaped yet, abandoned walks included
+    uint32_t n_reading;
+
+    // stacks of free and ready walk indices
+    uint32_t *free_walks;
+    uint32_t n_free;
+    uint32_t *ready;
+    uint32_t n_ready;
+
+    // reap output
+    uint64_t *tags;
+    int32_t *results;
+};
+
+static const async_level_t *
+async_levels(const paging_mode_t level) {
+    switch (level) {
+        case LEGACY:
+            return ASYNC_LEGACY_LEVELS;
+        case PAE:
+            return ASYNC_PAE_LEVELS;
+        case IA32E:
+            return ASYNC_IA32E_LEVELS;
+        case LA57:
+            return ASYNC_LA57_LEVELS;
+        default:
+            return NULL;
+    }
+}
+
+static void
+async_finish(async_walker_t *const w, const uint32_t i, const error_t err, const uint64_t phys_addr, const uint32_t page_fault) {
+    async_walk_t *walk = &w->walks[i];
+    walk->state = WALK_FREE;
+    w->free_walks[w->n_free++] = i;
+    --w->n_active;
+    w->done(walk->user_data, walk->virt_addr, err, phys_addr, page_fault);
+}
+
+// Reports walk i as failed, keeping it out of the free walks until its read is reaped
+static void
+async_abandon(async_walker_t *const w, const uint32_t i) {
+    async_walk_t *walk = &w->walks[i];
+    walk->state = WALK_ABANDONED;
+    --w->n_active;
+    w->done(walk->user_data, walk->virt_addr, READ_FAULT, 0, 0);
+}
+
+// Frees abandoned walk i now that its read is reaped
+static void
+async_release(async_walker_t *const w, const uint32_t i) {
+    w->walks[i].state = WALK_FREE;
+    w->free_walks[w->n_free++] = i;
+}
+
+// Suspends walk i until the entry of its current level is read
+static void
+async_suspend(async_walker_t *const w, const uint32_t i) {
+    async_walk_t *walk = &w->walks[i];
+    walk->entry_addr = walk->level->addr(&w->tr, walk->entry, walk->virt_addr);
+    walk->state = WALK_READY;
+    w->ready[w->n_ready++] = i;
+}
+
+// Checks the entry read by walk i, then finishes the walk or suspends it on the next level
+static void
+async_resume(async_walker_t *const w, const uint32_t i, const int32_t result) {
+    async_walk_t *walk = &w->walks[i];
+    const async_level_t *level = walk->level;
+    if (result <= 0) {
+        async_finish(w, i, READ_FAULT, 0, 0);
+        return;
+    }
+
+    uint32_t page_fault = 0;
+    error_t err = level->check(walk->buf, &w->tr, &page_fault);
+    if (err != SUCCESS) {
+        async_finish(w, i, err, 0, page_fault);
+        return;
+    }
+    if (level->phys != NULL && (level->maps_page == NULL || level->maps_page(walk->buf, &w->tr))) {
+        async_finish(w, i, SUCCESS, level->phys(walk->buf, walk->virt_addr), 0);
+        return;
+    }
+
+    walk->entry = walk->buf;
+    ++walk->level;
+    async_suspend(w, i);
+}
+
+async_walker_t *
+v2p_async_init(const config_t *const cfg,
+               const async_backend_t *const backend,
+               const uint32_t max_walks,
+               const walk_done_func_t done) {
+    const async_level_t *levels = async_levels(cfg->level);
+    if (levels == NULL || max_walks == 0) {
+        return NULL;
+    }
+
+    async_walker_t *w = calloc(1, sizeof(async_walker_t));
+    if (w == NULL) {
+        return NULL;
+    }
+    translator_setup(&w->tr, cfg);
+    w->levels = levels;
+    w->backend = *backend;
+    w->done = done;
+    w->max_walks = max_walks;
+    w->walks = calloc(max_walks, sizeof(async_walk_t));
+    w->free_walks = malloc(max_walks * sizeof(uint32_t));
+    w->ready = malloc(max_walks * sizeof(uint32_t));
+    w->tags = malloc(max_walks * sizeof(uint64_t));
+    w->results = malloc(max_walks * sizeof(int32_t));
+    if (w->walks == NULL || w->free_walks == NULL || w->ready == NULL || w->tags == NULL || w->results == NULL) {
+        v2p_async_free(w);
+        return NULL;
+    }
+
+    // Lowest indices on top
+    for (uint32_t i = 0; i < max_walks; ++i) {
+        w->free_walks[i] = max_walks - 1 - i;
+    }
+    w->n_free = max_walks;
+    return w;
+}
+
+void
+v2p_async_free(async_walker_t *const w) {
+    if (w == NULL) {
+        return;
+    }
+    // The bufs of the walks must outlive the reads the backend may still complete
+    while (w->n_reading > 0) {
+        uint32_t n = w->backend.reap(w->backend.arg, w->tags, w->results, w->max_walks);
+        if (n == 0) {
+            break;
+        }
+        w->n_reading -= n;
+    }
+    free(w->results);
+    free(w->tags);
+    free(w->ready);
+    free(w->free_walks);
+    free(w->walks);
+    free(w);
+}
+
+error_t
+v2p_async_submit(async_walker_t *const w, const uint64_t virt_addr, void *const user_data) {
+    if (w->n_free == 0) {
+        return INSUFFICIENT_BUFFER;
+    }
+    uint32_t i = w->free_walks[--w->n_free];
+    async_walk_t *walk = &w->walks[i];
+    walk->virt_addr = virt_addr;
+    walk->user_data = user_data;
+    walk->level = w->levels;
+    walk->entry = 0;
+    ++w->n_active;
+
+    if ((w->tr.cfg.level == IA32E && !ia32e_is_canonical(virt_addr, 48))
+        || (w->tr.cfg.level == LA57 && !ia32e_is_canonical(virt_addr, 57))) {
+        async_finish(w, i, NON_CANONICAL_ADDRESS, 0, 0);
+        return SUCCESS;
+    }
+    async_suspend(w, i);
+    return SUCCESS;
+}
+
+uint32_t
+v2p_async_poll(async_walker_t *const w) {
+    // Queue the reads of every ready walk, the backend sends them all at once
+    while (w->n_ready > 0) {
+        uint32_t i = w->ready[w->n_ready - 1];
+        async_walk_t *walk = &w->walks[i];
+        walk->buf = 0;
+        if (!w->backend.submit(w->backend.arg, &walk->buf, walk->level->entry_size, walk->entry_addr, i)) {
+            break;
+        }
+        --w->n_ready;
+        walk->state = WALK_READING;
+        ++w->n_reading;
+    }
+
+    uint32_t n = 0;
+    if (w->n_reading > 0) {
+        n = w->backend.reap(w->backend.arg, w->tags, w->results, w->max_walks);
+    }
+
+    if (n == 0) {
+        // Nothing can make progress any more: the backend either failed or
+        // cannot take a single read, so the walks stuck on it fail. The ones
+        // with a read submitted stay abandoned until a later reap returns it.
+        // Walks submitted from the done callbacks below are left for the next poll.
+        for (uint32_t i = 0; i < w->max_walks; ++i) {
+            if (w->walks[i].state == WALK_READY) {
+                w->walks[i].state = WALK_FAILED;
+            } else if (w->walks[i].state == WALK_READING) {
+                w->walks[i].state = WALK_FAILED_READING;
+            }
+        }
+        w->n_ready = 0;
+        for (uint32_t i = 0; i < w->max_walks; ++i) {
+            if (w->walks[i].state == WALK_FAILED) {
+                async_finish(w, i, READ_FAULT, 0, 0);
+            } else if (w->walks[i].state == WALK_FAILED_READING) {
+                async_abandon(w, i);
+            }
+        }
+        return w->n_active;
+    }
+
+    w->n_reading -= n;
+    for (uint32_t k = 0; k < n; ++k) {
+        uint32_t i = (uint32_t) w->tags[k];
+        if (w->walks[i].state == WALK_ABANDONED) {
+            async_release(w, i);
+        } else {
+            async_resume(w, i, w->results[k]);
+        }
+    }
+    return w->n_active;
+}
+
+void
+v2p_async_drain(async_walker_t *const w) {
+    while (w->n_active > 0) {
+        v2p_async_poll(w);
+    }
+}
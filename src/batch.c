@@ -0,0 +1,433 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+#include "translator.h"
+#include "legacy.h"
+#include "pae.h"
+#include "simd.h"
+#include "utils.h"
+
+typedef struct item {
+    uint32_t virt_addr;
+    size_t i;
+
+    // entry read at the previous level, and the request reading the next one
+    uint64_t entry;
+    size_t run;
+    bool pending;
+} item_t;
+
+// One paging-structure entry shared by a run of consecutive items
+typedef struct run {
+    uint64_t entry;
+    error_t err;
+    uint32_t page_fault;
+} run_t;
+
+typedef enum leaf {
+    NEVER,
+    MAYBE,
+    ALWAYS,
+} leaf_t;
+
+// Paging-structure level in terms of the per-level steps of legacy.c and pae.c
+typedef struct level {
+    // items with equal virt_addr >> shift go through the same entry
+    uint8_t shift;
+    uint32_t entry_size;
+    leaf_t leaf;
+
+    uint64_t (*addr)(const translator_t *tr, uint64_t parent, uint32_t virt_addr);
+    error_t (*check)(uint64_t entry, const translator_t *tr, uint32_t *page_fault);
+    bool (*maps_page)(uint64_t entry, const translator_t *tr);
+    uint64_t (*phys)(uint64_t entry, uint32_t virt_addr);
+} level_t;
+
+static uint64_t
+legacy_pde_at(const translator_t *const tr, const uint64_t parent, const uint32_t virt_addr) {
+    return legacy_pde_addr(tr, virt_addr);
+}
+
+static error_t
+legacy_pde_check(const uint64_t entry, const translator_t *const tr, uint32_t *page_fault) {
+    return legacy_check_pde(entry, tr, page_fault);
+}
+
+static bool
+legacy_pde_leaf(const uint64_t entry, const translator_t *const tr) {
+    return legacy_pde_maps_page(entry, tr);
+}
+
+static uint64_t
+legacy_pde_leaf_phys(const uint64_t entry, const uint32_t virt_addr) {
+    return legacy_pde_phys(entry, virt_addr);
+}
+
+static uint64_t
+legacy_pte_at(const translator_t *const tr, const uint64_t parent, const uint32_t virt_addr) {
+    return legacy_pte_addr(parent, virt_addr);
+}
+
+static error_t
+legacy_pte_check(const uint64_t entry, const translator_t *const tr, uint32_t *page_fault) {
+    return legacy_check_pte(entry, tr, page_fault);
+}
+
+static uint64_t
+legacy_pte_leaf_phys(const uint64_t entry, const uint32_t virt_addr) {
+    return legacy_pte_phys(entry, virt_addr);
+}
+
+static uint64_t
+pae_pdpte_at(const translator_t *const tr, const uint64_t parent, const uint32_t virt_addr) {
+    return pae_pdpte_addr(tr, virt_addr);
+}
+
+static uint64_t
+pae_pde_at(const translator_t *const tr, const uint64_t parent, const uint32_t virt_addr) {
+    return pae_pde_addr(parent, virt_addr);
+}
+
+static bool
+pae_pde_leaf(const uint64_t entry, const translator_t *const tr) {
+    return pae_pde_maps_page(entry);
+}
+
+static uint64_t
+pae_pte_at(const translator_t *const tr, const uint64_t parent, const uint32_t virt_addr) {
+    return pae_pte_addr(parent, virt_addr);
+}
+
+static const level_t LEGACY_LEVELS[] = {
+        {PAGE_4MB, sizeof(uint32_t), MAYBE,  legacy_pde_at, legacy_pde_check, legacy_pde_leaf, legacy_pde_leaf_phys},
+        {PAGE_4KB, sizeof(uint32_t), ALWAYS, legacy_pte_at, legacy_pte_check, NULL,            legacy_pte_leaf_phys},
+};
+
+static const level_t PAE_LEVELS[] = {
+        {30,       sizeof(uint64_t), NEVER,  pae_pdpte_at,  pae_check_pdpte,  NULL,         NULL},
+        {PAGE_2MB, sizeof(uint64_t), MAYBE,  pae_pde_at,    pae_check_pde,    pae_pde_leaf, pae_pde_phys},
+        {PAGE_4KB, sizeof(uint64_t), ALWAYS, pae_pte_at,    pae_check_pte,    NULL,         pae_pte_phys},
+};
+
+// One walk of va2pa_batch_interleaved, suspended before the read of its next entry
+typedef struct walk_slot {
+    bool busy;
+    size_t i;
+    size_t level;
+
+    // entry read at the previous level
+    uint64_t entry;
+
+    // physical and host address of the next entry, host is NULL if the table is not mapped
+    uint64_t entry_addr;
+    const uint8_t *host;
+} walk_slot_t;
+
+enum {
+    MAX_IN_FLIGHT = 64,
+};
+
+static bool
+batch_levels(const paging_mode_t level, const level_t **const levels, size_t *const n_levels) {
+    switch (level) {
+        case LEGACY: {
+            *levels = LEGACY_LEVELS;
+            *n_levels = sizeof(LEGACY_LEVELS) / sizeof(level_t);
+            return true;
+        }
+        case PAE: {
+            *levels = PAE_LEVELS;
+            *n_levels = sizeof(PAE_LEVELS) / sizeof(level_t);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static int
+cmp_items(const void *a, const void *b) {
+    const item_t *x = a;
+    const item_t *y = b;
+    if (x->virt_addr != y->virt_addr) {
+        return x->virt_addr < y->virt_addr ? -1 : 1;
+    }
+    return x->i < y->i ? -1 : (x->i > y->i);
+}
+
+// Reads and checks every distinct entry of one level the pending items go through,
+// all with a single read_many call
+static void
+batch_level(const level_t *const level,
+            const translator_t *const tr,
+            item_t *const items,
+            const size_t n,
+            run_t *const runs,
+            read_req_t *const reqs,
+            int32_t *const results,
+            uint64_t *const phys_addrs,
+            error_t *const errors,
+            uint32_t *const page_faults) {
+    const config_t *const cfg = &tr->cfg;
+
+    // Items are sorted, so items sharing an entry are adjacent
+    size_t n_runs = 0;
+    uint32_t last_tag = 0;
+    for (size_t k = 0; k < n; ++k) {
+        if (!items[k].pending) {
+            continue;
+        }
+        uint32_t tag = items[k].virt_addr >> level->shift;
+        if (n_runs == 0 || tag != last_tag) {
+            runs[n_runs].entry = 0;
+            reqs[n_runs].buf = &runs[n_runs].entry;
+            reqs[n_runs].size = level->entry_size;
+            reqs[n_runs].physical_addr = level->addr(tr, items[k].entry, items[k].virt_addr);
+            ++n_runs;
+            last_tag = tag;
+        }
+        items[k].run = n_runs - 1;
+    }
+    if (n_runs == 0) {
+        return;
+    }
+
+    if (cfg->mem_base != NULL || has_map(cfg)) {
+        // Consecutive runs mostly read entries of the same table, so the
+        // host pointer of the table is kept and entries are indexed from it
+        uint64_t table_addr = 0;
+        const uint8_t *table = NULL;
+        for (size_t r = 0; r < n_runs; ++r) {
+            uint64_t addr = reqs[r].physical_addr & ~comp_mask(11, 0);
+            if (r == 0 || addr != table_addr) {
+                table_addr = addr;
+                table = map_table(cfg, table_addr);
+            }
+            if (table != NULL) {
+                memcpy(reqs[r].buf, table + (reqs[r].physical_addr & comp_mask(11, 0)), reqs[r].size);
+                results[r] = (int32_t) reqs[r].size;
+            } else {
+                results[r] = read_phys(cfg, reqs[r].buf, reqs[r].size, reqs[r].physical_addr);
+            }
+        }
+    } else {
+        read_many(cfg, reqs, n_runs, results);
+    }
+
+    for (size_t r = 0; r < n_runs; ++r) {
+        runs[r].page_fault = 0;
+        if (results[r] <= 0) {
+            runs[r].err = READ_FAULT;
+        } else {
+            runs[r].err = level->check(runs[r].entry, tr, &runs[r].page_fault);
+        }
+    }
+
+    for (size_t k = 0; k < n; ++k) {
+        if (!items[k].pending) {
+            continue;
+        }
+        const run_t *run = &runs[items[k].run];
+        size_t i = items[k].i;
+        if (run->err != SUCCESS) {
+            errors[i] = run->err;
+            page_faults[i] = run->page_fault;
+            items[k].pending = false;
+        } else if (level->leaf == ALWAYS || (level->leaf == MAYBE && level->maps_page(run->entry, tr))) {
+            phys_addrs[i] = level->phys(run->entry, items[k].virt_addr);
+            errors[i] = SUCCESS;
+            items[k].pending = false;
+        } else {
+            items[k].entry = run->entry;
+        }
+    }
+}
+
+// Computes the address of the next entry of slot and prefetches it
+static void
+slot_issue(const level_t *const level, const translator_t *const tr, walk_slot_t *const slot, const uint32_t virt_addr) {
+    slot->entry_addr = level->addr(tr, slot->entry, virt_addr);
+    const uint8_t *table = map_table(&tr->cfg, slot->entry_addr & ~comp_mask(11, 0));
+    slot->host = table != NULL ? table + (slot->entry_addr & comp_mask(11, 0)) : NULL;
+    if (slot->host != NULL) {
+        __builtin_prefetch(slot->host);
+    }
+}
+
+// Reads and checks the entry prefetched by slot_issue, then either stores
+// the result of the walk or issues the next level.
+// Returns true if the walk of the slot is finished.
+static bool
+slot_step(const level_t *const levels,
+          const translator_t *const tr,
+          walk_slot_t *const slot,
+          const uint32_t virt_addr,
+          uint64_t *const phys_addrs,
+          error_t *const errors,
+          uint32_t *const page_faults) {
+    const level_t *level = &levels[slot->level];
+    uint64_t entry = 0;
+    uint32_t page_fault = 0;
+    error_t err;
+    if (slot->host != NULL) {
+        memcpy(&entry, slot->host, level->entry_size);
+        err = level->check(entry, tr, &page_fault);
+    } else if (read_phys(&tr->cfg, &entry, level->entry_size, slot->entry_addr) <= 0) {
+        err = READ_FAULT;
+    } else {
+        err = level->check(entry, tr, &page_fault);
+    }
+
+    size_t i = slot->i;
+    if (err != SUCCESS) {
+        errors[i] = err;
+        page_faults[i] = page_fault;
+        return true;
+    }
+    if (level->leaf == ALWAYS || (level->leaf == MAYBE && level->maps_page(entry, tr))) {
+        phys_addrs[i] = level->phys(entry, virt_addr);
+        errors[i] = SUCCESS;
+        return true;
+    }
+
+    slot->entry = entry;
+    ++slot->level;
+    slot_issue(&levels[slot->level], tr, slot, virt_addr);
+    return false;
+}
+
+// Starts the walk of address i in slot
+static void
+slot_start(const level_t *const levels,
+           const translator_t *const tr,
+           walk_slot_t *const slot,
+           const size_t i,
+           const uint32_t virt_addr) {
+    slot->busy = true;
+    slot->i = i;
+    slot->level = 0;
+    slot->entry = 0;
+    slot_issue(&levels[0], tr, slot, virt_addr);
+}
+
+error_t
+va2pa_batch(const uint32_t *const virt_addrs,
+            const size_t n,
+            const config_t *const cfg,
+            uint64_t *const phys_addrs,
+            error_t *const errors,
+            uint32_t *const page_faults) {
+    const level_t *levels;
+    size_t n_levels;
+    if (!batch_levels(cfg->level, &levels, &n_levels)) {
+        return INVALID_TRANSLATION_TYPE;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        phys_addrs[i] = 0;
+        page_faults[i] = 0;
+    }
+
+    translator_t tr;
+    translator_setup(&tr, cfg);
+
+    // Tables in host memory are walked lane-wise with vector gathers instead
+    if (simd_batch(simd_detect(), &tr, virt_addrs, n, phys_addrs, errors, page_faults)) {
+        return SUCCESS;
+    }
+
+    item_t *items = malloc(n * sizeof(item_t));
+    run_t *runs = malloc(n * sizeof(run_t));
+    read_req_t *reqs = malloc(n * sizeof(read_req_t));
+    int32_t *results = malloc(n * sizeof(int32_t));
+    if (items == NULL || runs == NULL || reqs == NULL || results == NULL) {
+        // Without memory for sharing, every address is walked on its own
+        for (size_t i = 0; i < n; ++i) {
+            page_size_t page_size;
+            errors[i] = walk(virt_addrs[i], cfg, &phys_addrs[i], &page_faults[i], &page_size);
+        }
+    } else {
+        // Visit the addresses in ascending order, so every address sharing a
+        // paging-structure entry comes right after each other. Each level
+        // is then fetched with one read_many call for all the addresses.
+        for (size_t i = 0; i < n; ++i) {
+            items[i].virt_addr = virt_addrs[i];
+            items[i].i = i;
+            items[i].entry = 0;
+            items[i].pending = true;
+        }
+        qsort(items, n, sizeof(item_t), cmp_items);
+
+        for (size_t l = 0; l < n_levels; ++l) {
+            batch_level(&levels[l], &tr, items, n, runs, reqs, results, phys_addrs, errors, page_faults);
+        }
+    }
+
+    free(results);
+    free(reqs);
+    free(runs);
+    free(items);
+    return SUCCESS;
+}
+
+error_t
+va2pa_batch_interleaved(const uint32_t *const virt_addrs,
+                        const size_t n,
+                        const config_t *const cfg,
+                        size_t in_flight,
+                        uint64_t *const phys_addrs,
+                        error_t *const errors,
+                        uint32_t *const page_faults) {
+    const level_t *levels;
+    size_t n_levels;
+    if (!batch_levels(cfg->level, &levels, &n_levels)) {
+        return INVALID_TRANSLATION_TYPE;
+    }
+    if (in_flight == 0) {
+        in_flight = 1;
+    } else if (in_flight > MAX_IN_FLIGHT) {
+        in_flight = MAX_IN_FLIGHT;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        phys_addrs[i] = 0;
+        page_faults[i] = 0;
+    }
+
+    translator_t tr;
+    translator_setup(&tr, cfg);
+
+    // Every slot holds a walk waiting for its prefetched entry. By the time
+    // the round-robin comes back to a slot, the entry has hopefully arrived,
+    // and the slot is refilled with the next address as soon as its walk ends.
+    walk_slot_t slots[MAX_IN_FLIGHT];
+    size_t next = 0;
+    size_t active = 0;
+    for (size_t s = 0; s < in_flight; ++s) {
+        slots[s].busy = false;
+        if (next < n) {
+            slot_start(levels, &tr, &slots[s], next, virt_addrs[next]);
+            ++next;
+            ++active;
+        }
+    }
+
+    while (active > 0) {
+        for (size_t s = 0; s < in_flight; ++s) {
+            walk_slot_t *slot = &slots[s];
+            if (!slot->busy
+                || !slot_step(levels, &tr, slot, virt_addrs[slot->i], phys_addrs, errors, page_faults)) {
+                continue;
+            }
+            if (next < n) {
+                slot_start(levels, &tr, slot, next, virt_addrs[next]);
+                ++next;
+            } else {
+                slot->busy = false;
+                --active;
+            }
+        }
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,69 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "v2p.h"
+
+static int
+advice(const dump_access_t access) {
+    switch (access) {
+        case DUMP_SEQUENTIAL:
+            return MADV_SEQUENTIAL;
+        case DUMP_RANDOM:
+        default:
+            return MADV_RANDOM;
+    }
+}
+
+error_t
+v2p_dump_open(const char *const path, const dump_access_t access, dump_t *const dump) {
+    dump->base = NULL;
+    dump->size = 0;
+    dump->fd = open(path, O_RDONLY);
+    if (dump->fd < 0) {
+        return READ_FAULT;
+    }
+
+    struct stat st;
+    if (fstat(dump->fd, &st) != 0 || st.st_size <= 0) {
+        v2p_dump_close(dump);
+        return READ_FAULT;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, dump->fd, 0);
+    if (base == MAP_FAILED) {
+        v2p_dump_close(dump);
+        return READ_FAULT;
+    }
+    dump->base = base;
+    dump->size = st.st_size;
+
+    v2p_dump_advise(dump, access);
+    return SUCCESS;
+}
+
+void
+v2p_dump_advise(const dump_t *const dump, const dump_access_t access) {
+    // Only a hint, the mapping works the same if it is ignored
+    madvise((void *) dump->base, dump->size, advice(access));
+}
+
+void
+v2p_dump_attach(const dump_t *const dump, config_t *const cfg) {
+    cfg->mem_base = dump->base;
+    cfg->mem_size = dump->size;
+}
+
+void
+v2p_dump_close(dump_t *const dump) {
+    if (dump->base != NULL) {
+        munmap((void *) dump->base, dump->size);
+    }
+    if (dump->fd >= 0) {
+        close(dump->fd);
+    }
+    dump->base = NULL;
+    dump->size = 0;
+    dump->fd = -1;
+}
@@ -0,0 +1,257 @@
+#include <stdlib.h>
+
+#include "v2p.h"
+#include "legacy.h"
+#include "pae.h"
+#include "translator.h"
+#include "utils.h"
+
+// Page tables fetched with one read_many call
+enum {
+    TABLES_PER_READ = 16,
+};
+
+// Outcome of visiting a subtree
+typedef enum visit {
+    CONTINUE,
+    STOP,
+} visit_t;
+
+// Group of consecutive page tables of a directory loaded at once
+typedef struct table_group {
+    uint8_t *bufs;
+    uint32_t capacity;
+
+    // positions of the loaded tables in the directory's list of tables
+    uint32_t first;
+    uint32_t n;
+
+    // number of entries read of each table
+    uint32_t got[TABLES_PER_READ];
+} table_group_t;
+
+// Returns table number pos of table_addrs: in place if it is directly accessible,
+// otherwise loading it together with the tables following it if it is not loaded yet
+static const uint8_t *
+load_table(const config_t *const cfg,
+           table_group_t *const g,
+           const uint64_t *const table_addrs,
+           const uint32_t n_tables,
+           const uint32_t pos,
+           const uint32_t entry_size,
+           uint32_t *const got) {
+    const uint8_t *table = map_table(cfg, table_addrs[pos]);
+    if (table != NULL) {
+        *got = 4096 / entry_size;
+        return table;
+    }
+
+    if (g->n == 0 || pos < g->first || pos >= g->first + g->n) {
+        g->first = pos;
+        g->n = n_tables - pos < g->capacity ? n_tables - pos : g->capacity;
+
+        read_req_t reqs[TABLES_PER_READ];
+        int32_t results[TABLES_PER_READ];
+        for (uint32_t j = 0; j < g->n; ++j) {
+            reqs[j].buf = g->bufs + j * 4096;
+            reqs[j].size = 4096;
+            reqs[j].physical_addr = table_addrs[pos + j];
+        }
+        read_many(cfg, reqs, g->n, results);
+
+        for (uint32_t j = 0; j < g->n; ++j) {
+            g->got[j] = 4096 / entry_size;
+            if (results[j] != 4096) {
+                // Find out how much of the table is readable
+                g->got[j] = read_entries(cfg, reqs[j].buf, entry_size, 4096 / entry_size, reqs[j].physical_addr);
+            }
+        }
+    }
+
+    *got = g->got[pos - g->first];
+    return g->bufs + (pos - g->first) * 4096;
+}
+
+static visit_t
+emit_mapping(const mapping_visitor_t visit,
+             void *const arg,
+             const uint64_t virt_addr,
+             const uint64_t phys_addr,
+             const page_size_t page_size,
+             const uint64_t entry,
+             const uint64_t addr_mask) {
+    mapping_t m = {
+            .virt_addr=virt_addr,
+            .phys_addr=phys_addr,
+            .page_size=page_size,
+            .flags=entry & ~addr_mask,
+    };
+    return visit(&m, arg) ? CONTINUE : STOP;
+}
+
+// CR3 -> PD[0..1023] -> PT[0..1023]
+static visit_t
+enumerate_legacy(const translator_t *const tr,
+                 table_group_t *const group,
+                 const mapping_visitor_t visit,
+                 void *const arg,
+                 error_t *const err) {
+    const config_t *const cfg = &tr->cfg;
+    uint32_t pdes[1024];
+    uint32_t got = read_entries(cfg, pdes, sizeof(uint32_t), 1024, legacy_pde_addr(tr, 0));
+    if (got < 1024) {
+        *err = READ_FAULT;
+    }
+
+    // Page tables referenced by the directory, to be fetched in groups
+    uint64_t table_addrs[1024];
+    uint32_t n_tables = 0;
+    for (uint32_t i = 0; i < got; ++i) {
+        uint32_t page_fault = 0;
+        if (legacy_check_pde(pdes[i], tr, &page_fault) == SUCCESS && !legacy_pde_maps_page(pdes[i], tr)) {
+            table_addrs[n_tables++] = legacy_pte_addr(pdes[i], 0);
+        }
+    }
+    group->n = 0;
+
+    uint32_t table = 0;
+    for (uint32_t i = 0; i < got; ++i) {
+        uint32_t page_fault = 0;
+        if (legacy_check_pde(pdes[i], tr, &page_fault) != SUCCESS) {
+            continue;
+        }
+
+        uint32_t virt_addr = i << PAGE_4MB;
+        if (legacy_pde_maps_page(pdes[i], tr)) {
+            if (emit_mapping(visit, arg, virt_addr, legacy_pde_phys(pdes[i], virt_addr), PAGE_4MB, pdes[i],
+                             comp_mask(31, 22) | comp_mask(20, 13)) == STOP) {
+                return STOP;
+            }
+            continue;
+        }
+
+        uint32_t got_ptes;
+        const uint32_t *ptes = (const uint32_t *) load_table(cfg, group, table_addrs, n_tables, table++,
+                                                             sizeof(uint32_t), &got_ptes);
+        if (got_ptes < 1024) {
+            *err = READ_FAULT;
+        }
+        for (uint32_t j = 0; j < got_ptes; ++j) {
+            if (legacy_check_pte(ptes[j], tr, &page_fault) != SUCCESS) {
+                continue;
+            }
+
+            uint32_t page_addr = virt_addr | (j << PAGE_4KB);
+            if (emit_mapping(visit, arg, page_addr, legacy_pte_phys(ptes[j], page_addr), PAGE_4KB, ptes[j],
+                             comp_mask(31, 12)) == STOP) {
+                return STOP;
+            }
+        }
+    }
+
+    return CONTINUE;
+}
+
+// CR3 -> PDPTE[0..3] -> PD[0..511] -> PT[0..511]
+static visit_t
+enumerate_pae(const translator_t *const tr,
+              table_group_t *const group,
+              const mapping_visitor_t visit,
+              void *const arg,
+              error_t *const err) {
+    const config_t *const cfg = &tr->cfg;
+    for (uint32_t i = 0; i < 4; ++i) {
+        uint32_t region_addr = i << 30U;
+        uint32_t page_fault = 0;
+        uint64_t pdpte;
+        error_t pdpte_err = pae_get_pdpte(region_addr, tr, &pdpte, &page_fault);
+        if (pdpte_err == READ_FAULT) {
+            *err = READ_FAULT;
+        }
+        if (pdpte_err != SUCCESS) {
+            continue;
+        }
+
+        uint64_t pdes[512];
+        uint32_t got = read_entries(cfg, pdes, sizeof(uint64_t), 512, pae_pde_addr(pdpte, 0));
+        if (got < 512) {
+            *err = READ_FAULT;
+        }
+
+        // Page tables referenced by the directory, to be fetched in groups
+        uint64_t table_addrs[512];
+        uint32_t n_tables = 0;
+        for (uint32_t j = 0; j < got; ++j) {
+            if (pae_check_pde(pdes[j], tr, &page_fault) == SUCCESS && !pae_pde_maps_page(pdes[j])) {
+                table_addrs[n_tables++] = pae_pte_addr(pdes[j], 0);
+            }
+        }
+        group->n = 0;
+
+        uint32_t table = 0;
+        for (uint32_t j = 0; j < got; ++j) {
+            if (pae_check_pde(pdes[j], tr, &page_fault) != SUCCESS) {
+                continue;
+            }
+
+            uint32_t virt_addr = region_addr | (j << PAGE_2MB);
+            if (pae_pde_maps_page(pdes[j])) {
+                if (emit_mapping(visit, arg, virt_addr, pae_pde_phys(pdes[j], virt_addr), PAGE_2MB, pdes[j],
+                                 comp_mask(51, 21)) == STOP) {
+                    return STOP;
+                }
+                continue;
+            }
+
+            uint32_t got_ptes;
+            const uint64_t *ptes = (const uint64_t *) load_table(cfg, group, table_addrs, n_tables, table++,
+                                                                 sizeof(uint64_t), &got_ptes);
+            if (got_ptes < 512) {
+                *err = READ_FAULT;
+            }
+            for (uint32_t k = 0; k < got_ptes; ++k) {
+                if (pae_check_pte(ptes[k], tr, &page_fault) != SUCCESS) {
+                    continue;
+                }
+
+                uint32_t page_addr = virt_addr | (k << PAGE_4KB);
+                if (emit_mapping(visit, arg, page_addr, pae_pte_phys(ptes[k], page_addr), PAGE_4KB, ptes[k],
+                                 comp_mask(51, 12)) == STOP) {
+                    return STOP;
+                }
+            }
+        }
+    }
+
+    return CONTINUE;
+}
+
+error_t
+v2p_enumerate(const config_t *const cfg, const mapping_visitor_t visit, void *const arg) {
+    if (cfg->level != LEGACY && cfg->level != PAE) {
+        return INVALID_TRANSLATION_TYPE;
+    }
+
+    // Without memory for a group the page tables are fetched one by one
+    uint8_t table_buf[4096];
+    table_group_t group = {.bufs=malloc(TABLES_PER_READ * 4096), .capacity=TABLES_PER_READ};
+    if (group.bufs == NULL) {
+        group.bufs = table_buf;
+        group.capacity = 1;
+    }
+
+    translator_t tr;
+    translator_setup(&tr, cfg);
+
+    error_t err = SUCCESS;
+    if (cfg->level == LEGACY) {
+        enumerate_legacy(&tr, &group, visit, arg, &err);
+    } else {
+        enumerate_pae(&tr, &group, visit, arg, &err);
+    }
+
+    if (group.bufs != table_buf) {
+        free(group.bufs);
+    }
+    return err;
+}
@@ -0,0 +1,149 @@
+#include <sys/mman.h>
+
+#include "v2p.h"
+#include "legacy.h"
+#include "pae.h"
+#include "translator.h"
+
+// huge pages are 2MB, the table is mapped at a multiple of it so that all of it can be
+static const uint64_t FLAT_ALIGN = 1ULL << 21U;
+static const uint64_t FLAT_SIZE = V2P_FLAT_PAGES * sizeof(uint64_t);
+
+static inline uint64_t
+flat_entry(const error_t err, const uint64_t phys_addr, const uint32_t page_fault) {
+    if (err == SUCCESS) {
+        return (phys_addr & ~0xfffULL) | 1U;
+    }
+    return (uint64_t) page_fault << 32U | (uint64_t) (-err) << 1U;
+}
+
+// Stores the result of the walk of the first page of a region of n pages for all of them:
+// a fault applies to every page, a large page maps them one after the other
+static void
+flat_fill(uint64_t *const entries, const uint32_t n, const error_t err, const uint64_t phys_addr,
+          const uint32_t page_fault) {
+    uint64_t entry = flat_entry(err, phys_addr, page_fault);
+    uint64_t step = err == SUCCESS ? 0x1000 : 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        entries[i] = entry + i * step;
+    }
+}
+
+// 1024 page directory entries of 4MB each
+static void
+flat_build_legacy(const translator_t *const tr, uint64_t *const entries) {
+    for (uint32_t i = 0; i < 1024; ++i) {
+        uint32_t virt_addr = i << 22U;
+        uint64_t *region = entries + (i << 10U);
+        uint32_t page_fault = 0;
+        uint32_t pde;
+        error_t err = legacy_get_pde(virt_addr, tr, &pde, &page_fault);
+        if (err != SUCCESS) {
+            flat_fill(region, 1024, err, 0, page_fault);
+            continue;
+        }
+        if (legacy_pde_maps_page(pde, tr)) {
+            flat_fill(region, 1024, SUCCESS, legacy_pde_phys(pde, virt_addr), 0);
+            continue;
+        }
+        for (uint32_t j = 0; j < 1024; ++j) {
+            uint64_t phys_addr = 0;
+            page_fault = 0;
+            page_size_t page_size;
+            err = legacy_walk_pt(virt_addr | (j << 12U), pde, tr, &phys_addr, &page_fault, &page_size);
+            region[j] = flat_entry(err, phys_addr, page_fault);
+        }
+    }
+}
+
+// 4 page-directory-pointer-table entries of 1GB, each of 512 page directory entries of 2MB
+static void
+flat_build_pae(const translator_t *const tr, uint64_t *const entries) {
+    for (uint32_t i = 0; i < 4; ++i) {
+        uint32_t virt_addr = i << 30U;
+        uint32_t page_fault = 0;
+        uint64_t pdpte;
+        error_t err = pae_get_pdpte(virt_addr, tr, &pdpte, &page_fault);
+        if (err != SUCCESS) {
+            flat_fill(entries + (i << 18U), 1U << 18U, err, 0, page_fault);
+            continue;
+        }
+        for (uint32_t j = 0; j < 512; ++j) {
+            uint32_t pd_addr = virt_addr | (j << 21U);
+            uint64_t *region = entries + (pd_addr >> 12U);
+            page_fault = 0;
+            uint64_t pde;
+            err = pae_get_pde(pd_addr, pdpte, tr, &pde, &page_fault);
+            if (err != SUCCESS) {
+                flat_fill(region, 512, err, 0, page_fault);
+                continue;
+            }
+            if (pae_pde_maps_page(pde)) {
+                flat_fill(region, 512, SUCCESS, pae_pde_phys(pde, pd_addr), 0);
+                continue;
+            }
+            for (uint32_t k = 0; k < 512; ++k) {
+                uint64_t phys_addr = 0;
+                page_fault = 0;
+                page_size_t page_size;
+                err = pae_walk_pt(pd_addr | (k << 12U), pde, tr, &phys_addr, &page_fault, &page_size);
+                region[k] = flat_entry(err, phys_addr, page_fault);
+            }
+        }
+    }
+}
+
+error_t
+v2p_flat_build(const config_t *const cfg, const bool huge_pages, flat_table_t *const flat) {
+    flat->entries = NULL;
+    if (cfg->level != LEGACY && cfg->level != PAE) {
+        return INVALID_TRANSLATION_TYPE;
+    }
+
+    // Over-allocate to cut an aligned table out of the mapping
+    uint8_t *map = mmap(NULL, FLAT_SIZE + FLAT_ALIGN, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return INSUFFICIENT_BUFFER;
+    }
+    uint8_t *base = (uint8_t *) (((uintptr_t) map + FLAT_ALIGN - 1) & ~(uintptr_t) (FLAT_ALIGN - 1));
+    if (base != map) {
+        munmap(map, base - map);
+    }
+    munmap(base + FLAT_SIZE, map + FLAT_ALIGN - base);
+    if (huge_pages) {
+        // Only a hint, the table works the same if transparent huge pages are off
+        madvise(base, FLAT_SIZE, MADV_HUGEPAGE);
+    }
+    flat->entries = (uint64_t *) base;
+
+    translator_t tr;
+    translator_setup(&tr, cfg);
+    if (cfg->level == LEGACY) {
+        flat_build_legacy(&tr, flat->entries);
+    } else {
+        flat_build_pae(&tr, flat->entries);
+    }
+    return SUCCESS;
+}
+
+error_t
+v2p_flat_translate(const flat_table_t *const flat,
+                   const uint32_t virt_addr,
+                   uint64_t *const phys_addr,
+                   uint32_t *page_fault) {
+    uint64_t entry = flat->entries[virt_addr >> 12U];
+    if (entry & 1U) {
+        *phys_addr = (entry & ~0xfffULL) | (virt_addr & 0xfffU);
+        return SUCCESS;
+    }
+    *page_fault |= (uint32_t) (entry >> 32U);
+    return -(error_t) ((entry >> 1U) & 7U);
+}
+
+void
+v2p_flat_free(flat_table_t *const flat) {
+    if (flat->entries != NULL) {
+        munmap(flat->entries, FLAT_SIZE);
+        flat->entries = NULL;
+    }
+}
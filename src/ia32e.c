@@ -0,0 +1,369 @@
+#include "ia32e.h"
+#include "utils.h"
+
+static const uint8_t PML5_SHIFT = 48;
+static const uint8_t PML4_SHIFT = 39;
+static const uint8_t PDPT_SHIFT = 30;
+static const uint8_t PD_SHIFT = 21;
+static const uint8_t PT_SHIFT = 12;
+
+// Bits 11:3 of an entry address are 9 bits of the linear address
+static uint64_t
+entry_addr(const uint64_t table_entry, const uint64_t virt_addr, const uint8_t shift) {
+    uint64_t addr = 0;
+
+    // Bits 51:12 are from the entry referencing the table (or CR3)
+    addr |= table_entry & comp_mask(51, 12);
+
+    // Bits 11:3 are bits shift+8:shift of the linear address
+    addr |= ((virt_addr >> shift) << 3U) & comp_mask(11, 3);
+
+    return addr;
+}
+
+static error_t
+check_entry(const uint64_t entry, const uint64_t reserved_mask, uint32_t *page_fault) {
+    if (!check_bit(entry, 0)) {
+        *page_fault = NOT_PRESENT;
+        return PAGE_FAULT;
+    }
+    if (entry & reserved_mask) {
+        *page_fault = RESERVED_BIT_VIOLATION;
+        return PAGE_FAULT;
+    }
+    return SUCCESS;
+}
+
+static error_t
+read_entry(const translator_t *const tr, const uint64_t addr, const paging_level_t level, uint64_t *const entry) {
+    if (read_level(&tr->cfg, entry, sizeof(uint64_t), addr, level) <= 0) {
+        return READ_FAULT;
+    }
+    return SUCCESS;
+}
+
+void
+ia32e_reserved_masks(const config_t *const cfg, reserved_masks_t *const masks) {
+    // Reserved bits every present IA-32e paging-structure entry shares
+    uint64_t common_reserved_mask = 0;
+
+    // Bits 51:MAXPHYADDR are reserved
+    common_reserved_mask |= comp_mask(51, cfg->maxphyaddr);
+
+    if (!cfg->nxe) {
+        // If IA32_EFER.NXE = 0, the XD flag (bit 63) is reserved
+        common_reserved_mask |= comp_mask(63, 63);
+    }
+
+    // The PS flag (bit 7) of a PML5E and of a PML4E is reserved
+    masks->pml4e = common_reserved_mask | comp_mask(7, 7);
+
+    masks->pdpte = common_reserved_mask;
+    // If the PS flag of a PDPTE is 1, bits 29:13 are reserved
+    masks->pdpte_1gb = common_reserved_mask | comp_mask(29, 13);
+
+    masks->pde = common_reserved_mask;
+    // If the PS flag of a PDE is 1, bits 20:13 are reserved
+    masks->pde_large = common_reserved_mask | comp_mask(20, 13);
+
+    masks->pte = common_reserved_mask;
+
+    // If the PAT is not supported
+    if (!cfg->pat) {
+        // bit 12 of a PDPTE or a PDE mapping a page is reserved
+        masks->pdpte_1gb |= comp_mask(12, 12);
+        masks->pde_large |= comp_mask(12, 12);
+        // bit 7 of a PTE is reserved
+        masks->pte |= comp_mask(7, 7);
+    }
+}
+
+bool
+ia32e_is_canonical(const uint64_t virt_addr, const uint8_t width) {
+    // Bits 63:width-1 must all be equal to bit width-1
+    uint64_t upper = virt_addr & comp_mask(63, width - 1);
+    return upper == 0 || upper == comp_mask(63, width - 1);
+}
+
+//---------------------------------------------------------
+// PML5E
+//---------------------------------------------------------
+uint64_t
+ia32e_pml5e_addr(const translator_t *const tr, const uint64_t virt_addr) {
+    // Bits 51:12 are from CR3, bits 11:3 are bits 56:48 of the linear address
+    return entry_addr(tr->cfg.root_addr, virt_addr, PML5_SHIFT);
+}
+
+error_t
+ia32e_check_pml5e(const uint64_t pml5e, const translator_t *const tr, uint32_t *page_fault) {
+    return check_entry(pml5e, tr->reserved.pml4e, page_fault);
+}
+
+error_t
+ia32e_get_pml5e(const uint64_t virt_addr,
+                const translator_t *const tr,
+                uint64_t *const pml5e,
+                uint32_t *page_fault) {
+    if (read_entry(tr, ia32e_pml5e_addr(tr, virt_addr), LEVEL_PML5E, pml5e) != SUCCESS) {
+        return READ_FAULT;
+    }
+    return ia32e_check_pml5e(*pml5e, tr, page_fault);
+}
+
+//---------------------------------------------------------
+// PML4E
+//---------------------------------------------------------
+uint64_t
+ia32e_pml4e_addr(const uint64_t pml5e, const uint64_t virt_addr) {
+    // Bits 51:12 are from the PML5E (CR3 with 4-level paging),
+    // bits 11:3 are bits 47:39 of the linear address
+    return entry_addr(pml5e, virt_addr, PML4_SHIFT);
+}
+
+error_t
+ia32e_check_pml4e(const uint64_t pml4e, const translator_t *const tr, uint32_t *page_fault) {
+    return check_entry(pml4e, tr->reserved.pml4e, page_fault);
+}
+
+error_t
+ia32e_get_pml4e(const uint64_t virt_addr,
+                const uint64_t pml5e,
+                const translator_t *const tr,
+                uint64_t *const pml4e,
+                uint32_t *page_fault) {
+    if (read_entry(tr, ia32e_pml4e_addr(pml5e, virt_addr), LEVEL_PML4E, pml4e) != SUCCESS) {
+        return READ_FAULT;
+    }
+    return ia32e_check_pml4e(*pml4e, tr, page_fault);
+}
+
+//---------------------------------------------------------
+// PDPTE
+//---------------------------------------------------------
+uint64_t
+ia32e_pdpte_addr(const uint64_t pml4e, const uint64_t virt_addr) {
+    // Bits 51:12 are from the PML4E, bits 11:3 are bits 38:30 of the linear address
+    return entry_addr(pml4e, virt_addr, PDPT_SHIFT);
+}
+
+error_t
+ia32e_check_pdpte(const uint64_t pdpte, const translator_t *const tr, uint32_t *page_fault) {
+    uint64_t mask = ia32e_pdpte_maps_page(pdpte) ? tr->reserved.pdpte_1gb : tr->reserved.pdpte;
+    return check_entry(pdpte, mask, page_fault);
+}
+
+error_t
+ia32e_get_pdpte(const uint64_t virt_addr,
+                const uint64_t pml4e,
+                const translator_t *const tr,
+                uint64_t *const pdpte,
+                uint32_t *page_fault) {
+    if (read_entry(tr, ia32e_pdpte_addr(pml4e, virt_addr), LEVEL_PDPTE, pdpte) != SUCCESS) {
+        return READ_FAULT;
+    }
+    return ia32e_check_pdpte(*pdpte, tr, page_fault);
+}
+
+bool
+ia32e_pdpte_maps_page(const uint64_t pdpte) {
+    // If the PDPTE’s PS flag is 1, the PDPTE maps a 1-GByte page
+    return check_bit(pdpte, 7);
+}
+
+uint64_t
+ia32e_pdpte_phys(const uint64_t pdpte, const uint64_t virt_addr) {
+    // Bits 51:30 are from the PDPTE, bits 29:0 are from the original linear address
+    return (pdpte & comp_mask(51, 30)) | (virt_addr & comp_mask(29, 0));
+}
+
+//---------------------------------------------------------
+// PDE
+//---------------------------------------------------------
+uint64_t
+ia32e_pde_addr(const uint64_t pdpte, const uint64_t virt_addr) {
+    // Bits 51:12 are from the PDPTE, bits 11:3 are bits 29:21 of the linear address
+    return entry_addr(pdpte, virt_addr, PD_SHIFT);
+}
+
+error_t
+ia32e_check_pde(const uint64_t pde, const translator_t *const tr, uint32_t *page_fault) {
+    uint64_t mask = ia32e_pde_maps_page(pde) ? tr->reserved.pde_large : tr->reserved.pde;
+    return check_entry(pde, mask, page_fault);
+}
+
+error_t
+ia32e_get_pde(const uint64_t virt_addr,
+              const uint64_t pdpte,
+              const translator_t *const tr,
+              uint64_t *const pde,
+              uint32_t *page_fault) {
+    if (read_entry(tr, ia32e_pde_addr(pdpte, virt_addr), LEVEL_PDE, pde) != SUCCESS) {
+        return READ_FAULT;
+    }
+    return ia32e_check_pde(*pde, tr, page_fault);
+}
+
+bool
+ia32e_pde_maps_page(const uint64_t pde) {
+    // If the PDE’s PS flag is 1, the PDE maps a 2-MByte page
+    return check_bit(pde, 7);
+}
+
+uint64_t
+ia32e_pde_phys(const uint64_t pde, const uint64_t virt_addr) {
+    // Bits 51:21 are from the PDE, bits 20:0 are from the original linear address
+    return (pde & comp_mask(51, 21)) | (virt_addr & comp_mask(20, 0));
+}
+
+//---------------------------------------------------------
+// PTE
+//---------------------------------------------------------
+uint64_t
+ia32e_pte_addr(const uint64_t pde, const uint64_t virt_addr) {
+    // Bits 51:12 are from the PDE, bits 11:3 are bits 20:12 of the linear address
+    return entry_addr(pde, virt_addr, PT_SHIFT);
+}
+
+error_t
+ia32e_check_pte(const uint64_t pte, const translator_t *const tr, uint32_t *page_fault) {
+    return check_entry(pte, tr->reserved.pte, page_fault);
+}
+
+error_t
+ia32e_get_pte(const uint64_t virt_addr,
+              const uint64_t pde,
+              const translator_t *const tr,
+              uint64_t *const pte,
+              uint32_t *page_fault) {
+    if (read_entry(tr, ia32e_pte_addr(pde, virt_addr), LEVEL_PTE, pte) != SUCCESS) {
+        return READ_FAULT;
+    }
+    return ia32e_check_pte(*pte, tr, page_fault);
+}
+
+uint64_t
+ia32e_pte_phys(const uint64_t pte, const uint64_t virt_addr) {
+    // Bits 51:12 are from the PTE, bits 11:0 are from the original linear address
+    return (pte & comp_mask(51, 12)) | (virt_addr & comp_mask(11, 0));
+}
+
+//---------------------------------------------------------
+// WALK
+//---------------------------------------------------------
+// PDE -> PTE -> PHYS
+error_t
+ia32e_walk_pt(const uint64_t virt_addr,
+              const uint64_t pde,
+              const translator_t *const tr,
+              uint64_t *const phys_addr,
+              uint32_t *page_fault,
+              page_size_t *const page_size) {
+    uint64_t pte;
+    error_t err = ia32e_get_pte(virt_addr, pde, tr, &pte, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    *phys_addr = ia32e_pte_phys(pte, virt_addr);
+    *page_size = PAGE_4KB;
+    return SUCCESS;
+}
+
+// PDPTE -> PDE -> [PTE] -> PHYS
+error_t
+ia32e_walk_pd(const uint64_t virt_addr,
+              const uint64_t pdpte,
+              const translator_t *const tr,
+              uint64_t *const phys_addr,
+              uint32_t *page_fault,
+              page_size_t *const page_size) {
+    uint64_t pde;
+    error_t err = ia32e_get_pde(virt_addr, pdpte, tr, &pde, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+    if (ia32e_pde_maps_page(pde)) {
+        *phys_addr = ia32e_pde_phys(pde, virt_addr);
+        *page_size = PAGE_2MB;
+        return SUCCESS;
+    }
+
+    return ia32e_walk_pt(virt_addr, pde, tr, phys_addr, page_fault, page_size);
+}
+
+// PML4E -> PDPTE -> [PDE -> [PTE]] -> PHYS
+error_t
+ia32e_walk_pdpt(const uint64_t virt_addr,
+                const uint64_t pml4e,
+                const translator_t *const tr,
+                uint64_t *const phys_addr,
+                uint32_t *page_fault,
+                page_size_t *const page_size) {
+    uint64_t pdpte;
+    error_t err = ia32e_get_pdpte(virt_addr, pml4e, tr, &pdpte, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+    if (ia32e_pdpte_maps_page(pdpte)) {
+        *phys_addr = ia32e_pdpte_phys(pdpte, virt_addr);
+        *page_size = PAGE_1GB;
+        return SUCCESS;
+    }
+
+    return ia32e_walk_pd(virt_addr, pdpte, tr, phys_addr, page_fault, page_size);
+}
+
+// PML5E (CR3 with 4-level paging) -> PML4E -> PDPTE -> [PDE -> [PTE]] -> PHYS
+error_t
+ia32e_walk_pml4(const uint64_t virt_addr,
+                const uint64_t pml5e,
+                const translator_t *const tr,
+                uint64_t *const phys_addr,
+                uint32_t *page_fault,
+                page_size_t *const page_size) {
+    uint64_t pml4e;
+    error_t err = ia32e_get_pml4e(virt_addr, pml5e, tr, &pml4e, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    return ia32e_walk_pdpt(virt_addr, pml4e, tr, phys_addr, page_fault, page_size);
+}
+
+// CR3 -> PML4E -> PDPTE -> PDE -> PTE -> PHYS (4KB pages)
+// CR3 -> PML4E -> PDPTE -> PDE -> PHYS (2MB pages)
+// CR3 -> PML4E -> PDPTE -> PHYS (1GB pages)
+error_t
+va2pa_ia32e(const translator_t *const tr,
+            const uint64_t virt_addr,
+            uint64_t *const phys_addr,
+            uint32_t *page_fault,
+            page_size_t *const page_size) {
+    // Linear addresses are 48 bits wide and must be sign-extended to 64 bits
+    if (!ia32e_is_canonical(virt_addr, 48)) {
+        return NON_CANONICAL_ADDRESS;
+    }
+
+    return ia32e_walk_pml4(virt_addr, tr->cfg.root_addr, tr, phys_addr, page_fault, page_size);
+}
+
+// CR3 -> PML5E -> PML4E -> PDPTE -> [PDE -> [PTE]] -> PHYS
+error_t
+va2pa_la57(const translator_t *const tr,
+           const uint64_t virt_addr,
+           uint64_t *const phys_addr,
+           uint32_t *page_fault,
+           page_size_t *const page_size) {
+    // Linear addresses are 57 bits wide and must be sign-extended to 64 bits
+    if (!ia32e_is_canonical(virt_addr, 57)) {
+        return NON_CANONICAL_ADDRESS;
+    }
+
+    uint64_t pml5e;
+    error_t err = ia32e_get_pml5e(virt_addr, tr, &pml5e, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    return ia32e_walk_pml4(virt_addr, pml5e, tr, phys_addr, page_fault, page_size);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "v2p.h"
+#include "internal.h"
+#include "translator.h"
+
+// Per-level steps of IA-32e paging (4-level, and 5-level with LA57). get_* read an entry and check it,
+// check_* only validate an entry that has already been read.
+
+V2P_INTERNAL void
+ia32e_reserved_masks(const config_t *cfg, reserved_masks_t *masks);
+
+// true if bits 63:width-1 of virt_addr are all equal
+V2P_INTERNAL bool
+ia32e_is_canonical(uint64_t virt_addr, uint8_t width);
+
+V2P_INTERNAL uint64_t
+ia32e_pml5e_addr(const translator_t *tr, uint64_t virt_addr);
+
+V2P_INTERNAL error_t
+ia32e_check_pml5e(uint64_t pml5e, const translator_t *tr, uint32_t *page_fault);
+
+V2P_INTERNAL error_t
+ia32e_get_pml5e(uint64_t virt_addr, const translator_t *tr, uint64_t *pml5e, uint32_t *page_fault);
+
+// pml5e is cr3 with 4-level paging
+V2P_INTERNAL uint64_t
+ia32e_pml4e_addr(uint64_t pml5e, uint64_t virt_addr);
+
+V2P_INTERNAL error_t
+ia32e_check_pml4e(uint64_t pml4e, const translator_t *tr, uint32_t *page_fault);
+
+V2P_INTERNAL error_t
+ia32e_get_pml4e(uint64_t virt_addr, uint64_t pml5e, const translator_t *tr, uint64_t *pml4e, uint32_t *page_fault);
+
+V2P_INTERNAL uint64_t
+ia32e_pdpte_addr(uint64_t pml4e, uint64_t virt_addr);
+
+V2P_INTERNAL error_t
+ia32e_check_pdpte(uint64_t pdpte, const translator_t *tr, uint32_t *page_fault);
+
+V2P_INTERNAL error_t
+ia32e_get_pdpte(uint64_t virt_addr, uint64_t pml4e, const translator_t *tr, uint64_t *pdpte, uint32_t *page_fault);
+
+V2P_INTERNAL bool
+ia32e_pdpte_maps_page(uint64_t pdpte);
+
+V2P_INTERNAL uint64_t
+ia32e_pdpte_phys(uint64_t pdpte, uint64_t virt_addr);
+
+V2P_INTERNAL uint64_t
+ia32e_pde_addr(uint64_t pdpte, uint64_t virt_addr);
+
+V2P_INTERNAL error_t
+ia32e_check_pde(uint64_t pde, const translator_t *tr, uint32_t *page_fault);
+
+V2P_INTERNAL error_t
+ia32e_get_pde(uint64_t virt_addr, uint64_t pdpte, const translator_t *tr, uint64_t *pde, uint32_t *page_fault);
+
+V2P_INTERNAL bool
+ia32e_pde_maps_page(uint64_t pde);
+
+V2P_INTERNAL uint64_t
+ia32e_pde_phys(uint64_t pde, uint64_t virt_addr);
+
+V2P_INTERNAL uint64_t
+ia32e_pte_addr(uint64_t pde, uint64_t virt_addr);
+
+V2P_INTERNAL error_t
+ia32e_check_pte(uint64_t pte, const translator_t *tr, uint32_t *page_fault);
+
+V2P_INTERNAL error_t
+ia32e_get_pte(uint64_t virt_addr, uint64_t pde, const translator_t *tr, uint64_t *pte, uint32_t *page_fault);
+
+V2P_INTERNAL uint64_t
+ia32e_pte_phys(uint64_t pte, uint64_t virt_addr);
+
+// Resumes a walk from a valid PDE that references a page table
+V2P_INTERNAL error_t
+ia32e_walk_pt(uint64_t virt_addr,
+              uint64_t pde,
+              const translator_t *tr,
+              uint64_t *phys_addr,
+              uint32_t *page_fault,
+              page_size_t *page_size);
+
+// Resumes a walk from a valid PDPTE that references a page directory
+V2P_INTERNAL error_t
+ia32e_walk_pd(uint64_t virt_addr,
+              uint64_t pdpte,
+              const translator_t *tr,
+              uint64_t *phys_addr,
+              uint32_t *page_fault,
+              page_size_t *page_size);
+
+// Resumes a walk from a valid PML4E
+V2P_INTERNAL error_t
+ia32e_walk_pdpt(uint64_t virt_addr,
+                uint64_t pml4e,
+                const translator_t *tr,
+                uint64_t *phys_addr,
+                uint32_t *page_fault,
+                page_size_t *page_size);
+
+// Resumes a walk from a valid PML5E (or cr3 with 4-level paging)
+V2P_INTERNAL error_t
+ia32e_walk_pml4(uint64_t virt_addr,
+                uint64_t pml5e,
+                const translator_t *tr,
+                uint64_t *phys_addr,
+                uint32_t *page_fault,
+                page_size_t *page_size);
+
+V2P_INTERNAL error_t
+va2pa_ia32e(const translator_t *tr,
+            uint64_t virt_addr,
+            uint64_t *phys_addr,
+            uint32_t *page_fault,
+            page_size_t *page_size);
+
+V2P_INTERNAL error_t
+va2pa_la57(const translator_t *tr,
+           uint64_t virt_addr,
+           uint64_t *phys_addr,
+           uint32_t *page_fault,
+           page_size_t *page_size);
@@ -0,0 +1,11 @@
+#pragma once
+
+// Linkage of the functions shared by the translation units of the library.
+// The single-header build (V2P_IMPLEMENTATION, see gen_header_only.sh) compiles all
+// of them into the including translation unit, where they are static inline
+// so that a whole walk, read function included, can be inlined.
+#ifdef V2P_SINGLE_HEADER
+#define V2P_INTERNAL static inline
+#else
+#define V2P_INTERNAL
+#endif
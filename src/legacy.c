@@ -1,36 +1,11 @@
 #include "legacy.h"
 #include "utils.h"
 
-// CR3 -> PDE -> PTE -> PHYS (4KB pages)
-// CR3 -> PDE -> PHYS (4MB pages)
-error_t
-va2pa_legacy(const uint32_t virt_addr,
-             const config_t *const cfg,
-             uint64_t *const phys_addr,
-             uint32_t *page_fault) {
-    //---------------------------------------------------------
-    // GET PDE
-    //---------------------------------------------------------
-    uint32_t pde_addr = 0;
-
-    // Bits 31:12 are from CR3
-    pde_addr |= comp_mask(31, 12) & cfg->root_addr;
-
-    // Bits 11:2 are bits 31:22 of the linear address
-    uint32_t virt_for_pde = virt_addr & comp_mask(31, 22);
-    pde_addr |= (virt_for_pde >> 20U) & comp_mask(11, 2);
-
-    uint32_t pde;
-    if (cfg->read_func(&pde, sizeof(uint32_t), pde_addr) <= 0) {
-        return READ_FAULT;
-    }
-    if (!check_bit(pde, P_PDE4KB)) {
-        *page_fault = 0;
-        return PAGE_FAULT;
-    }
-
+void
+legacy_reserved_masks(const config_t *const cfg, reserved_masks_t *const masks) {
     // Form PDE reserved mask
     uint64_t pde_reserved_mask = 0;
+    uint64_t pde_4mb_reserved_mask = 0;
     if (cfg->pse) {
         if (cfg->pse36) {
             // If the PSE-36 mechanism is supported, bits 21:(M–19) are reserved,
@@ -45,36 +20,86 @@ va2pa_legacy(const uint32_t virt_addr,
         // If the PAT is not supported
         if (!cfg->pat) {
             // If the P flag and the PS flag of a PDE are both 1, bit 12 is reserved
-            if (check_bit(pde, P_PDE4MB) && check_bit(pde, PS_PDE4MB)) {
-                pde_reserved_mask |= comp_mask(12, 12);
-            }
+            pde_4mb_reserved_mask |= comp_mask(12, 12);
         }
     }
+    masks->pde = pde_reserved_mask;
+    masks->pde_large = pde_reserved_mask | pde_4mb_reserved_mask;
+
+    masks->pte = 0;
+    if (cfg->pse && !cfg->pat) {
+        // If the P flag of a PTE is 1, bit 7 is reserved
+        masks->pte |= comp_mask(7, 7);
+    }
+}
+
+uint32_t
+legacy_pde_addr(const translator_t *const tr, const uint32_t virt_addr) {
+    uint32_t pde_addr = 0;
+
+    // Bits 31:12 are from CR3
+    pde_addr |= comp_mask(31, 12) & tr->cfg.root_addr;
+
+    // Bits 11:2 are bits 31:22 of the linear address
+    uint32_t virt_for_pde = virt_addr & comp_mask(31, 22);
+    pde_addr |= (virt_for_pde >> 20U) & comp_mask(11, 2);
+
+    return pde_addr;
+}
+
+error_t
+legacy_check_pde(const uint32_t pde, const translator_t *const tr, uint32_t *page_fault) {
+    if (!check_bit(pde, P_PDE4KB)) {
+        *page_fault = 0;
+        return PAGE_FAULT;
+    }
+
+    uint64_t pde_reserved_mask = check_bit(pde, PS_PDE4MB) ? tr->reserved.pde_large : tr->reserved.pde;
     // Check that none of the reserved bits has been set
     if (pde & pde_reserved_mask) {
         *page_fault = comp_mask(3, 3);
         return PAGE_FAULT;
     }
+
+    return SUCCESS;
+}
+
+error_t
+legacy_get_pde(const uint32_t virt_addr,
+               const translator_t *const tr,
+               uint32_t *const pde,
+               uint32_t *page_fault) {
+    if (read_level(&tr->cfg, pde, sizeof(uint32_t), legacy_pde_addr(tr, virt_addr), LEVEL_PDE) <= 0) {
+        return READ_FAULT;
+    }
+    return legacy_check_pde(*pde, tr, page_fault);
+}
+
+bool
+legacy_pde_maps_page(const uint32_t pde, const translator_t *const tr) {
     // If CR4.PSE = 1 and the PDE’s PS flag is 1, the PDE maps a 4-MByte page
-    if (cfg->pse && check_bit(pde, PS_PDE4MB)) {
-        *phys_addr = 0;
+    return tr->cfg.pse && check_bit(pde, PS_PDE4MB);
+}
 
-        // Bits 39:32 are bits 20:13 of the PDE
-        uint64_t pde_for_phys = pde & comp_mask(20, 13);
-        *phys_addr |= (pde_for_phys << 19U) & comp_mask(39, 32);
+uint64_t
+legacy_pde_phys(const uint32_t pde, const uint32_t virt_addr) {
+    uint64_t phys_addr = 0;
 
-        // Bits 31:22 are bits 31:22 of the PDE
-        *phys_addr |= pde & comp_mask(31, 22);
+    // Bits 39:32 are bits 20:13 of the PDE
+    uint64_t pde_for_phys = pde & comp_mask(20, 13);
+    phys_addr |= (pde_for_phys << 19U) & comp_mask(39, 32);
 
-        // Bits 21:0 are from the original linear address.
-        *phys_addr |= virt_addr & comp_mask(21, 0);
+    // Bits 31:22 are bits 31:22 of the PDE
+    phys_addr |= pde & comp_mask(31, 22);
 
-        return SUCCESS;
-    }
+    // Bits 21:0 are from the original linear address.
+    phys_addr |= virt_addr & comp_mask(21, 0);
+
+    return phys_addr;
+}
 
-    //---------------------------------------------------------
-    // GET PTE
-    //---------------------------------------------------------
+uint32_t
+legacy_pte_addr(const uint32_t pde, const uint32_t virt_addr) {
     uint32_t pte_addr = 0;
 
     // Bits 31:12 are from the PDE
@@ -84,30 +109,85 @@ va2pa_legacy(const uint32_t virt_addr,
     uint32_t virt_for_pte = virt_addr & comp_mask(21, 12);
     pte_addr |= (virt_for_pte >> 10U) & comp_mask(11, 2);
 
-    uint32_t pte;
-    if (cfg->read_func(&pte, sizeof(uint32_t), pte_addr) <= 0) {
-        return READ_FAULT;
-    }
+    return pte_addr;
+}
+
+error_t
+legacy_check_pte(const uint32_t pte, const translator_t *const tr, uint32_t *page_fault) {
     if (!check_bit(pte, P_PTE)) {
         *page_fault = 0;
         return PAGE_FAULT;
     }
-    if (cfg->pse && !cfg->pat) {
-        // If the P flag of a PTE is 1, bit 7 is reserved
-        if (check_bit(pte, PAT_PTE)) {
-            *page_fault = comp_mask(3, 3);
-            return PAGE_FAULT;
-        }
+    if (pte & tr->reserved.pte) {
+        *page_fault = comp_mask(3, 3);
+        return PAGE_FAULT;
+    }
+
+    return SUCCESS;
+}
+
+error_t
+legacy_get_pte(const uint32_t virt_addr,
+               const uint32_t pde,
+               const translator_t *const tr,
+               uint32_t *const pte,
+               uint32_t *page_fault) {
+    if (read_level(&tr->cfg, pte, sizeof(uint32_t), legacy_pte_addr(pde, virt_addr), LEVEL_PTE) <= 0) {
+        return READ_FAULT;
     }
-    //---------------------------------------------------------
-    *phys_addr = 0;
+    return legacy_check_pte(*pte, tr, page_fault);
+}
+
+uint64_t
+legacy_pte_phys(const uint32_t pte, const uint32_t virt_addr) {
+    uint64_t phys_addr = 0;
 
     // Bits 31:12 are from the PTE
-    *phys_addr |= pte & comp_mask(31, 12);
+    phys_addr |= pte & comp_mask(31, 12);
 
     // Bits 11:0 are from the original linear address
-    *phys_addr |= virt_addr & comp_mask(11, 0);
+    phys_addr |= virt_addr & comp_mask(11, 0);
+
+    return phys_addr;
+}
 
+// PDE -> PTE -> PHYS
+error_t
+legacy_walk_pt(const uint32_t virt_addr,
+               const uint32_t pde,
+               const translator_t *const tr,
+               uint64_t *const phys_addr,
+               uint32_t *page_fault,
+               page_size_t *const page_size) {
+    uint32_t pte;
+    error_t err = legacy_get_pte(virt_addr, pde, tr, &pte, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    *phys_addr = legacy_pte_phys(pte, virt_addr);
+    *page_size = PAGE_4KB;
     return SUCCESS;
 }
 
+// CR3 -> PDE -> PTE -> PHYS (4KB pages)
+// CR3 -> PDE -> PHYS (4MB pages)
+error_t
+va2pa_legacy(const translator_t *const tr,
+             const uint64_t virt_addr,
+             uint64_t *const phys_addr,
+             uint32_t *page_fault,
+             page_size_t *const page_size) {
+    uint32_t pde;
+    error_t err = legacy_get_pde(virt_addr, tr, &pde, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+    if (legacy_pde_maps_page(pde, tr)) {
+        *phys_addr = legacy_pde_phys(pde, virt_addr);
+        *page_size = PAGE_4MB;
+        return SUCCESS;
+    }
+
+    return legacy_walk_pt(virt_addr, pde, tr, phys_addr, page_fault, page_size);
+}
@@ -3,9 +3,55 @@
 #include <stdint.h>
 
 #include "v2p.h"
+#include "internal.h"
+#include "translator.h"
 
-error_t
-va2pa_legacy(uint32_t virt_addr,
-             const config_t *cfg,
+// Per-level steps of 32-bit paging. get_* read an entry and check it,
+// check_* only validate an entry that has already been read.
+
+V2P_INTERNAL void
+legacy_reserved_masks(const config_t *cfg, reserved_masks_t *masks);
+
+V2P_INTERNAL uint32_t
+legacy_pde_addr(const translator_t *tr, uint32_t virt_addr);
+
+V2P_INTERNAL error_t
+legacy_check_pde(uint32_t pde, const translator_t *tr, uint32_t *page_fault);
+
+V2P_INTERNAL error_t
+legacy_get_pde(uint32_t virt_addr, const translator_t *tr, uint32_t *pde, uint32_t *page_fault);
+
+V2P_INTERNAL bool
+legacy_pde_maps_page(uint32_t pde, const translator_t *tr);
+
+V2P_INTERNAL uint64_t
+legacy_pde_phys(uint32_t pde, uint32_t virt_addr);
+
+V2P_INTERNAL uint32_t
+legacy_pte_addr(uint32_t pde, uint32_t virt_addr);
+
+V2P_INTERNAL error_t
+legacy_check_pte(uint32_t pte, const translator_t *tr, uint32_t *page_fault);
+
+V2P_INTERNAL error_t
+legacy_get_pte(uint32_t virt_addr, uint32_t pde, const translator_t *tr, uint32_t *pte, uint32_t *page_fault);
+
+V2P_INTERNAL uint64_t
+legacy_pte_phys(uint32_t pte, uint32_t virt_addr);
+
+// Resumes a walk from a valid PDE that references a page table
+V2P_INTERNAL error_t
+legacy_walk_pt(uint32_t virt_addr,
+               uint32_t pde,
+               const translator_t *tr,
+               uint64_t *phys_addr,
+               uint32_t *page_fault,
+               page_size_t *page_size);
+
+// Walks the low 32 bits of virt_addr
+V2P_INTERNAL error_t
+va2pa_legacy(const translator_t *tr,
+             uint64_t virt_addr,
              uint64_t *phys_addr,
-             uint32_t *page_fault);
+             uint32_t *page_fault,
+             page_size_t *page_size);
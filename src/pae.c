@@ -1,23 +1,46 @@
 #include "pae.h"
 #include "utils.h"
 
-// CR3 -> PDPTE -> PDE -> PTE -> PHYS (4KB pages)
-// CR3 -> PDPTE -> PDE -> PHYS (2MB pages)
-error_t
-va2pa_pae(const uint32_t virt_addr,
-          const config_t *const cfg,
-          uint64_t *const phys_addr,
-          uint32_t *page_fault) {
-    //---------------------------------------------------------
+void
+pae_reserved_masks(const config_t *const cfg, reserved_masks_t *const masks) {
+    uint64_t common_reserved_mask = 0;
+    // If the P flag (bit 0) of a PDE or a PTE is 1, bits 62:MAXPHYADDR are reserved
+    common_reserved_mask |= comp_mask(62, cfg->maxphyaddr);
+    if (!cfg->nxe) {
+        // If IA32_EFER.NXE = 0 and the P flag of a PDE or a PTE is 1, the XD flag (bit 63) is reserved
+        common_reserved_mask |= comp_mask(63, 63);
+    }
+
+    // PDPTE registers are only checked for presence
+    masks->pdpte = 0;
+    masks->pdpte_1gb = 0;
+
+    masks->pde = common_reserved_mask;
+    // If the P flag and the PS flag (bit 7) of a PDE are both 1, bits 20:13 are reserved
+    masks->pde_large = common_reserved_mask | comp_mask(20, 13);
+
+    masks->pte = common_reserved_mask;
+    // If the PAT is not supported
+    if (!cfg->pat) {
+        // If the P flag and the PS flag of a PDE are both 1, bit 12 is reserved
+        masks->pde_large |= comp_mask(12, 12);
+        // If the P flag of a PTE is 1, bit 7 is reserved
+        masks->pte |= comp_mask(7, 7);
+    }
+}
+
+uint64_t
+pae_pdpte_addr(const translator_t *const tr, const uint32_t virt_addr) {
     uint32_t pdpte_addr = 0;
     // TODO: not sure, maybe I should add it with cr3
     // Bits 31:30 of the linear address select a PDPTE register
     pdpte_addr |= virt_addr & comp_mask(31, 30);
 
-    uint64_t pdpte;
-    if (cfg->read_func(&pdpte, sizeof(uint64_t), pdpte_addr) <= 0) {
-        return READ_FAULT;
-    }
+    return pdpte_addr;
+}
+
+error_t
+pae_check_pdpte(const uint64_t pdpte, const translator_t *const tr, uint32_t *page_fault) {
     // If the P flag (bit 0) of PDPTEi is 0, the processor ignores bits 63:1,
     // and there is no mapping for the 1-GByte region controlled by PDPTEi.
     // A reference using a linear address in this region causes a page-fault exception
@@ -25,7 +48,23 @@ va2pa_pae(const uint32_t virt_addr,
         *page_fault |= 0U;
         return PAGE_FAULT;
     }
-    //---------------------------------------------------------
+
+    return SUCCESS;
+}
+
+error_t
+pae_get_pdpte(const uint32_t virt_addr,
+              const translator_t *const tr,
+              uint64_t *const pdpte,
+              uint32_t *page_fault) {
+    if (read_level(&tr->cfg, pdpte, sizeof(uint64_t), pae_pdpte_addr(tr, virt_addr), LEVEL_PDPTE) <= 0) {
+        return READ_FAULT;
+    }
+    return pae_check_pdpte(*pdpte, tr, page_fault);
+}
+
+uint64_t
+pae_pde_addr(const uint64_t pdpte, const uint32_t virt_addr) {
     // If the P flag of PDPTEi is 1, 4-KByte naturally aligned page directory
     // is located at the physical address specified in bits 51:12 of PDPTEi
     uint64_t pde_addr = 0;
@@ -37,50 +76,58 @@ va2pa_pae(const uint32_t virt_addr,
     uint64_t virt_for_pde = virt_addr & comp_mask(29, 21);
     pde_addr |= (virt_for_pde >> 18U) & comp_mask(11, 3);
 
-    uint64_t pde;
-    if (cfg->read_func(&pde, sizeof(uint64_t), pde_addr) <= 0) {
-        return READ_FAULT;
-    }
+    return pde_addr;
+}
+
+error_t
+pae_check_pde(const uint64_t pde, const translator_t *const tr, uint32_t *page_fault) {
     if (!check_bit(pde, 0)) {
         *page_fault |= 0U;
         return PAGE_FAULT;
     }
-    uint64_t pde_reserved_mask = 0;
-    // If the P flag (bit 0) of a PDE bits 62:MAXPHYADDR are reserved.
-    pde_reserved_mask |= comp_mask(62, cfg->maxphyaddr);
-    if (check_bit(pde, 7)) {
-        // If the P flag and the PS flag (bit 7) of a PDE are both 1, bits 20:13 are reserved
-        pde_reserved_mask |= comp_mask(20, 13);
-
-        // If the PAT is not supported
-        if (!cfg->pat) {
-            // If the P flag and the PS flag of a PDE are both 1, bit 12 is reserved
-            pde_reserved_mask |= comp_mask(12, 12);
-        }
-    }
-    if (!cfg->nxe) {
-        // If IA32_EFER.NXE = 0 and the P flag of a PDE, the XD flag (bit 63) is reserved
-        pde_reserved_mask |= comp_mask(63, 63);
-    }
+    uint64_t pde_reserved_mask = check_bit(pde, 7) ? tr->reserved.pde_large : tr->reserved.pde;
     // check that none of the reserved bits has been set
     if (pde & pde_reserved_mask) {
         *page_fault |= comp_mask(3, 3);
         return PAGE_FAULT;
     }
-    //---------------------------------------------------------
+
+    return SUCCESS;
+}
+
+error_t
+pae_get_pde(const uint32_t virt_addr,
+            const uint64_t pdpte,
+            const translator_t *const tr,
+            uint64_t *const pde,
+            uint32_t *page_fault) {
+    if (read_level(&tr->cfg, pde, sizeof(uint64_t), pae_pde_addr(pdpte, virt_addr), LEVEL_PDE) <= 0) {
+        return READ_FAULT;
+    }
+    return pae_check_pde(*pde, tr, page_fault);
+}
+
+bool
+pae_pde_maps_page(const uint64_t pde) {
     // If the PDE’s PS flag is 1, the PDE maps a 2-MByte page
-    if (check_bit(pde, 7)) {
-        *phys_addr = 0;
+    return check_bit(pde, 7);
+}
 
-        // Bits 51:21 are from the PDE
-        *phys_addr |= pde & comp_mask(51, 21);
+uint64_t
+pae_pde_phys(const uint64_t pde, const uint32_t virt_addr) {
+    uint64_t phys_addr = 0;
 
-        // Bits 20:0 are from the original linear address
-        *phys_addr |= virt_addr & comp_mask(20, 0);
+    // Bits 51:21 are from the PDE
+    phys_addr |= pde & comp_mask(51, 21);
 
-        return SUCCESS;
-    }
+    // Bits 20:0 are from the original linear address
+    phys_addr |= virt_addr & comp_mask(20, 0);
+
+    return phys_addr;
+}
 
+uint64_t
+pae_pte_addr(const uint64_t pde, const uint32_t virt_addr) {
     // If the PDE’s PS flag is 0, a 4-KByte naturally aligned page table
     // is located at the physical address specified in bits 51:12 of the PDE.
     // A page table comprises 512 64-bit entries (PTEs).
@@ -91,36 +138,103 @@ va2pa_pae(const uint32_t virt_addr,
     uint64_t virt_for_pte = virt_addr & comp_mask(20, 12);
     pte_addr |= (virt_for_pte >> 9U) & comp_mask(11, 3);
 
-    uint64_t pte;
-    if (cfg->read_func(&pte, sizeof(uint64_t), pte_addr) <= 0) {
-        return READ_FAULT;
-    }
+    return pte_addr;
+}
+
+error_t
+pae_check_pte(const uint64_t pte, const translator_t *const tr, uint32_t *page_fault) {
     if (!check_bit(pte, 0)) {
         *page_fault |= 0U;
         return PAGE_FAULT;
     }
-    uint64_t pte_reserved_mask = 0;
-    // If the P flag (bit 0) of a PTE is 1, bits 62:MAXPHYADDR are reserved
-    pte_reserved_mask |= comp_mask(62, cfg->maxphyaddr);
-    if (!cfg->nxe) {
-        // If IA32_EFER.NXE = 0 and the P flag of a PTE is 1, the XD flag (bit 63) is reserved
-        pte_reserved_mask |= comp_mask(63, 63);
-    }
-    if (!cfg->pat) {
-        pte_reserved_mask |= comp_mask(7, 7);
-    }
-    if (pte & pte_reserved_mask) {
+    if (pte & tr->reserved.pte) {
         *page_fault |= comp_mask(3, 3);
         return PAGE_FAULT;
     }
-    //---------------------------------------------------------
-    *phys_addr = 0;
+
+    return SUCCESS;
+}
+
+error_t
+pae_get_pte(const uint32_t virt_addr,
+            const uint64_t pde,
+            const translator_t *const tr,
+            uint64_t *const pte,
+            uint32_t *page_fault) {
+    if (read_level(&tr->cfg, pte, sizeof(uint64_t), pae_pte_addr(pde, virt_addr), LEVEL_PTE) <= 0) {
+        return READ_FAULT;
+    }
+    return pae_check_pte(*pte, tr, page_fault);
+}
+
+uint64_t
+pae_pte_phys(const uint64_t pte, const uint32_t virt_addr) {
+    uint64_t phys_addr = 0;
 
     // Bits 51:12 are from the PTE
-    *phys_addr |= pte & comp_mask(51, 12);
+    phys_addr |= pte & comp_mask(51, 12);
 
     //Bits 11:0 are from the original linear address
-    *phys_addr |= virt_addr & comp_mask(11, 0);
+    phys_addr |= virt_addr & comp_mask(11, 0);
 
+    return phys_addr;
+}
+
+// PDE -> PTE -> PHYS
+error_t
+pae_walk_pt(const uint32_t virt_addr,
+            const uint64_t pde,
+            const translator_t *const tr,
+            uint64_t *const phys_addr,
+            uint32_t *page_fault,
+            page_size_t *const page_size) {
+    uint64_t pte;
+    error_t err = pae_get_pte(virt_addr, pde, tr, &pte, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    *phys_addr = pae_pte_phys(pte, virt_addr);
+    *page_size = PAGE_4KB;
     return SUCCESS;
 }
+
+// PDPTE -> PDE -> PTE -> PHYS (4KB pages)
+// PDPTE -> PDE -> PHYS (2MB pages)
+error_t
+pae_walk_pd(const uint32_t virt_addr,
+            const uint64_t pdpte,
+            const translator_t *const tr,
+            uint64_t *const phys_addr,
+            uint32_t *page_fault,
+            page_size_t *const page_size) {
+    uint64_t pde;
+    error_t err = pae_get_pde(virt_addr, pdpte, tr, &pde, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+    if (pae_pde_maps_page(pde)) {
+        *phys_addr = pae_pde_phys(pde, virt_addr);
+        *page_size = PAGE_2MB;
+        return SUCCESS;
+    }
+
+    return pae_walk_pt(virt_addr, pde, tr, phys_addr, page_fault, page_size);
+}
+
+// CR3 -> PDPTE -> PDE -> PTE -> PHYS (4KB pages)
+// CR3 -> PDPTE -> PDE -> PHYS (2MB pages)
+error_t
+va2pa_pae(const translator_t *const tr,
+          const uint64_t virt_addr,
+          uint64_t *const phys_addr,
+          uint32_t *page_fault,
+          page_size_t *const page_size) {
+    uint64_t pdpte;
+    error_t err = pae_get_pdpte(virt_addr, tr, &pdpte, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+
+    return pae_walk_pd(virt_addr, pdpte, tr, phys_addr, page_fault, page_size);
+}
@@ -3,9 +3,73 @@
 #include <stdint.h>
 
 #include "v2p.h"
+#include "internal.h"
+#include "translator.h"
 
-error_t
-va2pa_pae(uint32_t virt_addr,
-          const config_t *cfg,
+// Per-level steps of PAE paging. get_* read an entry and check it,
+// check_* only validate an entry that has already been read.
+
+V2P_INTERNAL void
+pae_reserved_masks(const config_t *cfg, reserved_masks_t *masks);
+
+V2P_INTERNAL uint64_t
+pae_pdpte_addr(const translator_t *tr, uint32_t virt_addr);
+
+V2P_INTERNAL error_t
+pae_check_pdpte(uint64_t pdpte, const translator_t *tr, uint32_t *page_fault);
+
+V2P_INTERNAL error_t
+pae_get_pdpte(uint32_t virt_addr, const translator_t *tr, uint64_t *pdpte, uint32_t *page_fault);
+
+V2P_INTERNAL uint64_t
+pae_pde_addr(uint64_t pdpte, uint32_t virt_addr);
+
+V2P_INTERNAL error_t
+pae_check_pde(uint64_t pde, const translator_t *tr, uint32_t *page_fault);
+
+V2P_INTERNAL error_t
+pae_get_pde(uint32_t virt_addr, uint64_t pdpte, const translator_t *tr, uint64_t *pde, uint32_t *page_fault);
+
+V2P_INTERNAL bool
+pae_pde_maps_page(uint64_t pde);
+
+V2P_INTERNAL uint64_t
+pae_pde_phys(uint64_t pde, uint32_t virt_addr);
+
+V2P_INTERNAL uint64_t
+pae_pte_addr(uint64_t pde, uint32_t virt_addr);
+
+V2P_INTERNAL error_t
+pae_check_pte(uint64_t pte, const translator_t *tr, uint32_t *page_fault);
+
+V2P_INTERNAL error_t
+pae_get_pte(uint32_t virt_addr, uint64_t pde, const translator_t *tr, uint64_t *pte, uint32_t *page_fault);
+
+V2P_INTERNAL uint64_t
+pae_pte_phys(uint64_t pte, uint32_t virt_addr);
+
+// Resumes a walk from a valid PDE that references a page table
+V2P_INTERNAL error_t
+pae_walk_pt(uint32_t virt_addr,
+            uint64_t pde,
+            const translator_t *tr,
+            uint64_t *phys_addr,
+            uint32_t *page_fault,
+            page_size_t *page_size);
+
+// Resumes a walk from a valid PDPTE
+V2P_INTERNAL error_t
+pae_walk_pd(uint32_t virt_addr,
+            uint64_t pdpte,
+            const translator_t *tr,
+            uint64_t *phys_addr,
+            uint32_t *page_fault,
+            page_size_t *page_size);
+
+// Walks the low 32 bits of virt_addr
+V2P_INTERNAL error_t
+va2pa_pae(const translator_t *tr,
+          uint64_t virt_addr,
           uint64_t *phys_addr,
-          uint32_t *page_fault);
+          uint32_t *page_fault,
+          page_size_t *page_size);
@@ -0,0 +1,132 @@
+#include <string.h>
+#include <x86intrin.h>
+
+#include "v2p.h"
+#include "utils.h"
+
+static const char *const PROFILE_LEVEL_NAMES[LEVEL_PML5E + 1] = {
+        [LEVEL_PTE]="PTE",
+        [LEVEL_PDE]="PDE",
+        [LEVEL_PDPTE]="PDPTE",
+        [LEVEL_PML4E]="PML4E",
+        [LEVEL_PML5E]="PML5E",
+};
+
+// reads of the calling thread left to skip before the next timed one
+static _Thread_local uint32_t profile_skip = 0;
+
+static inline uint64_t
+profile_cycles(void) {
+    // keep the read from being reordered around the timestamps
+    _mm_lfence();
+    uint64_t t = __rdtsc();
+    _mm_lfence();
+    return t;
+}
+
+static uint32_t
+profile_bucket(const uint64_t cycles) {
+    if (cycles < 8) {
+        return (uint32_t) cycles;
+    }
+    uint32_t exp = 63 - __builtin_clzll(cycles);
+    return (exp - 2) * 8 + ((cycles >> (exp - 3)) & 7U);
+}
+
+// largest value counted in bucket
+static uint64_t
+profile_bucket_max(const uint32_t bucket) {
+    if (bucket < 8) {
+        return bucket;
+    }
+    uint32_t exp = bucket / 8 + 2;
+    uint64_t width = 1ULL << (exp - 3);
+    return (8 + bucket % 8) * width + width - 1;
+}
+
+int32_t
+profile_read(const config_t *const cfg,
+             void *const buf,
+             const uint32_t size,
+             const uint64_t physical_addr,
+             const paging_level_t level) {
+    if (cfg->profile->sample_every > 1) {
+        if (profile_skip > 0) {
+            --profile_skip;
+            return read_phys(cfg, buf, size, physical_addr);
+        }
+        profile_skip = cfg->profile->sample_every - 1;
+    }
+    uint64_t start = profile_cycles();
+    int32_t read = read_phys(cfg, buf, size, physical_addr);
+    v2p_profile_record(cfg->profile, level, profile_cycles() - start);
+    return read;
+}
+
+void
+v2p_profile_reset(v2p_profile_t *const profile) {
+    memset(profile->samples, 0, sizeof(profile->samples));
+    memset(profile->buckets, 0, sizeof(profile->buckets));
+}
+
+void
+v2p_profile_record(v2p_profile_t *const profile, const paging_level_t level, const uint64_t cycles) {
+    if (level < LEVEL_PTE || level > LEVEL_PML5E) {
+        return;
+    }
+    __atomic_fetch_add(&profile->buckets[level][profile_bucket(cycles)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&profile->samples[level], 1, __ATOMIC_RELAXED);
+}
+
+uint64_t
+v2p_profile_percentile(const v2p_profile_t *const profile, const paging_level_t level, const double percentile) {
+    if (level < LEVEL_PTE || level > LEVEL_PML5E) {
+        return 0;
+    }
+    uint64_t samples = __atomic_load_n(&profile->samples[level], __ATOMIC_RELAXED);
+    if (samples == 0) {
+        return 0;
+    }
+
+    // rank of the sample the percentile falls on, counting from 1
+    double rank = percentile / 100.0 * (double) samples;
+    uint64_t want = (uint64_t) rank;
+    if ((double) want < rank || want == 0) {
+        ++want;
+    }
+    uint64_t seen = 0;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < V2P_PROFILE_BUCKETS; ++i) {
+        uint64_t n = __atomic_load_n(&profile->buckets[level][i], __ATOMIC_RELAXED);
+        if (n == 0) {
+            continue;
+        }
+        seen += n;
+        last = i;
+        if (seen >= want) {
+            return profile_bucket_max(i);
+        }
+    }
+    // samples counted before their bucket while recording concurrently
+    return profile_bucket_max(last);
+}
+
+void
+v2p_profile_dump(const v2p_profile_t *const profile, FILE *const out) {
+    fprintf(out, "%-6s %12s %10s %10s %10s %10s %10s  (cycles)\n",
+            "level", "samples", "p50", "p90", "p99", "p99.9", "max");
+    for (int level = LEVEL_PML5E; level >= LEVEL_PTE; --level) {
+        uint64_t samples = __atomic_load_n(&profile->samples[level], __ATOMIC_RELAXED);
+        if (samples == 0) {
+            continue;
+        }
+        fprintf(out, "%-6s %12llu %10llu %10llu %10llu %10llu %10llu\n",
+                PROFILE_LEVEL_NAMES[level],
+                (unsigned long long) samples,
+                (unsigned long long) v2p_profile_percentile(profile, level, 50),
+                (unsigned long long) v2p_profile_percentile(profile, level, 90),
+                (unsigned long long) v2p_profile_percentile(profile, level, 99),
+                (unsigned long long) v2p_profile_percentile(profile, level, 99.9),
+                (unsigned long long) v2p_profile_percentile(profile, level, 100));
+    }
+}
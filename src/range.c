@@ -0,0 +1,201 @@
+#include "v2p.h"
+#include "legacy.h"
+#include "pae.h"
+#include "translator.h"
+#include "utils.h"
+
+// Linear addresses are 32 bits wide, ranges are truncated at 4GB
+static const uint64_t ADDRESS_SPACE_END = 1ULL << 32U;
+
+typedef struct extent_list {
+    extent_t *extents;
+    size_t max;
+    size_t *n;
+} extent_list_t;
+
+// Appends [phys_addr, phys_addr + len) merging it with the last extent if they are adjacent
+static bool
+emit_extent(const extent_list_t *const list, const uint64_t phys_addr, const uint64_t len) {
+    size_t n = *list->n;
+    if (n > 0 && list->extents[n - 1].phys_addr + list->extents[n - 1].len == phys_addr) {
+        list->extents[n - 1].len += len;
+        return true;
+    }
+    if (n == list->max) {
+        return false;
+    }
+
+    list->extents[n].phys_addr = phys_addr;
+    list->extents[n].len = len;
+    ++*list->n;
+    return true;
+}
+
+static uint64_t
+next_boundary(const uint64_t addr, const uint8_t shift, const uint64_t end) {
+    uint64_t next = ((addr >> shift) + 1) << shift;
+    return next < end ? next : end;
+}
+
+// CR3 -> PDE[first..last] -> PTE[first..last] -> PHYS
+static error_t
+range_legacy(const uint64_t end,
+             const translator_t *const tr,
+             const extent_list_t *const list,
+             uint64_t *const va,
+             uint32_t *page_fault) {
+    const config_t *const cfg = &tr->cfg;
+    uint32_t pdes[1024];
+    uint32_t first_pde = *va >> PAGE_4MB;
+    uint32_t n_pdes = ((end - 1) >> PAGE_4MB) - first_pde + 1;
+    uint32_t got = read_entries(cfg, pdes, sizeof(uint32_t), n_pdes, legacy_pde_addr(tr, *va));
+
+    for (uint32_t i = 0; i < n_pdes; ++i) {
+        if (i == got) {
+            return READ_FAULT;
+        }
+        error_t err = legacy_check_pde(pdes[i], tr, page_fault);
+        if (err != SUCCESS) {
+            return err;
+        }
+
+        uint64_t pde_end = next_boundary(*va, PAGE_4MB, end);
+        if (legacy_pde_maps_page(pdes[i], tr)) {
+            if (!emit_extent(list, legacy_pde_phys(pdes[i], *va), pde_end - *va)) {
+                return INSUFFICIENT_BUFFER;
+            }
+            *va = pde_end;
+            continue;
+        }
+
+        uint32_t ptes[1024];
+        uint32_t first_pte = (*va >> PAGE_4KB) & comp_mask(9, 0);
+        uint32_t n_ptes = (((pde_end - 1) >> PAGE_4KB) & comp_mask(9, 0)) - first_pte + 1;
+        uint32_t got_ptes = read_entries(cfg, ptes, sizeof(uint32_t), n_ptes, legacy_pte_addr(pdes[i], *va));
+
+        for (uint32_t j = 0; j < n_ptes; ++j) {
+            if (j == got_ptes) {
+                return READ_FAULT;
+            }
+            err = legacy_check_pte(ptes[j], tr, page_fault);
+            if (err != SUCCESS) {
+                return err;
+            }
+
+            uint64_t pte_end = next_boundary(*va, PAGE_4KB, end);
+            if (!emit_extent(list, legacy_pte_phys(ptes[j], *va), pte_end - *va)) {
+                return INSUFFICIENT_BUFFER;
+            }
+            *va = pte_end;
+        }
+    }
+
+    return SUCCESS;
+}
+
+// CR3 -> PDPTE -> PDE[first..last] -> PTE[first..last] -> PHYS
+static error_t
+range_pae(const uint64_t end,
+          const translator_t *const tr,
+          const extent_list_t *const list,
+          uint64_t *const va,
+          uint32_t *page_fault) {
+    const config_t *const cfg = &tr->cfg;
+    while (*va < end) {
+        // PDPTEs of different regions are not adjacent, each is read on its own
+        uint64_t pdpte;
+        error_t err = pae_get_pdpte(*va, tr, &pdpte, page_fault);
+        if (err != SUCCESS) {
+            return err;
+        }
+
+        uint64_t pdpte_end = next_boundary(*va, 30, end);
+        uint64_t pdes[512];
+        uint32_t first_pde = (*va >> PAGE_2MB) & comp_mask(8, 0);
+        uint32_t n_pdes = (((pdpte_end - 1) >> PAGE_2MB) & comp_mask(8, 0)) - first_pde + 1;
+        uint32_t got = read_entries(cfg, pdes, sizeof(uint64_t), n_pdes, pae_pde_addr(pdpte, *va));
+
+        for (uint32_t i = 0; i < n_pdes; ++i) {
+            if (i == got) {
+                return READ_FAULT;
+            }
+            err = pae_check_pde(pdes[i], tr, page_fault);
+            if (err != SUCCESS) {
+                return err;
+            }
+
+            uint64_t pde_end = next_boundary(*va, PAGE_2MB, end);
+            if (pae_pde_maps_page(pdes[i])) {
+                if (!emit_extent(list, pae_pde_phys(pdes[i], *va), pde_end - *va)) {
+                    return INSUFFICIENT_BUFFER;
+                }
+                *va = pde_end;
+                continue;
+            }
+
+            uint64_t ptes[512];
+            uint32_t first_pte = (*va >> PAGE_4KB) & comp_mask(8, 0);
+            uint32_t n_ptes = (((pde_end - 1) >> PAGE_4KB) & comp_mask(8, 0)) - first_pte + 1;
+            uint32_t got_ptes = read_entries(cfg, ptes, sizeof(uint64_t), n_ptes, pae_pte_addr(pdes[i], *va));
+
+            for (uint32_t j = 0; j < n_ptes; ++j) {
+                if (j == got_ptes) {
+                    return READ_FAULT;
+                }
+                err = pae_check_pte(ptes[j], tr, page_fault);
+                if (err != SUCCESS) {
+                    return err;
+                }
+
+                uint64_t pte_end = next_boundary(*va, PAGE_4KB, end);
+                if (!emit_extent(list, pae_pte_phys(ptes[j], *va), pte_end - *va)) {
+                    return INSUFFICIENT_BUFFER;
+                }
+                *va = pte_end;
+            }
+        }
+    }
+
+    return SUCCESS;
+}
+
+error_t
+va2pa_range(const uint32_t virt_addr,
+            const uint64_t len,
+            const config_t *const cfg,
+            extent_t *const extents,
+            const size_t max_extents,
+            size_t *const n_extents,
+            uint64_t *const done,
+            uint32_t *page_fault) {
+    extent_list_t list = {.extents=extents, .max=max_extents, .n=n_extents};
+    uint64_t va = virt_addr;
+    // virt_addr + len may wrap around for lengths close to UINT64_MAX
+    uint64_t end = len > ADDRESS_SPACE_END - virt_addr ? ADDRESS_SPACE_END : virt_addr + len;
+
+    *n_extents = 0;
+    *done = 0;
+    if (len == 0) {
+        return SUCCESS;
+    }
+
+    translator_t tr;
+    translator_setup(&tr, cfg);
+
+    error_t err;
+    switch (cfg->level) {
+        case LEGACY: {
+            err = range_legacy(end, &tr, &list, &va, page_fault);
+            break;
+        }
+        case PAE: {
+            err = range_pae(end, &tr, &list, &va, page_fault);
+            break;
+        }
+        default:
+            return INVALID_TRANSLATION_TYPE;
+    }
+
+    *done = va - virt_addr;
+    return err;
+}
@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+#include "scan.h"
+
+// Page sizes of the reverse map, one sorted array each
+enum {
+    RMAP_4KB,
+    RMAP_2MB,
+    RMAP_4MB,
+    RMAP_1GB,
+    RMAP_SIZES,
+};
+
+static const page_size_t RMAP_PAGE_SIZES[RMAP_SIZES] = {PAGE_4KB, PAGE_2MB, PAGE_4MB, PAGE_1GB};
+
+// page of the array's size at phys_addr mapped at virt_addr
+typedef struct rmap_page {
+    uint64_t phys_addr;
+    uint64_t virt_addr;
+} rmap_page_t;
+
+typedef struct rmap_array {
+    rmap_page_t *pages;
+    size_t n;
+    size_t capacity;
+} rmap_array_t;
+
+// Pages of equal size sorted by physical and then virtual address: all the
+// mappings of a frame are adjacent and found with two binary searches
+struct rmap {
+    rmap_array_t arrays[RMAP_SIZES];
+};
+
+static int
+rmap_index(const page_size_t page_size) {
+    for (int k = 0; k < RMAP_SIZES; ++k) {
+        if (RMAP_PAGE_SIZES[k] == page_size) {
+            return k;
+        }
+    }
+    return RMAP_4KB;
+}
+
+static bool
+rmap_append(rmap_array_t *const a, const rmap_page_t *const page) {
+    if (a->n == a->capacity) {
+        size_t capacity = a->capacity == 0 ? 256 : a->capacity * 2;
+        rmap_page_t *pages = realloc(a->pages, capacity * sizeof(rmap_page_t));
+        if (pages == NULL) {
+            return false;
+        }
+        a->pages = pages;
+        a->capacity = capacity;
+    }
+    a->pages[a->n++] = *page;
+    return true;
+}
+
+static int
+rmap_cmp_pages(const void *a, const void *b) {
+    const rmap_page_t *x = a;
+    const rmap_page_t *y = b;
+    if (x->phys_addr != y->phys_addr) {
+        return x->phys_addr < y->phys_addr ? -1 : 1;
+    }
+    return x->virt_addr < y->virt_addr ? -1 : (x->virt_addr > y->virt_addr);
+}
+
+// first page of a with a physical address not below phys_addr
+static size_t
+rmap_lower_bound(const rmap_array_t *const a, const uint64_t phys_addr) {
+    size_t lo = 0;
+    size_t hi = a->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a->pages[mid].phys_addr < phys_addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Mappings found by a walk, sorted into the arrays once it is over
+typedef struct rmap_collector {
+    rmap_array_t arrays[RMAP_SIZES];
+    bool out_of_memory;
+} rmap_collector_t;
+
+static bool
+rmap_collect_page(const mapping_t *const mapping, void *const arg) {
+    rmap_collector_t *c = arg;
+    rmap_page_t page = {.phys_addr=mapping->phys_addr, .virt_addr=mapping->virt_addr};
+    if (!rmap_append(&c->arrays[rmap_index(mapping->page_size)], &page)) {
+        c->out_of_memory = true;
+        return false;
+    }
+    return true;
+}
+
+static void
+rmap_free_arrays(rmap_array_t *const arrays) {
+    for (int k = 0; k < RMAP_SIZES; ++k) {
+        free(arrays[k].pages);
+        memset(&arrays[k], 0, sizeof(rmap_array_t));
+    }
+}
+
+// Walks the pages intersecting [first, last] into c, sorting every array
+static error_t
+rmap_collect(const config_t *const cfg, const uint64_t first, const uint64_t last, rmap_collector_t *const c) {
+    memset(c, 0, sizeof(*c));
+    error_t err = scan_tree(cfg, 1, first, last, rmap_collect_page, c);
+    if (c->out_of_memory) {
+        rmap_free_arrays(c->arrays);
+        return INSUFFICIENT_BUFFER;
+    }
+    for (int k = 0; k < RMAP_SIZES; ++k) {
+        qsort(c->arrays[k].pages, c->arrays[k].n, sizeof(rmap_page_t), rmap_cmp_pages);
+    }
+    return err;
+}
+
+error_t
+v2p_rmap_build(const config_t *const cfg, rmap_t **const rmap) {
+    *rmap = NULL;
+    if (cfg->level != LEGACY && cfg->level != PAE && cfg->level != IA32E && cfg->level != LA57) {
+        return INVALID_TRANSLATION_TYPE;
+    }
+    rmap_t *r = calloc(1, sizeof(rmap_t));
+    if (r == NULL) {
+        return INSUFFICIENT_BUFFER;
+    }
+
+    rmap_collector_t c;
+    error_t err = rmap_collect(cfg, 0, UINT64_MAX, &c);
+    if (err == INSUFFICIENT_BUFFER) {
+        free(r);
+        return err;
+    }
+    memcpy(r->arrays, c.arrays, sizeof(r->arrays));
+    *rmap = r;
+    return err;
+}
+
+void
+v2p_rmap_free(rmap_t *const rmap) {
+    if (rmap == NULL) {
+        return;
+    }
+    rmap_free_arrays(rmap->arrays);
+    free(rmap);
+}
+
+error_t
+v2p_rmap_rebuild(rmap_t *const rmap, const config_t *const cfg, const uint64_t virt_addr, const uint64_t len) {
+    if (len == 0) {
+        return SUCCESS;
+    }
+    uint64_t last = virt_addr + len - 1 < virt_addr ? UINT64_MAX : virt_addr + len - 1;
+
+    rmap_collector_t c;
+    error_t err = rmap_collect(cfg, virt_addr, last, &c);
+    if (err == INSUFFICIENT_BUFFER || err == INVALID_TRANSLATION_TYPE) {
+        return err;
+    }
+
+    // Merge the kept pages with the fresh ones, both sorted, into new arrays
+    // allocated upfront so that running out of memory leaves the map unchanged
+    rmap_page_t *merged[RMAP_SIZES];
+    for (int k = 0; k < RMAP_SIZES; ++k) {
+        merged[k] = malloc((rmap->arrays[k].n + c.arrays[k].n + 1) * sizeof(rmap_page_t));
+        if (merged[k] == NULL) {
+            while (k-- > 0) {
+                free(merged[k]);
+            }
+            rmap_free_arrays(c.arrays);
+            return INSUFFICIENT_BUFFER;
+        }
+    }
+
+    for (int k = 0; k < RMAP_SIZES; ++k) {
+        rmap_array_t *old = &rmap->arrays[k];
+        const rmap_array_t *fresh = &c.arrays[k];
+        uint64_t page_len = 1ULL << RMAP_PAGE_SIZES[k];
+        rmap_page_t *pages = merged[k];
+
+        size_t n = 0;
+        size_t j = 0;
+        for (size_t i = 0; i < old->n; ++i) {
+            const rmap_page_t *page = &old->pages[i];
+            if (page->virt_addr <= last && page->virt_addr + page_len - 1 >= virt_addr) {
+                // replaced by the walk of the range
+                continue;
+            }
+            while (j < fresh->n && rmap_cmp_pages(&fresh->pages[j], page) < 0) {
+                pages[n++] = fresh->pages[j++];
+            }
+            pages[n++] = *page;
+        }
+        while (j < fresh->n) {
+            pages[n++] = fresh->pages[j++];
+        }
+
+        free(old->pages);
+        old->capacity = old->n + fresh->n + 1;
+        old->pages = pages;
+        old->n = n;
+    }
+
+    rmap_free_arrays(c.arrays);
+    return err;
+}
+
+error_t
+v2p_rmap_lookup(const rmap_t *const rmap,
+                const uint64_t phys_addr,
+                rmap_range_t *const ranges,
+                const uint32_t max_ranges,
+                uint32_t *const n_ranges) {
+    *n_ranges = 0;
+    for (int k = 0; k < RMAP_SIZES; ++k) {
+        // Pages of one size are naturally aligned, so only the frame of phys_addr can contain it
+        const rmap_array_t *a = &rmap->arrays[k];
+        uint64_t page_len = 1ULL << RMAP_PAGE_SIZES[k];
+        uint64_t frame = phys_addr & ~(page_len - 1);
+        for (size_t i = rmap_lower_bound(a, frame); i < a->n && a->pages[i].phys_addr == frame; ++i) {
+            if (*n_ranges == max_ranges) {
+                return INSUFFICIENT_BUFFER;
+            }
+            rmap_range_t *r = &ranges[(*n_ranges)++];
+            r->virt_addr = a->pages[i].virt_addr;
+            r->phys_addr = frame;
+            r->len = page_len;
+        }
+    }
+    return SUCCESS;
+}
+
+size_t
+v2p_rmap_size(const rmap_t *const rmap) {
+    size_t n = 0;
+    for (int k = 0; k < RMAP_SIZES; ++k) {
+        n += rmap->arrays[k].n;
+    }
+    return n;
+}
@@ -0,0 +1,477 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "v2p.h"
+#include "legacy.h"
+#include "pae.h"
+#include "ia32e.h"
+#include "translator.h"
+#include "scan.h"
+#include "utils.h"
+
+//---------------------------------------------------------
+// LEGACY
+//---------------------------------------------------------
+static error_t
+scan_legacy_check_pde(const uint64_t entry, const translator_t *const tr, uint32_t *const page_fault) {
+    return legacy_check_pde((uint32_t) entry, tr, page_fault);
+}
+
+static bool
+scan_legacy_pde_maps_page(const uint64_t entry, const translator_t *const tr) {
+    return legacy_pde_maps_page((uint32_t) entry, tr);
+}
+
+static uint64_t
+scan_legacy_pde_phys(const uint64_t entry, const uint64_t virt_addr) {
+    return legacy_pde_phys((uint32_t) entry, (uint32_t) virt_addr);
+}
+
+static uint64_t
+scan_legacy_pt(const uint64_t entry) {
+    return legacy_pte_addr((uint32_t) entry, 0);
+}
+
+static error_t
+scan_legacy_check_pte(const uint64_t entry, const translator_t *const tr, uint32_t *const page_fault) {
+    return legacy_check_pte((uint32_t) entry, tr, page_fault);
+}
+
+static uint64_t
+scan_legacy_pte_phys(const uint64_t entry, const uint64_t virt_addr) {
+    return legacy_pte_phys((uint32_t) entry, (uint32_t) virt_addr);
+}
+
+static const scan_level_t SCAN_LEGACY_LEVELS[] = {
+        {PAGE_4MB, sizeof(uint32_t), 1024, scan_legacy_check_pde, scan_legacy_pde_maps_page, scan_legacy_pde_phys,
+                scan_legacy_pt, 0xffdfe000ULL},
+        {PAGE_4KB, sizeof(uint32_t), 1024, scan_legacy_check_pte, NULL,                      scan_legacy_pte_phys,
+                NULL,           0xfffff000ULL},
+};
+
+//---------------------------------------------------------
+// PAE
+//---------------------------------------------------------
+static bool
+scan_pae_pde_maps_page(const uint64_t entry, const translator_t *const tr) {
+    return pae_pde_maps_page(entry);
+}
+
+static uint64_t
+scan_pae_pde_phys(const uint64_t entry, const uint64_t virt_addr) {
+    return pae_pde_phys(entry, (uint32_t) virt_addr);
+}
+
+static uint64_t
+scan_pae_pt(const uint64_t entry) {
+    return pae_pte_addr(entry, 0);
+}
+
+static uint64_t
+scan_pae_pte_phys(const uint64_t entry, const uint64_t virt_addr) {
+    return pae_pte_phys(entry, (uint32_t) virt_addr);
+}
+
+// The PDPTEs are not a table in memory (see pae_pdpte_addr), so scanning starts at the directories
+static const scan_level_t SCAN_PAE_LEVELS[] = {
+        {PAGE_2MB, sizeof(uint64_t), 512, pae_check_pde, scan_pae_pde_maps_page, scan_pae_pde_phys, scan_pae_pt,
+                0x000fffffffe00000ULL},
+        {PAGE_4KB, sizeof(uint64_t), 512, pae_check_pte, NULL,                   scan_pae_pte_phys, NULL,
+                0x000ffffffffff000ULL},
+};
+
+//---------------------------------------------------------
+// IA32E, LA57
+//---------------------------------------------------------
+static uint64_t
+scan_pml4(const uint64_t entry) {
+    return ia32e_pml4e_addr(entry, 0);
+}
+
+static uint64_t
+scan_pdpt(const uint64_t entry) {
+    return ia32e_pdpte_addr(entry, 0);
+}
+
+static bool
+scan_pdpte_maps_page(const uint64_t entry, const translator_t *const tr) {
+    return ia32e_pdpte_maps_page(entry);
+}
+
+static uint64_t
+scan_pd(const uint64_t entry) {
+    return ia32e_pde_addr(entry, 0);
+}
+
+static bool
+scan_pde_maps_page(const uint64_t entry, const translator_t *const tr) {
+    return ia32e_pde_maps_page(entry);
+}
+
+static uint64_t
+scan_pt(const uint64_t entry) {
+    return ia32e_pte_addr(entry, 0);
+}
+
+// LA57 starts at the PML5, 4-level paging one level below
+static const scan_level_t SCAN_IA32E_LEVELS[] = {
+        {48,       sizeof(uint64_t), 512, ia32e_check_pml5e, NULL,                 NULL,             scan_pml4, 0},
+        {39,       sizeof(uint64_t), 512, ia32e_check_pml4e, NULL,                 NULL,             scan_pdpt, 0},
+        {30,       sizeof(uint64_t), 512, ia32e_check_pdpte, scan_pdpte_maps_page, ia32e_pdpte_phys, scan_pd,
+                0x000fffffc0000000ULL},
+        {PAGE_2MB, sizeof(uint64_t), 512, ia32e_check_pde,   scan_pde_maps_page,   ia32e_pde_phys,   scan_pt,
+                0x000fffffffe00000ULL},
+        {PAGE_4KB, sizeof(uint64_t), 512, ia32e_check_pte,   NULL,                 ia32e_pte_phys,   NULL,
+                0x000ffffffffff000ULL},
+};
+
+//---------------------------------------------------------
+// WORK STEALING
+//---------------------------------------------------------
+// one table to scan
+typedef struct scan_task {
+    const scan_level_t *level;
+    uint64_t table_addr;
+    uint64_t virt_base;
+} scan_task_t;
+
+// Tasks of a worker: the owner pushes and pops at the bottom, thieves take from the top,
+// which holds the tasks of the biggest subtrees
+typedef struct scan_deque {
+    pthread_mutex_t lock;
+    scan_task_t *tasks;
+    size_t top;
+    size_t bottom;
+    size_t capacity;
+} scan_deque_t;
+
+typedef struct scan_worker {
+    struct scan_shared *shared;
+    uint32_t id;
+    scan_deque_t deque;
+
+    // mappings found by this worker, sorted when the scan is over
+    mapping_t *mappings;
+    size_t n_mappings;
+    size_t capacity;
+
+    bool read_fault;
+    bool out_of_memory;
+} scan_worker_t;
+
+typedef struct scan_shared {
+    translator_t tr;
+
+    // width of the linear address, for sign-extending 64-bit addresses
+    uint8_t width;
+
+    // only subtrees intersecting [first, last] are scanned
+    uint64_t first;
+    uint64_t last;
+
+    scan_worker_t *workers;
+    uint32_t n_workers;
+
+    // tasks pushed and not finished yet, the scan is over when it drops to 0
+    size_t pending;
+} scan_shared_t;
+
+static bool
+deque_push(scan_deque_t *const d, const scan_task_t *const task) {
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom - d->top == d->capacity) {
+        size_t capacity = d->capacity == 0 ? 64 : d->capacity * 2;
+        scan_task_t *tasks = malloc(capacity * sizeof(scan_task_t));
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&d->lock);
+            return false;
+        }
+        for (size_t i = d->top; i < d->bottom; ++i) {
+            tasks[i - d->top] = d->tasks[i % d->capacity];
+        }
+        free(d->tasks);
+        d->tasks = tasks;
+        d->bottom -= d->top;
+        d->top = 0;
+        d->capacity = capacity;
+    }
+    d->tasks[d->bottom % d->capacity] = *task;
+    ++d->bottom;
+    pthread_mutex_unlock(&d->lock);
+    return true;
+}
+
+static bool
+deque_pop(scan_deque_t *const d, scan_task_t *const task, const bool steal) {
+    pthread_mutex_lock(&d->lock);
+    bool got = d->bottom != d->top;
+    if (got && steal) {
+        *task = d->tasks[d->top % d->capacity];
+        ++d->top;
+    } else if (got) {
+        --d->bottom;
+        *task = d->tasks[d->bottom % d->capacity];
+    }
+    pthread_mutex_unlock(&d->lock);
+    return got;
+}
+
+static void
+push_task(scan_worker_t *const w, const scan_level_t *const level, const uint64_t table_addr, const uint64_t virt_base) {
+    scan_task_t task = {.level=level, .table_addr=table_addr, .virt_base=virt_base};
+    __atomic_add_fetch(&w->shared->pending, 1, __ATOMIC_RELAXED);
+    if (!deque_push(&w->deque, &task)) {
+        __atomic_sub_fetch(&w->shared->pending, 1, __ATOMIC_RELEASE);
+        w->out_of_memory = true;
+    }
+}
+
+static void
+add_mapping(scan_worker_t *const w, const mapping_t *const m) {
+    if (w->n_mappings == w->capacity) {
+        size_t capacity = w->capacity == 0 ? 1024 : w->capacity * 2;
+        mapping_t *mappings = realloc(w->mappings, capacity * sizeof(mapping_t));
+        if (mappings == NULL) {
+            w->out_of_memory = true;
+            return;
+        }
+        w->mappings = mappings;
+        w->capacity = capacity;
+    }
+    w->mappings[w->n_mappings++] = *m;
+}
+
+uint64_t
+scan_canonical(const uint64_t virt_addr, const uint8_t width) {
+    if (width == 0 || ((virt_addr >> (width - 1)) & 1U) == 0) {
+        return virt_addr;
+    }
+    return virt_addr | comp_mask(63, width);
+}
+
+// Reads one table, keeps the pages it maps and pushes the tables it references
+static void
+scan_table(scan_worker_t *const w, const scan_task_t *const task) {
+    const scan_shared_t *shared = w->shared;
+    const scan_level_t *level = task->level;
+    uint64_t entries[1024];
+    uint32_t got = read_entries(&shared->tr.cfg, entries, level->entry_size, level->n_entries, task->table_addr);
+    if (got < level->n_entries) {
+        w->read_fault = true;
+    }
+
+    // Children are pushed from the last one, so that the owner pops them in ascending order
+    for (uint32_t i = got; i-- > 0;) {
+        uint64_t entry = level->entry_size == sizeof(uint32_t) ? ((const uint32_t *) entries)[i] : entries[i];
+        uint32_t page_fault = 0;
+        if (level->check(entry, &shared->tr, &page_fault) != SUCCESS) {
+            continue;
+        }
+
+        uint64_t virt_addr = scan_canonical(task->virt_base | ((uint64_t) i << level->shift), shared->width);
+        if (virt_addr > shared->last || virt_addr + (1ULL << level->shift) - 1 < shared->first) {
+            continue;
+        }
+        if (level->phys != NULL && (level->maps_page == NULL || level->maps_page(entry, &shared->tr))) {
+            mapping_t m = {
+                    .virt_addr=virt_addr,
+                    .phys_addr=level->phys(entry, virt_addr),
+                    .page_size=(page_size_t) level->shift,
+                    .flags=entry & ~level->addr_mask,
+            };
+            add_mapping(w, &m);
+        } else {
+            push_task(w, level + 1, level->table(entry), virt_addr);
+        }
+    }
+}
+
+static bool
+next_task(scan_worker_t *const w, scan_task_t *const task) {
+    scan_shared_t *shared = w->shared;
+    while (true) {
+        if (deque_pop(&w->deque, task, false)) {
+            return true;
+        }
+        for (uint32_t k = 1; k < shared->n_workers; ++k) {
+            scan_worker_t *victim = &shared->workers[(w->id + k) % shared->n_workers];
+            if (deque_pop(&victim->deque, task, true)) {
+                return true;
+            }
+        }
+        if (__atomic_load_n(&shared->pending, __ATOMIC_ACQUIRE) == 0) {
+            return false;
+        }
+        sched_yield();
+    }
+}
+
+static int
+cmp_mappings(const void *a, const void *b) {
+    const mapping_t *x = a;
+    const mapping_t *y = b;
+    return x->virt_addr < y->virt_addr ? -1 : (x->virt_addr > y->virt_addr);
+}
+
+static void *
+scan_run(void *const arg) {
+    scan_worker_t *w = arg;
+    scan_task_t task;
+    while (next_task(w, &task)) {
+        scan_table(w, &task);
+        __atomic_sub_fetch(&w->shared->pending, 1, __ATOMIC_RELEASE);
+    }
+
+    // Every worker sorts its own mappings, they are only merged by the caller
+    qsort(w->mappings, w->n_mappings, sizeof(mapping_t), cmp_mappings);
+    return NULL;
+}
+
+// Pushes the tables of the top level to the first worker
+static void
+scan_roots(scan_shared_t *const shared) {
+    const translator_t *tr = &shared->tr;
+    scan_worker_t *w = &shared->workers[0];
+    switch (tr->cfg.level) {
+        case LEGACY:
+            push_task(w, SCAN_LEGACY_LEVELS, legacy_pde_addr(tr, 0), 0);
+            break;
+        case PAE:
+            for (uint32_t i = 4; i-- > 0;) {
+                uint64_t pdpte;
+                uint32_t page_fault = 0;
+                uint64_t region_addr = (uint64_t) i << 30U;
+                if (region_addr > shared->last || region_addr + (1ULL << 30U) - 1 < shared->first) {
+                    continue;
+                }
+                error_t err = pae_get_pdpte((uint32_t) region_addr, tr, &pdpte, &page_fault);
+                if (err == READ_FAULT) {
+                    w->read_fault = true;
+                } else if (err == SUCCESS) {
+                    push_task(w, SCAN_PAE_LEVELS, pae_pde_addr(pdpte, 0), region_addr);
+                }
+            }
+            break;
+        case IA32E:
+            push_task(w, &SCAN_IA32E_LEVELS[1], ia32e_pml4e_addr(tr->cfg.root_addr, 0), 0);
+            break;
+        case LA57:
+        default:
+            push_task(w, SCAN_IA32E_LEVELS, ia32e_pml5e_addr(tr, 0), 0);
+            break;
+    }
+}
+
+// Visits the mappings of all workers in ascending order: each worker's
+// list is sorted, so the smallest head is picked every time
+static void
+merge_mappings(const scan_shared_t *const shared, size_t *const heads, const mapping_visitor_t visit, void *const arg) {
+    while (true) {
+        const mapping_t *next = NULL;
+        uint32_t from = 0;
+        for (uint32_t k = 0; k < shared->n_workers; ++k) {
+            const scan_worker_t *w = &shared->workers[k];
+            if (heads[k] < w->n_mappings && (next == NULL || w->mappings[heads[k]].virt_addr < next->virt_addr)) {
+                next = &w->mappings[heads[k]];
+                from = k;
+            }
+        }
+        if (next == NULL || !visit(next, arg)) {
+            return;
+        }
+        ++heads[from];
+    }
+}
+
+error_t
+scan_tree(const config_t *const cfg,
+          uint32_t n_threads,
+          const uint64_t first,
+          const uint64_t last,
+          const mapping_visitor_t visit,
+          void *const arg) {
+    if (cfg->level != LEGACY && cfg->level != PAE && cfg->level != IA32E && cfg->level != LA57) {
+        return INVALID_TRANSLATION_TYPE;
+    }
+    if (n_threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = cpus > 0 ? (uint32_t) cpus : 1;
+    }
+
+    scan_shared_t shared = {.n_workers=n_threads, .first=first, .last=last, .pending=0};
+    translator_setup(&shared.tr, cfg);
+    shared.width = cfg->level == IA32E ? 48 : cfg->level == LA57 ? 57 : 0;
+    shared.workers = calloc(n_threads, sizeof(scan_worker_t));
+    pthread_t *threads = calloc(n_threads, sizeof(pthread_t));
+    bool *started = calloc(n_threads, sizeof(bool));
+    size_t *heads = calloc(n_threads, sizeof(size_t));
+    if (shared.workers == NULL || threads == NULL || started == NULL || heads == NULL) {
+        free(heads);
+        free(started);
+        free(threads);
+        free(shared.workers);
+        return INSUFFICIENT_BUFFER;
+    }
+    for (uint32_t k = 0; k < n_threads; ++k) {
+        shared.workers[k].shared = &shared;
+        shared.workers[k].id = k;
+        pthread_mutex_init(&shared.workers[k].deque.lock, NULL);
+    }
+
+    scan_roots(&shared);
+
+    // The calling thread is worker 0, the others run on threads of their own
+    // (if one cannot be started, its share is stolen by the rest)
+    for (uint32_t k = 1; k < n_threads; ++k) {
+        started[k] = pthread_create(&threads[k], NULL, scan_run, &shared.workers[k]) == 0;
+    }
+    scan_run(&shared.workers[0]);
+    for (uint32_t k = 1; k < n_threads; ++k) {
+        if (started[k]) {
+            pthread_join(threads[k], NULL);
+        }
+    }
+
+    error_t err = SUCCESS;
+    for (uint32_t k = 0; k < n_threads; ++k) {
+        if (shared.workers[k].out_of_memory) {
+            err = INSUFFICIENT_BUFFER;
+        } else if (shared.workers[k].read_fault && err == SUCCESS) {
+            err = READ_FAULT;
+        }
+    }
+    merge_mappings(&shared, heads, visit, arg);
+
+    for (uint32_t k = 0; k < n_threads; ++k) {
+        pthread_mutex_destroy(&shared.workers[k].deque.lock);
+        free(shared.workers[k].deque.tasks);
+        free(shared.workers[k].mappings);
+    }
+    free(heads);
+    free(started);
+    free(threads);
+    free(shared.workers);
+    return err;
+}
+
+const scan_level_t *
+scan_levels(const paging_mode_t level) {
+    switch (level) {
+        case LEGACY:
+            return SCAN_LEGACY_LEVELS;
+        case PAE:
+            return SCAN_PAE_LEVELS;
+        case IA32E:
+            return &SCAN_IA32E_LEVELS[1];
+        case LA57:
+        default:
+            return SCAN_IA32E_LEVELS;
+    }
+}
+
+error_t
+v2p_enumerate_parallel(const config_t *const cfg, const uint32_t n_threads, const mapping_visitor_t visit, void *const arg) {
+    return scan_tree(cfg, n_threads, 0, UINT64_MAX, visit, arg);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "v2p.h"
+#include "internal.h"
+#include "translator.h"
+
+// Paging-structure level of a scanned table in terms of the per-level steps.
+// Levels with phys NULL only reference tables, levels with maps_page NULL only map pages.
+typedef struct scan_level {
+    // bits of the linear address translated below each entry
+    uint8_t shift;
+    uint32_t entry_size;
+    uint32_t n_entries;
+
+    error_t (*check)(uint64_t entry, const translator_t *tr, uint32_t *page_fault);
+    bool (*maps_page)(uint64_t entry, const translator_t *tr);
+    uint64_t (*phys)(uint64_t entry, uint64_t virt_addr);
+
+    // physical address of the table referenced by an entry
+    uint64_t (*table)(uint64_t entry);
+
+    // physical-address bits of an entry mapping a page, cleared in mapping_t.flags
+    uint64_t addr_mask;
+} scan_level_t;
+
+// Levels of a paging mode from its top table on (the page directories for PAE,
+// whose PDPTEs are not read as a table), each followed by the level below it
+V2P_INTERNAL const scan_level_t *
+scan_levels(paging_mode_t level);
+
+// Sign-extends the linear address of a 64-bit mode (width 0 for the 32-bit ones)
+V2P_INTERNAL uint64_t
+scan_canonical(uint64_t virt_addr, uint8_t width);
+
+// v2p_enumerate_parallel limited to the pages intersecting [first, last],
+// only the tables of subtrees intersecting it are read
+V2P_INTERNAL error_t
+scan_tree(const config_t *cfg,
+          uint32_t n_threads,
+          uint64_t first,
+          uint64_t last,
+          mapping_visitor_t visit,
+          void *arg);
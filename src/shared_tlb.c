@@ -0,0 +1,135 @@
+#include <stdlib.h>
+
+#include "v2p.h"
+
+// Translation of a 4KB page, guarded by a per-entry sequence number: odd while
+// a fill or an invlpg is writing the entry, advanced by 2 by every write
+typedef struct stlb_entry {
+    uint64_t seq;
+
+    // epoch << 32 | virt_addr >> 12 << 3 | paging mode, 0 for an empty entry
+    uint64_t key;
+    uint64_t root_addr;
+
+    // physical address of the 4KB page
+    uint64_t phys_addr;
+} stlb_entry_t;
+
+struct shared_tlb {
+    stlb_entry_t *entries;
+    uint32_t mask;
+
+    // entries filled in another epoch are stale, never 0
+    uint32_t epoch;
+};
+
+static inline uint64_t
+stlb_key(const uint32_t epoch, const uint32_t virt_addr, const paging_mode_t level) {
+    return (uint64_t) epoch << 32U | (virt_addr >> 12U) << 3U | (level & 7U);
+}
+
+// Direct-mapped by page, so an invlpg has a single entry to drop for every cr3
+static inline stlb_entry_t *
+stlb_slot(const shared_tlb_t *const tlb, const uint32_t virt_addr) {
+    return &tlb->entries[(virt_addr >> 12U) & tlb->mask];
+}
+
+shared_tlb_t *
+v2p_shared_tlb_init(const uint32_t n_entries) {
+    uint32_t n = 1;
+    while (n < n_entries && n < (1U << 31U)) {
+        n <<= 1U;
+    }
+    shared_tlb_t *tlb = malloc(sizeof(shared_tlb_t));
+    if (tlb == NULL) {
+        return NULL;
+    }
+    tlb->entries = calloc(n, sizeof(stlb_entry_t));
+    if (tlb->entries == NULL) {
+        free(tlb);
+        return NULL;
+    }
+    tlb->mask = n - 1;
+    tlb->epoch = 1;
+    return tlb;
+}
+
+void
+v2p_shared_tlb_free(shared_tlb_t *const tlb) {
+    if (tlb == NULL) {
+        return;
+    }
+    free(tlb->entries);
+    free(tlb);
+}
+
+error_t
+va2pa_shared_tlb(const uint32_t virt_addr,
+                 const config_t *const cfg,
+                 shared_tlb_t *const tlb,
+                 uint64_t *const phys_addr,
+                 uint32_t *page_fault) {
+    // The epoch is read before the walk: a flush during it leaves the fill stale
+    uint32_t epoch = __atomic_load_n(&tlb->epoch, __ATOMIC_ACQUIRE);
+    uint64_t key = stlb_key(epoch, virt_addr, cfg->level);
+    stlb_entry_t *e = stlb_slot(tlb, virt_addr);
+
+    uint64_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+    if ((seq & 1U) == 0) {
+        uint64_t got_key = __atomic_load_n(&e->key, __ATOMIC_RELAXED);
+        uint64_t got_root = __atomic_load_n(&e->root_addr, __ATOMIC_RELAXED);
+        uint64_t got_phys = __atomic_load_n(&e->phys_addr, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == seq && got_key == key && got_root == cfg->root_addr) {
+            *phys_addr = got_phys | (virt_addr & 0xfffU);
+            return SUCCESS;
+        }
+    }
+
+    // Only successful translations are cached, faults are always re-walked
+    error_t err = va2pa(virt_addr, cfg, phys_addr, page_fault);
+    if (err != SUCCESS || (seq & 1U) != 0) {
+        return err;
+    }
+
+    // Fill only if nobody wrote the entry since it was looked up: another fill
+    // or an invlpg of it wins, and no reader or writer ever waits for this one
+    if (!__atomic_compare_exchange_n(&e->seq, &seq, seq + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return err;
+    }
+    // keep the stores below from becoming visible before the odd sequence number
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&e->key, key, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->root_addr, cfg->root_addr, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->phys_addr, *phys_addr & ~0xfffULL, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->seq, seq + 2, __ATOMIC_RELEASE);
+    return err;
+}
+
+void
+v2p_shared_tlb_invlpg(shared_tlb_t *const tlb, const uint32_t virt_addr) {
+    stlb_entry_t *e = stlb_slot(tlb, virt_addr);
+    uint64_t seq = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+    for (;;) {
+        // wait out a fill in progress, it only stores four words
+        if ((seq & 1U) != 0) {
+            seq = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(&e->seq, &seq, seq + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&e->key, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&e->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void
+v2p_shared_tlb_flush(shared_tlb_t *const tlb) {
+    uint32_t epoch = __atomic_load_n(&tlb->epoch, __ATOMIC_RELAXED);
+    uint32_t next;
+    do {
+        next = epoch + 1 == 0 ? 1 : epoch + 1;
+    } while (!__atomic_compare_exchange_n(&tlb->epoch, &epoch, next, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
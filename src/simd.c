@@ -0,0 +1,373 @@
+#include <string.h>
+
+#include "simd.h"
+#include "utils.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+
+// Paging-structure level in the form the vector kernels evaluate lane-wise:
+// the entry is at (parent & table_mask) | ((virt_addr >> shift) & index_mask),
+// where the parent of the first level is cr3
+typedef struct simd_level {
+    uint64_t table_mask;
+    uint8_t shift;
+    uint64_t index_mask;
+    uint32_t entry_size;
+
+    // PS flag of the entries that may map a page, 0 if they never do
+    uint64_t ps_mask;
+
+    // every valid entry maps a page
+    bool leaf;
+
+    uint64_t reserved;
+    uint64_t reserved_large;
+
+    // the page is at (entry & frame) | ((entry & high) << 19) | (virt_addr & offset),
+    // the _large masks are used for entries with the PS flag
+    uint64_t frame;
+    uint64_t offset;
+    uint64_t frame_large;
+    uint64_t high_large;
+    uint64_t offset_large;
+} simd_level_t;
+
+enum {
+    SIMD_MAX_LEVELS = 3,
+};
+
+// Describes the levels of tr->cfg.level as the steps of legacy.c and pae.c
+// compute them, returns their number or 0 for other modes
+static size_t
+simd_levels(const translator_t *const tr, simd_level_t *const levels) {
+    const reserved_masks_t *r = &tr->reserved;
+    memset(levels, 0, SIMD_MAX_LEVELS * sizeof(simd_level_t));
+    switch (tr->cfg.level) {
+        case LEGACY: {
+            // PDE: bits 31:12 are from CR3, bits 11:2 are bits 31:22 of the linear address
+            levels[0].table_mask = comp_mask(31, 12);
+            levels[0].shift = 20;
+            levels[0].index_mask = comp_mask(11, 2);
+            levels[0].entry_size = sizeof(uint32_t);
+            levels[0].ps_mask = tr->cfg.pse ? comp_mask(PS_PDE4MB, PS_PDE4MB) : 0;
+            levels[0].reserved = r->pde;
+            levels[0].reserved_large = r->pde_large;
+            levels[0].frame_large = comp_mask(31, 22);
+            levels[0].high_large = comp_mask(20, 13);
+            levels[0].offset_large = comp_mask(21, 0);
+
+            // PTE: bits 31:12 are from the PDE, bits 11:2 are bits 21:12 of the linear address
+            levels[1].table_mask = comp_mask(31, 12);
+            levels[1].shift = 10;
+            levels[1].index_mask = comp_mask(11, 2);
+            levels[1].entry_size = sizeof(uint32_t);
+            levels[1].leaf = true;
+            levels[1].reserved = r->pte;
+            levels[1].reserved_large = r->pte;
+            levels[1].frame = comp_mask(31, 12);
+            levels[1].offset = comp_mask(11, 0);
+            return 2;
+        }
+        case PAE: {
+            // PDPTE: bits 31:30 of the linear address, only checked for presence
+            levels[0].index_mask = comp_mask(31, 30);
+            levels[0].entry_size = sizeof(uint64_t);
+
+            // PDE: bits 51:12 are from the PDPTE, bits 11:3 are bits 29:21 of the linear address
+            levels[1].table_mask = comp_mask(51, 12);
+            levels[1].shift = 18;
+            levels[1].index_mask = comp_mask(11, 3);
+            levels[1].entry_size = sizeof(uint64_t);
+            levels[1].ps_mask = comp_mask(7, 7);
+            levels[1].reserved = r->pde;
+            levels[1].reserved_large = r->pde_large;
+            levels[1].frame_large = comp_mask(51, 21);
+            levels[1].offset_large = comp_mask(20, 0);
+
+            // PTE: bits 51:12 are from the PDE, bits 11:3 are bits 20:12 of the linear address
+            levels[2].table_mask = comp_mask(51, 12);
+            levels[2].shift = 9;
+            levels[2].index_mask = comp_mask(11, 3);
+            levels[2].entry_size = sizeof(uint64_t);
+            levels[2].leaf = true;
+            levels[2].reserved = r->pte;
+            levels[2].reserved_large = r->pte;
+            levels[2].frame = comp_mask(51, 12);
+            levels[2].offset = comp_mask(11, 0);
+            return 3;
+        }
+        default:
+            return 0;
+    }
+}
+
+static void
+batch_scalar(const translator_t *const tr,
+             const uint32_t *const virt_addrs,
+             const size_t n,
+             uint64_t *const phys_addrs,
+             error_t *const errors,
+             uint32_t *const page_faults) {
+    for (size_t i = 0; i < n; ++i) {
+        page_size_t page_size;
+        phys_addrs[i] = 0;
+        page_faults[i] = 0;
+        errors[i] = translator_walk(tr, virt_addrs[i], &phys_addrs[i], &page_faults[i], &page_size);
+    }
+}
+
+#ifdef SIMD_X86
+// Highest entry address that can be read from mem_base, compared as signed 64-bit
+static int64_t
+simd_limit(const config_t *const cfg, const uint32_t entry_size) {
+    uint64_t limit = cfg->mem_size - entry_size;
+    return limit > INT64_MAX ? INT64_MAX : (int64_t) limit;
+}
+
+__attribute__((target("avx2")))
+static void
+batch_avx2(const simd_level_t *const levels,
+           const size_t n_levels,
+           const translator_t *const tr,
+           const uint32_t *const virt_addrs,
+           const size_t n,
+           uint64_t *const phys_addrs,
+           error_t *const errors,
+           uint32_t *const page_faults) {
+    const long long *base = tr->cfg.mem_base;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    const __m256i present_flag = _mm256_set1_epi64x(1);
+    const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+
+    for (size_t i = 0; i < n; i += 4) {
+        size_t m = n - i < 4 ? n - i : 4;
+        uint64_t va_lanes[4] = {0};
+        for (size_t j = 0; j < m; ++j) {
+            va_lanes[j] = virt_addrs[i + j];
+        }
+        __m256i va = _mm256_loadu_si256((const __m256i *) va_lanes);
+        __m256i active = _mm256_cmpgt_epi64(_mm256_set1_epi64x((long long) m), lanes);
+        __m256i entry = _mm256_set1_epi64x((long long) tr->cfg.root_addr);
+        __m256i phys = zero;
+        __m256i err = zero;
+        __m256i page_fault = zero;
+
+        for (size_t l = 0; l < n_levels; ++l) {
+            const simd_level_t *lv = &levels[l];
+            __m256i index = _mm256_srl_epi64(va, _mm_cvtsi32_si128(lv->shift));
+            __m256i addr = _mm256_or_si256(_mm256_and_si256(entry, _mm256_set1_epi64x((long long) lv->table_mask)),
+                                           _mm256_and_si256(index, _mm256_set1_epi64x((long long) lv->index_mask)));
+
+            // Reads outside of mem_base fail like they do in read_phys
+            __m256i limit = _mm256_set1_epi64x(simd_limit(&tr->cfg, lv->entry_size));
+            __m256i inside = _mm256_andnot_si256(_mm256_cmpgt_epi64(addr, limit), active);
+            err = _mm256_blendv_epi8(err, _mm256_set1_epi64x(READ_FAULT), _mm256_andnot_si256(inside, active));
+            active = inside;
+
+            __m256i value;
+            if (lv->entry_size == sizeof(uint64_t)) {
+                value = _mm256_mask_i64gather_epi64(zero, base, addr, active, 1);
+            } else {
+                // 32-bit gathers take one mask bit per 32-bit lane
+                __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+                __m128i mask = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(active, low_halves));
+                value = _mm256_cvtepu32_epi64(
+                        _mm256_mask_i64gather_epi32(_mm_setzero_si128(), (const int *) base, addr, mask, 1));
+            }
+
+            __m256i present = _mm256_cmpeq_epi64(_mm256_and_si256(value, present_flag), present_flag);
+            __m256i not_present = _mm256_andnot_si256(present, active);
+            err = _mm256_blendv_epi8(err, _mm256_set1_epi64x(PAGE_FAULT), not_present);
+            page_fault = _mm256_blendv_epi8(page_fault, _mm256_set1_epi64x(NOT_PRESENT), not_present);
+            active = _mm256_and_si256(active, present);
+
+            __m256i ps = _mm256_and_si256(value, _mm256_set1_epi64x((long long) lv->ps_mask));
+            __m256i large = _mm256_andnot_si256(_mm256_cmpeq_epi64(ps, zero), ones);
+            __m256i reserved = _mm256_blendv_epi8(_mm256_set1_epi64x((long long) lv->reserved),
+                                                  _mm256_set1_epi64x((long long) lv->reserved_large), large);
+            __m256i violation = _mm256_andnot_si256(_mm256_cmpeq_epi64(_mm256_and_si256(value, reserved), zero),
+                                                    active);
+            err = _mm256_blendv_epi8(err, _mm256_set1_epi64x(PAGE_FAULT), violation);
+            page_fault = _mm256_blendv_epi8(page_fault, _mm256_set1_epi64x(RESERVED_BIT_VIOLATION), violation);
+            active = _mm256_andnot_si256(violation, active);
+
+            __m256i leaf = lv->leaf ? active : _mm256_and_si256(active, large);
+            __m256i frame = _mm256_blendv_epi8(_mm256_set1_epi64x((long long) lv->frame),
+                                               _mm256_set1_epi64x((long long) lv->frame_large), large);
+            __m256i high = _mm256_and_si256(_mm256_set1_epi64x((long long) lv->high_large), large);
+            __m256i offset = _mm256_blendv_epi8(_mm256_set1_epi64x((long long) lv->offset),
+                                                _mm256_set1_epi64x((long long) lv->offset_large), large);
+            __m256i page = _mm256_or_si256(_mm256_and_si256(value, frame),
+                                           _mm256_slli_epi64(_mm256_and_si256(value, high), 19));
+            page = _mm256_or_si256(page, _mm256_and_si256(va, offset));
+            phys = _mm256_blendv_epi8(phys, page, leaf);
+            active = _mm256_andnot_si256(leaf, active);
+            entry = value;
+        }
+
+        int64_t phys_lanes[4];
+        int64_t err_lanes[4];
+        int64_t page_fault_lanes[4];
+        _mm256_storeu_si256((__m256i *) phys_lanes, phys);
+        _mm256_storeu_si256((__m256i *) err_lanes, err);
+        _mm256_storeu_si256((__m256i *) page_fault_lanes, page_fault);
+        for (size_t j = 0; j < m; ++j) {
+            phys_addrs[i + j] = (uint64_t) phys_lanes[j];
+            errors[i + j] = (error_t) err_lanes[j];
+            page_faults[i + j] = (uint32_t) page_fault_lanes[j];
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void
+batch_avx512(const simd_level_t *const levels,
+             const size_t n_levels,
+             const translator_t *const tr,
+             const uint32_t *const virt_addrs,
+             const size_t n,
+             uint64_t *const phys_addrs,
+             error_t *const errors,
+             uint32_t *const page_faults) {
+    const void *base = tr->cfg.mem_base;
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i present_flag = _mm512_set1_epi64(1);
+
+    for (size_t i = 0; i < n; i += 8) {
+        size_t m = n - i < 8 ? n - i : 8;
+        uint64_t va_lanes[8] = {0};
+        for (size_t j = 0; j < m; ++j) {
+            va_lanes[j] = virt_addrs[i + j];
+        }
+        __m512i va = _mm512_loadu_si512(va_lanes);
+        __mmask8 active = (__mmask8) ((1U << m) - 1);
+        __m512i entry = _mm512_set1_epi64((long long) tr->cfg.root_addr);
+        __m512i phys = zero;
+        __m512i err = zero;
+        __m512i page_fault = zero;
+
+        for (size_t l = 0; l < n_levels; ++l) {
+            const simd_level_t *lv = &levels[l];
+            __m512i index = _mm512_srl_epi64(va, _mm_cvtsi32_si128(lv->shift));
+            __m512i addr = _mm512_or_si512(_mm512_and_si512(entry, _mm512_set1_epi64((long long) lv->table_mask)),
+                                           _mm512_and_si512(index, _mm512_set1_epi64((long long) lv->index_mask)));
+
+            // Reads outside of mem_base fail like they do in read_phys
+            __m512i limit = _mm512_set1_epi64(simd_limit(&tr->cfg, lv->entry_size));
+            __mmask8 inside = _mm512_mask_cmple_epi64_mask(active, addr, limit);
+            err = _mm512_mask_mov_epi64(err, active & ~inside, _mm512_set1_epi64(READ_FAULT));
+            active = inside;
+
+            __m512i value;
+            if (lv->entry_size == sizeof(uint64_t)) {
+                value = _mm512_mask_i64gather_epi64(zero, active, addr, base, 1);
+            } else {
+                value = _mm512_cvtepu32_epi64(_mm512_mask_i64gather_epi32(_mm256_setzero_si256(), active, addr, base, 1));
+            }
+
+            __mmask8 present = _mm512_mask_test_epi64_mask(active, value, present_flag);
+            __mmask8 not_present = active & ~present;
+            err = _mm512_mask_mov_epi64(err, not_present, _mm512_set1_epi64(PAGE_FAULT));
+            page_fault = _mm512_mask_mov_epi64(page_fault, not_present, _mm512_set1_epi64(NOT_PRESENT));
+            active = present;
+
+            __mmask8 large = _mm512_test_epi64_mask(value, _mm512_set1_epi64((long long) lv->ps_mask));
+            __m512i reserved = _mm512_mask_mov_epi64(_mm512_set1_epi64((long long) lv->reserved), large,
+                                                     _mm512_set1_epi64((long long) lv->reserved_large));
+            __mmask8 violation = _mm512_mask_test_epi64_mask(active, value, reserved);
+            err = _mm512_mask_mov_epi64(err, violation, _mm512_set1_epi64(PAGE_FAULT));
+            page_fault = _mm512_mask_mov_epi64(page_fault, violation, _mm512_set1_epi64(RESERVED_BIT_VIOLATION));
+            active &= ~violation;
+
+            __mmask8 leaf = lv->leaf ? active : active & large;
+            __m512i frame = _mm512_mask_mov_epi64(_mm512_set1_epi64((long long) lv->frame), large,
+                                                  _mm512_set1_epi64((long long) lv->frame_large));
+            __m512i high = _mm512_maskz_mov_epi64(large, _mm512_set1_epi64((long long) lv->high_large));
+            __m512i offset = _mm512_mask_mov_epi64(_mm512_set1_epi64((long long) lv->offset), large,
+                                                   _mm512_set1_epi64((long long) lv->offset_large));
+            __m512i page = _mm512_or_si512(_mm512_and_si512(value, frame),
+                                           _mm512_slli_epi64(_mm512_and_si512(value, high), 19));
+            page = _mm512_or_si512(page, _mm512_and_si512(va, offset));
+            phys = _mm512_mask_mov_epi64(phys, leaf, page);
+            active &= ~leaf;
+            entry = value;
+        }
+
+        int64_t phys_lanes[8];
+        int64_t err_lanes[8];
+        int64_t page_fault_lanes[8];
+        _mm512_storeu_si512(phys_lanes, phys);
+        _mm512_storeu_si512(err_lanes, err);
+        _mm512_storeu_si512(page_fault_lanes, page_fault);
+        for (size_t j = 0; j < m; ++j) {
+            phys_addrs[i + j] = (uint64_t) phys_lanes[j];
+            errors[i + j] = (error_t) err_lanes[j];
+            page_faults[i + j] = (uint32_t) page_fault_lanes[j];
+        }
+    }
+}
+#endif
+
+simd_kernel_t
+simd_detect(void) {
+    // cpuid once, racing first calls store the same value
+    static int detected = -1;
+    int kernel_id = __atomic_load_n(&detected, __ATOMIC_RELAXED);
+    if (kernel_id < 0) {
+        simd_kernel_t kernel = SIMD_SCALAR;
+#ifdef SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            kernel = SIMD_AVX512;
+        } else if (__builtin_cpu_supports("avx2")) {
+            kernel = SIMD_AVX2;
+        }
+#endif
+        kernel_id = kernel;
+        __atomic_store_n(&detected, kernel_id, __ATOMIC_RELAXED);
+    }
+    return (simd_kernel_t) kernel_id;
+}
+
+bool
+simd_batch(const simd_kernel_t kernel,
+           const translator_t *const tr,
+           const uint32_t *const virt_addrs,
+           const size_t n,
+           uint64_t *const phys_addrs,
+           error_t *const errors,
+           uint32_t *const page_faults) {
+    simd_level_t levels[SIMD_MAX_LEVELS];
+    size_t n_levels = simd_levels(tr, levels);
+    if (tr->cfg.mem_base == NULL || n_levels == 0 || kernel > simd_detect()) {
+        return false;
+    }
+
+    switch (kernel) {
+        case SIMD_SCALAR: {
+            batch_scalar(tr, virt_addrs, n, phys_addrs, errors, page_faults);
+            return true;
+        }
+#ifdef SIMD_X86
+        case SIMD_AVX2:
+        case SIMD_AVX512: {
+            // Every lane may read a whole entry
+            if (tr->cfg.mem_size < sizeof(uint64_t)) {
+                return false;
+            }
+            if (kernel == SIMD_AVX2) {
+                batch_avx2(levels, n_levels, tr, virt_addrs, n, phys_addrs, errors, page_faults);
+            } else {
+                batch_avx512(levels, n_levels, tr, virt_addrs, n, phys_addrs, errors, page_faults);
+            }
+            return true;
+        }
+#endif
+        default:
+            return false;
+    }
+}
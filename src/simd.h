@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "v2p.h"
+#include "internal.h"
+#include "translator.h"
+
+// Kernels translating many addresses over tables in cfg.mem_base
+typedef enum simd_kernel {
+    // one walk per address
+    SIMD_SCALAR,
+
+    // 4 addresses per vector, gathers with 64-bit indices
+    SIMD_AVX2,
+
+    // 8 addresses per vector
+    SIMD_AVX512,
+} simd_kernel_t;
+
+// The widest kernel the cpu supports
+V2P_INTERNAL simd_kernel_t
+simd_detect(void);
+
+// Translates n addresses with kernel, storing the results like va2pa_batch does.
+// Returns false if kernel can not be used (not supported by the cpu, paging mode
+// other than LEGACY or PAE, or no mem_base), leaving the results untouched.
+V2P_INTERNAL bool
+simd_batch(simd_kernel_t kernel,
+           const translator_t *tr,
+           const uint32_t *virt_addrs,
+           size_t n,
+           uint64_t *phys_addrs,
+           error_t *errors,
+           uint32_t *page_faults);
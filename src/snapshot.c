@@ -0,0 +1,352 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+#include "legacy.h"
+#include "pae.h"
+#include "ia32e.h"
+#include "translator.h"
+#include "scan.h"
+#include "utils.h"
+
+// accessed and dirty bits, set by the processor on its own
+#define SNAP_AD_BITS ((1ULL << 5U) | (1ULL << 6U))
+
+// Paging structure as of the last scan
+typedef struct snap_table {
+    uint64_t hash;
+
+    // number of entries that could be read, the others are zero
+    uint32_t got;
+
+    // some referenced table could not be copied, the entries are compared on the next scan
+    bool incomplete;
+
+    // entries as read, entry_size bytes each
+    void *entries;
+
+    // tables referenced by the entries, NULL for the others
+    // (and the whole array NULL for levels that only map pages)
+    struct snap_table **children;
+} snap_table_t;
+
+struct snapshot {
+    paging_mode_t level;
+
+    // the top-level table, or the page directory of every PAE gigabyte
+    snap_table_t *roots[4];
+};
+
+// what an entry translates to
+typedef enum snap_kind {
+    SNAP_NONE,
+    SNAP_PAGE,
+    SNAP_TABLE,
+} snap_kind_t;
+
+typedef struct snap_entry {
+    snap_kind_t kind;
+
+    // physical address of the page or of the table
+    uint64_t addr;
+    uint64_t flags;
+} snap_entry_t;
+
+typedef struct snap_diff {
+    translator_t tr;
+    uint8_t width;
+
+    diff_visitor_t visit;
+    void *arg;
+    bool stopped;
+
+    // the last range, extended while the next changes are adjacent to it
+    diff_range_t pending;
+    bool has_pending;
+
+    bool read_fault;
+    bool out_of_memory;
+} snap_diff_t;
+
+// Four independent multiply-xorshift lanes, so that the multiplications
+// of consecutive words overlap instead of forming one dependency chain
+static uint64_t
+snap_hash(const uint64_t *const words, const uint32_t n) {
+    uint64_t h[4] = {0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL, 0x2545f4914f6cdd1dULL};
+    for (uint32_t i = 0; i < n; i += 4) {
+        for (uint32_t k = 0; k < 4; ++k) {
+            h[k] = (h[k] ^ words[i + k]) * 0xff51afd7ed558ccdULL;
+            h[k] ^= h[k] >> 32U;
+        }
+    }
+    return (h[0] ^ (h[1] * 3) ^ (h[2] * 5) ^ (h[3] * 7)) * 0xc4ceb9fe1a85ec53ULL;
+}
+
+static uint64_t
+snap_entry_at(const void *const entries, const scan_level_t *const level, const uint32_t i) {
+    return level->entry_size == sizeof(uint32_t) ? ((const uint32_t *) entries)[i] : ((const uint64_t *) entries)[i];
+}
+
+static void
+snap_decode(const snap_diff_t *const d,
+            const scan_level_t *const level,
+            const uint64_t entry,
+            const uint64_t virt_addr,
+            snap_entry_t *const e) {
+    uint32_t page_fault = 0;
+    e->kind = SNAP_NONE;
+    if (level->check(entry, &d->tr, &page_fault) != SUCCESS) {
+        return;
+    }
+    if (level->phys != NULL && (level->maps_page == NULL || level->maps_page(entry, &d->tr))) {
+        e->kind = SNAP_PAGE;
+        e->addr = level->phys(entry, virt_addr);
+        e->flags = entry & ~level->addr_mask;
+    } else {
+        e->kind = SNAP_TABLE;
+        e->addr = level->table(entry);
+    }
+}
+
+static void
+snap_flush(snap_diff_t *const d) {
+    if (d->has_pending && !d->stopped) {
+        d->stopped = !d->visit(&d->pending, d->arg);
+    }
+    d->has_pending = false;
+}
+
+static void
+snap_emit(snap_diff_t *const d, const diff_kind_t kind, const uint64_t virt_addr, const uint64_t len) {
+    if (d->stopped) {
+        return;
+    }
+    if (d->has_pending && d->pending.kind == kind && d->pending.virt_addr + d->pending.len == virt_addr) {
+        d->pending.len += len;
+        return;
+    }
+    snap_flush(d);
+    d->pending.kind = kind;
+    d->pending.virt_addr = virt_addr;
+    d->pending.len = len;
+    d->has_pending = true;
+}
+
+static snap_table_t *
+snap_table_new(const scan_level_t *const level) {
+    snap_table_t *t = calloc(1, sizeof(snap_table_t));
+    if (t == NULL) {
+        return NULL;
+    }
+    t->entries = calloc(level->n_entries, level->entry_size);
+    if (level->table != NULL) {
+        t->children = calloc(level->n_entries, sizeof(snap_table_t *));
+    }
+    if (t->entries == NULL || (level->table != NULL && t->children == NULL)) {
+        free(t->children);
+        free(t->entries);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+static void
+snap_table_free(const scan_level_t *const level, snap_table_t *const t) {
+    if (t == NULL) {
+        return;
+    }
+    if (t->children != NULL) {
+        for (uint32_t i = 0; i < level->n_entries; ++i) {
+            snap_table_free(level + 1, t->children[i]);
+        }
+    }
+    free(t->children);
+    free(t->entries);
+    free(t);
+}
+
+// Reports every page of a recorded subtree as removed
+static void
+snap_remove(snap_diff_t *const d, const scan_level_t *const level, const snap_table_t *const t, const uint64_t virt_base) {
+    if (t == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < level->n_entries && !d->stopped; ++i) {
+        uint64_t virt_addr = scan_canonical(virt_base | ((uint64_t) i << level->shift), d->width);
+        snap_entry_t e;
+        snap_decode(d, level, snap_entry_at(t->entries, level, i), virt_addr, &e);
+        if (e.kind == SNAP_PAGE) {
+            snap_emit(d, DIFF_REMOVED, virt_addr, 1ULL << level->shift);
+        } else if (e.kind == SNAP_TABLE) {
+            snap_remove(d, level + 1, t->children[i], virt_base | ((uint64_t) i << level->shift));
+        }
+    }
+}
+
+// Compares the table at table_addr with its copy t (NULL if it was not
+// there before), reports what changed and returns the updated copy
+static snap_table_t *
+snap_diff_table(snap_diff_t *const d,
+                const scan_level_t *const level,
+                snap_table_t *t,
+                const uint64_t table_addr,
+                const uint64_t virt_base) {
+    uint64_t entries[512];
+    uint32_t size = level->entry_size * level->n_entries;
+    uint32_t got = read_entries(&d->tr.cfg, entries, level->entry_size, level->n_entries, table_addr);
+    if (got < level->n_entries) {
+        d->read_fault = true;
+        memset((uint8_t *) entries + got * level->entry_size, 0, (level->n_entries - got) * level->entry_size);
+    }
+    uint64_t hash = snap_hash(entries, size / sizeof(uint64_t));
+
+    if (t != NULL && t->hash == hash && t->got == got && !t->incomplete) {
+        // Same entries, so only the tables they reference may have changed
+        if (t->children != NULL) {
+            for (uint32_t i = 0; i < level->n_entries; ++i) {
+                if (t->children[i] != NULL) {
+                    uint64_t virt_addr = virt_base | ((uint64_t) i << level->shift);
+                    uint64_t child_addr = level->table(snap_entry_at(entries, level, i));
+                    t->children[i] = snap_diff_table(d, level + 1, t->children[i], child_addr, virt_addr);
+                    t->incomplete |= t->children[i] == NULL;
+                }
+            }
+        }
+        return t;
+    }
+
+    if (t == NULL) {
+        t = snap_table_new(level);
+        if (t == NULL) {
+            d->out_of_memory = true;
+            return NULL;
+        }
+    }
+
+    bool incomplete = false;
+    for (uint32_t i = 0; i < level->n_entries; ++i) {
+        uint64_t child_base = virt_base | ((uint64_t) i << level->shift);
+        uint64_t virt_addr = scan_canonical(child_base, d->width);
+        uint64_t len = 1ULL << level->shift;
+        snap_entry_t was;
+        snap_entry_t now;
+        snap_decode(d, level, snap_entry_at(t->entries, level, i), virt_addr, &was);
+        snap_decode(d, level, snap_entry_at(entries, level, i), virt_addr, &now);
+
+        if (was.kind == SNAP_TABLE && now.kind == SNAP_TABLE) {
+            t->children[i] = snap_diff_table(d, level + 1, t->children[i], now.addr, child_base);
+            incomplete |= t->children[i] == NULL;
+            continue;
+        }
+        if (was.kind == SNAP_PAGE && now.kind == SNAP_PAGE) {
+            if (was.addr != now.addr || ((was.flags ^ now.flags) & ~SNAP_AD_BITS) != 0) {
+                snap_emit(d, DIFF_REMAPPED, virt_addr, len);
+            }
+            continue;
+        }
+
+        if (was.kind == SNAP_PAGE) {
+            snap_emit(d, DIFF_REMOVED, virt_addr, len);
+        } else if (was.kind == SNAP_TABLE) {
+            snap_remove(d, level + 1, t->children[i], child_base);
+            snap_table_free(level + 1, t->children[i]);
+            t->children[i] = NULL;
+        }
+        if (now.kind == SNAP_PAGE) {
+            snap_emit(d, DIFF_ADDED, virt_addr, len);
+        } else if (now.kind == SNAP_TABLE) {
+            t->children[i] = snap_diff_table(d, level + 1, NULL, now.addr, child_base);
+            incomplete |= t->children[i] == NULL;
+        }
+    }
+
+    memcpy(t->entries, entries, size);
+    t->hash = hash;
+    t->got = got;
+    t->incomplete = incomplete;
+    return t;
+}
+
+error_t
+v2p_snapshot_update(snapshot_t *const snapshot, const config_t *const cfg, const diff_visitor_t visit, void *const arg) {
+    if (cfg->level != snapshot->level) {
+        return INVALID_TRANSLATION_TYPE;
+    }
+
+    snap_diff_t d = {.visit=visit, .arg=arg, .stopped=visit == NULL};
+    translator_setup(&d.tr, cfg);
+    d.width = cfg->level == IA32E ? 48 : cfg->level == LA57 ? 57 : 0;
+    const scan_level_t *top = scan_levels(cfg->level);
+    switch (cfg->level) {
+        case LEGACY:
+            snapshot->roots[0] = snap_diff_table(&d, top, snapshot->roots[0], legacy_pde_addr(&d.tr, 0), 0);
+            break;
+        case PAE:
+            for (uint32_t i = 0; i < 4; ++i) {
+                uint64_t pdpte;
+                uint32_t page_fault = 0;
+                uint64_t region_addr = (uint64_t) i << 30U;
+                error_t err = pae_get_pdpte((uint32_t) region_addr, &d.tr, &pdpte, &page_fault);
+                if (err == SUCCESS) {
+                    snapshot->roots[i] = snap_diff_table(&d, top, snapshot->roots[i],
+                                                         pae_pde_addr(pdpte, 0), region_addr);
+                    continue;
+                }
+                if (err == READ_FAULT) {
+                    d.read_fault = true;
+                }
+                snap_remove(&d, top, snapshot->roots[i], region_addr);
+                snap_table_free(top, snapshot->roots[i]);
+                snapshot->roots[i] = NULL;
+            }
+            break;
+        case IA32E:
+            snapshot->roots[0] = snap_diff_table(&d, top, snapshot->roots[0],
+                                                 ia32e_pml4e_addr(cfg->root_addr, 0), 0);
+            break;
+        case LA57:
+        default:
+            snapshot->roots[0] = snap_diff_table(&d, top, snapshot->roots[0], ia32e_pml5e_addr(&d.tr, 0), 0);
+            break;
+    }
+    snap_flush(&d);
+
+    if (d.out_of_memory) {
+        return INSUFFICIENT_BUFFER;
+    }
+    return d.read_fault ? READ_FAULT : SUCCESS;
+}
+
+error_t
+v2p_snapshot_take(const config_t *const cfg, snapshot_t **const snapshot) {
+    *snapshot = NULL;
+    if (cfg->level != LEGACY && cfg->level != PAE && cfg->level != IA32E && cfg->level != LA57) {
+        return INVALID_TRANSLATION_TYPE;
+    }
+    snapshot_t *s = calloc(1, sizeof(snapshot_t));
+    if (s == NULL) {
+        return INSUFFICIENT_BUFFER;
+    }
+    s->level = cfg->level;
+
+    error_t err = v2p_snapshot_update(s, cfg, NULL, NULL);
+    if (err == INSUFFICIENT_BUFFER) {
+        v2p_snapshot_free(s);
+        return err;
+    }
+    *snapshot = s;
+    return err;
+}
+
+void
+v2p_snapshot_free(snapshot_t *const snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+    const scan_level_t *top = scan_levels(snapshot->level);
+    for (uint32_t i = 0; i < 4; ++i) {
+        snap_table_free(top, snapshot->roots[i]);
+    }
+    free(snapshot);
+}
@@ -0,0 +1,152 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+#include "stats.h"
+
+#ifdef V2P_STATS
+_Thread_local v2p_stats_t *v2p_stats_tls = NULL;
+
+// Counters of a thread, linked into the list v2p_stats_get sums up
+typedef struct stats_block {
+    v2p_stats_t stats;
+    struct stats_block *prev;
+    struct stats_block *next;
+} stats_block_t;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static stats_block_t *stats_threads = NULL;
+
+// counters of the threads that exited
+static v2p_stats_t stats_retired;
+
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+
+// counters of a thread whose block could not be allocated, never reported
+static _Thread_local v2p_stats_t stats_unregistered;
+
+// Every field of v2p_stats_t is a uint64_t counter
+static void
+stats_add(v2p_stats_t *const to, const v2p_stats_t *const from) {
+    uint64_t *dst = (uint64_t *) to;
+    const uint64_t *src = (const uint64_t *) from;
+    for (size_t i = 0; i < sizeof(v2p_stats_t) / sizeof(uint64_t); ++i) {
+        dst[i] += __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    }
+}
+
+// Folds the counters of an exiting thread into stats_retired
+static void
+stats_exit(void *const arg) {
+    stats_block_t *block = arg;
+    pthread_mutex_lock(&stats_lock);
+    stats_add(&stats_retired, &block->stats);
+    if (block->prev != NULL) {
+        block->prev->next = block->next;
+    } else {
+        stats_threads = block->next;
+    }
+    if (block->next != NULL) {
+        block->next->prev = block->prev;
+    }
+    pthread_mutex_unlock(&stats_lock);
+    free(block);
+}
+
+static void
+stats_create_key(void) {
+    pthread_key_create(&stats_key, stats_exit);
+}
+
+v2p_stats_t *
+stats_register(void) {
+    pthread_once(&stats_once, stats_create_key);
+    stats_block_t *block = calloc(1, sizeof(stats_block_t));
+    if (block == NULL) {
+        v2p_stats_tls = &stats_unregistered;
+        return v2p_stats_tls;
+    }
+
+    pthread_mutex_lock(&stats_lock);
+    block->next = stats_threads;
+    if (stats_threads != NULL) {
+        stats_threads->prev = block;
+    }
+    stats_threads = block;
+    pthread_mutex_unlock(&stats_lock);
+
+    pthread_setspecific(stats_key, block);
+    v2p_stats_tls = &block->stats;
+    return v2p_stats_tls;
+}
+
+void
+stats_walk(v2p_stats_t *const stats,
+           const paging_level_t top,
+           const uint64_t reads,
+           const error_t err,
+           const uint32_t page_fault,
+           const page_size_t page_size) {
+    STATS_ADD(stats, walks, 1);
+    STATS_ADD(stats, walk_reads, reads);
+    if (reads > 0 && reads <= top) {
+        // One entry is read per level, from the top one down
+        STATS_ADD(stats, ended_at[top - reads + 1], 1);
+    }
+
+    switch (err) {
+        case SUCCESS:
+            switch (page_size) {
+                case PAGE_4KB:
+                    STATS_ADD(stats, pages_4kb, 1);
+                    break;
+                case PAGE_2MB:
+                    STATS_ADD(stats, pages_2mb, 1);
+                    break;
+                case PAGE_4MB:
+                    STATS_ADD(stats, pages_4mb, 1);
+                    break;
+                case PAGE_1GB:
+                default:
+                    STATS_ADD(stats, pages_1gb, 1);
+                    break;
+            }
+            break;
+        case PAGE_FAULT:
+            if (page_fault & RESERVED_BIT_VIOLATION) {
+                STATS_ADD(stats, reserved_bit, 1);
+            } else {
+                STATS_ADD(stats, not_present, 1);
+            }
+            break;
+        case READ_FAULT:
+            STATS_ADD(stats, read_faults, 1);
+            break;
+        case NON_CANONICAL_ADDRESS:
+            STATS_ADD(stats, non_canonical, 1);
+            break;
+        default:
+            break;
+    }
+}
+
+bool
+v2p_stats_get(v2p_stats_t *const stats) {
+    memset(stats, 0, sizeof(v2p_stats_t));
+    pthread_mutex_lock(&stats_lock);
+    stats_add(stats, &stats_retired);
+    for (const stats_block_t *block = stats_threads; block != NULL; block = block->next) {
+        stats_add(stats, &block->stats);
+    }
+    pthread_mutex_unlock(&stats_lock);
+    return true;
+}
+#else
+bool
+v2p_stats_get(v2p_stats_t *const stats) {
+    memset(stats, 0, sizeof(v2p_stats_t));
+    return false;
+}
+#endif
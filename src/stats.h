@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "v2p.h"
+#include "internal.h"
+
+#ifdef V2P_STATS
+// counters of the calling thread, NULL until it records something
+extern _Thread_local v2p_stats_t *v2p_stats_tls;
+
+// Allocates and registers the counters of the calling thread
+V2P_INTERNAL v2p_stats_t *
+stats_register(void);
+
+static inline v2p_stats_t *
+stats_local(void) {
+    return v2p_stats_tls != NULL ? v2p_stats_tls : stats_register();
+}
+
+// Only the owning thread writes its counters, the relaxed store keeps
+// v2p_stats_get reading them from another thread free of data races
+#define STATS_ADD(stats, field, n) \
+    __atomic_store_n(&(stats)->field, (stats)->field + (n), __ATOMIC_RELAXED)
+
+// Records a walk that made reads reads of paging-structure entries, starting at level top
+V2P_INTERNAL void
+stats_walk(v2p_stats_t *stats,
+           paging_level_t top,
+           uint64_t reads,
+           error_t err,
+           uint32_t page_fault,
+           page_size_t page_size);
+#endif
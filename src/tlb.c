@@ -0,0 +1,273 @@
+#include <string.h>
+
+#include "v2p.h"
+#include "legacy.h"
+#include "pae.h"
+#include "translator.h"
+#include "utils.h"
+
+// Bits of the linear address above the ones translated by each PAE level
+static const uint8_t PDPTE_SHIFT = 30;
+static const uint8_t PAE_PDE_SHIFT = 21;
+static const uint8_t LEGACY_PDE_SHIFT = 22;
+
+// Spread neighbouring cr3s over different sets
+static tlb_set_t *
+find_set(tlb_set_t *const sets, const uint32_t n, const uint32_t tag, const uint64_t root_addr) {
+    return &sets[(tag ^ (root_addr >> 12U)) & (n - 1)];
+}
+
+static tlb_entry_t *
+lookup(tlb_set_t *const sets, const uint32_t n, const uint32_t tag, const config_t *const cfg) {
+    tlb_set_t *set = find_set(sets, n, tag, cfg->root_addr);
+
+    for (int i = 0; i < TLB_WAYS; ++i) {
+        tlb_entry_t *e = &set->ways[i];
+        if (e->valid && e->tag == tag && e->root_addr == cfg->root_addr && e->level == cfg->level) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void
+fill(tlb_set_t *const sets, const uint32_t n, const uint32_t tag, const config_t *const cfg, const uint64_t value) {
+    tlb_set_t *set = find_set(sets, n, tag, cfg->root_addr);
+
+    // Prefer a free way, otherwise evict round-robin
+    tlb_entry_t *e = NULL;
+    for (int i = 0; i < TLB_WAYS; ++i) {
+        if (!set->ways[i].valid) {
+            e = &set->ways[i];
+            break;
+        }
+    }
+    if (e == NULL) {
+        e = &set->ways[set->victim];
+        set->victim = (set->victim + 1) % TLB_WAYS;
+    }
+
+    e->value = value;
+    e->tag = tag;
+    e->root_addr = cfg->root_addr;
+    e->level = cfg->level;
+    e->valid = true;
+}
+
+static bool
+lookup_page(tlb_t *const tlb,
+            const page_size_t page_size,
+            const uint32_t virt_addr,
+            const config_t *const cfg,
+            uint64_t *const phys_addr) {
+    tlb_entry_t *e;
+    switch (page_size) {
+        case PAGE_4KB:
+            e = lookup(tlb->sets_4kb, TLB_4KB_SETS, virt_addr >> page_size, cfg);
+            break;
+        case PAGE_2MB:
+            e = lookup(tlb->sets_2mb, TLB_LARGE_SETS, virt_addr >> page_size, cfg);
+            break;
+        case PAGE_4MB:
+            e = lookup(tlb->sets_4mb, TLB_LARGE_SETS, virt_addr >> page_size, cfg);
+            break;
+        default:
+            e = NULL;
+    }
+    if (e == NULL) {
+        return false;
+    }
+
+    *phys_addr = e->value | (virt_addr & comp_mask(page_size - 1, 0));
+    return true;
+}
+
+static void
+fill_page(tlb_t *const tlb,
+          const page_size_t page_size,
+          const uint32_t virt_addr,
+          const config_t *const cfg,
+          const uint64_t phys_addr) {
+    uint64_t frame = phys_addr & ~comp_mask(page_size - 1, 0);
+    switch (page_size) {
+        case PAGE_4KB:
+            fill(tlb->sets_4kb, TLB_4KB_SETS, virt_addr >> page_size, cfg, frame);
+            break;
+        case PAGE_2MB:
+            fill(tlb->sets_2mb, TLB_LARGE_SETS, virt_addr >> page_size, cfg, frame);
+            break;
+        case PAGE_4MB:
+            fill(tlb->sets_4mb, TLB_LARGE_SETS, virt_addr >> page_size, cfg, frame);
+            break;
+        default:
+            break;
+    }
+}
+
+// CR3 -> [PDE cache] -> PDE -> PTE -> PHYS
+static error_t
+walk_legacy(tlb_t *const tlb,
+            const uint32_t virt_addr,
+            const translator_t *const tr,
+            uint64_t *const phys_addr,
+            uint32_t *page_fault,
+            page_size_t *const page_size) {
+    const config_t *const cfg = &tr->cfg;
+    uint32_t pde_tag = virt_addr >> LEGACY_PDE_SHIFT;
+    tlb_entry_t *e = lookup(tlb->pde_cache, TLB_PDE_SETS, pde_tag, cfg);
+    if (e != NULL) {
+        return legacy_walk_pt(virt_addr, e->value, tr, phys_addr, page_fault, page_size);
+    }
+
+    uint32_t pde;
+    error_t err = legacy_get_pde(virt_addr, tr, &pde, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+    if (legacy_pde_maps_page(pde, tr)) {
+        *phys_addr = legacy_pde_phys(pde, virt_addr);
+        *page_size = PAGE_4MB;
+        return SUCCESS;
+    }
+    fill(tlb->pde_cache, TLB_PDE_SETS, pde_tag, cfg, pde);
+
+    return legacy_walk_pt(virt_addr, pde, tr, phys_addr, page_fault, page_size);
+}
+
+// CR3 -> [PDPTE cache] -> PDPTE -> [PDE cache] -> PDE -> PTE -> PHYS
+static error_t
+walk_pae(tlb_t *const tlb,
+         const uint32_t virt_addr,
+         const translator_t *const tr,
+         uint64_t *const phys_addr,
+         uint32_t *page_fault,
+         page_size_t *const page_size) {
+    const config_t *const cfg = &tr->cfg;
+    uint32_t pde_tag = virt_addr >> PAE_PDE_SHIFT;
+    tlb_entry_t *e = lookup(tlb->pde_cache, TLB_PDE_SETS, pde_tag, cfg);
+    if (e != NULL) {
+        return pae_walk_pt(virt_addr, e->value, tr, phys_addr, page_fault, page_size);
+    }
+
+    uint64_t pdpte;
+    uint32_t pdpte_tag = virt_addr >> PDPTE_SHIFT;
+    e = lookup(tlb->pdpte_cache, TLB_PDPTE_SETS, pdpte_tag, cfg);
+    if (e != NULL) {
+        pdpte = e->value;
+    } else {
+        error_t err = pae_get_pdpte(virt_addr, tr, &pdpte, page_fault);
+        if (err != SUCCESS) {
+            return err;
+        }
+        fill(tlb->pdpte_cache, TLB_PDPTE_SETS, pdpte_tag, cfg, pdpte);
+    }
+
+    uint64_t pde;
+    error_t err = pae_get_pde(virt_addr, pdpte, tr, &pde, page_fault);
+    if (err != SUCCESS) {
+        return err;
+    }
+    if (pae_pde_maps_page(pde)) {
+        *phys_addr = pae_pde_phys(pde, virt_addr);
+        *page_size = PAGE_2MB;
+        return SUCCESS;
+    }
+    fill(tlb->pde_cache, TLB_PDE_SETS, pde_tag, cfg, pde);
+
+    return pae_walk_pt(virt_addr, pde, tr, phys_addr, page_fault, page_size);
+}
+
+void
+v2p_tlb_init(tlb_t *const tlb) {
+    v2p_tlb_flush(tlb);
+}
+
+error_t
+va2pa_tlb(const uint32_t virt_addr,
+          const config_t *const cfg,
+          tlb_t *const tlb,
+          uint64_t *const phys_addr,
+          uint32_t *page_fault) {
+    if (lookup_page(tlb, PAGE_4KB, virt_addr, cfg, phys_addr)) {
+        return SUCCESS;
+    }
+
+    // Only successful translations are cached, faults are always re-walked
+    translator_t tr;
+    page_size_t page_size;
+    error_t err;
+    switch (cfg->level) {
+        case LEGACY: {
+            if (lookup_page(tlb, PAGE_4MB, virt_addr, cfg, phys_addr)) {
+                return SUCCESS;
+            }
+            translator_setup(&tr, cfg);
+            err = walk_legacy(tlb, virt_addr, &tr, phys_addr, page_fault, &page_size);
+            break;
+        }
+        case PAE: {
+            if (lookup_page(tlb, PAGE_2MB, virt_addr, cfg, phys_addr)) {
+                return SUCCESS;
+            }
+            translator_setup(&tr, cfg);
+            err = walk_pae(tlb, virt_addr, &tr, phys_addr, page_fault, &page_size);
+            break;
+        }
+        default:
+            return INVALID_TRANSLATION_TYPE;
+    }
+
+    if (err == SUCCESS) {
+        fill_page(tlb, page_size, virt_addr, cfg, *phys_addr);
+    }
+    return err;
+}
+
+static void
+invalidate_tag(tlb_set_t *const sets, const int n, const uint32_t tag) {
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < TLB_WAYS; ++j) {
+            if (sets[i].ways[j].tag == tag) {
+                sets[i].ways[j].valid = false;
+            }
+        }
+    }
+}
+
+void
+v2p_tlb_invlpg(tlb_t *const tlb, const uint32_t virt_addr) {
+    // The set depends on cr3, so every set has to be searched
+    invalidate_tag(tlb->sets_4kb, TLB_4KB_SETS, virt_addr >> PAGE_4KB);
+    invalidate_tag(tlb->sets_2mb, TLB_LARGE_SETS, virt_addr >> PAGE_2MB);
+    invalidate_tag(tlb->sets_4mb, TLB_LARGE_SETS, virt_addr >> PAGE_4MB);
+
+    // INVLPG also invalidates all entries in all paging-structure caches,
+    // regardless of the linear addresses to which they correspond
+    memset(tlb->pdpte_cache, 0, sizeof(tlb->pdpte_cache));
+    memset(tlb->pde_cache, 0, sizeof(tlb->pde_cache));
+}
+
+void
+v2p_tlb_flush(tlb_t *const tlb) {
+    memset(tlb, 0, sizeof(*tlb));
+}
+
+static void
+invalidate_root(tlb_set_t *const sets, const int n, const uint64_t root_addr) {
+    for (int i = 0; i < n; ++i) {
+        for (int j = 0; j < TLB_WAYS; ++j) {
+            if (sets[i].ways[j].root_addr == root_addr) {
+                sets[i].ways[j].valid = false;
+            }
+        }
+    }
+}
+
+void
+v2p_tlb_flush_root(tlb_t *const tlb, const uint64_t root_addr) {
+    invalidate_root(tlb->sets_4kb, TLB_4KB_SETS, root_addr);
+    invalidate_root(tlb->sets_2mb, TLB_LARGE_SETS, root_addr);
+    invalidate_root(tlb->sets_4mb, TLB_LARGE_SETS, root_addr);
+    invalidate_root(tlb->pdpte_cache, TLB_PDPTE_SETS, root_addr);
+    invalidate_root(tlb->pde_cache, TLB_PDE_SETS, root_addr);
+}
@@ -0,0 +1,143 @@
+#include <stdlib.h>
+
+#include "translator.h"
+#include "legacy.h"
+#include "pae.h"
+#include "ia32e.h"
+#include "stats.h"
+#include "utils.h"
+
+static error_t
+walk_invalid(const translator_t *const tr,
+             const uint64_t virt_addr,
+             uint64_t *const phys_addr,
+             uint32_t *page_fault,
+             page_size_t *const page_size) {
+    return INVALID_TRANSLATION_TYPE;
+}
+
+void
+translator_setup(translator_t *const tr, const config_t *const cfg) {
+    tr->cfg = *cfg;
+    if (cfg->detect_features) {
+        get_features(&tr->cfg.pat, &tr->cfg.maxphyaddr);
+    }
+
+    tr->reserved = (reserved_masks_t) {0};
+    switch (cfg->level) {
+#if !defined(V2P_ONLY_PAE) && !defined(V2P_ONLY_IA32E)
+        case LEGACY: {
+            legacy_reserved_masks(&tr->cfg, &tr->reserved);
+            tr->walk = va2pa_legacy;
+            break;
+        }
+#endif
+#if !defined(V2P_ONLY_LEGACY) && !defined(V2P_ONLY_IA32E)
+        case PAE: {
+            pae_reserved_masks(&tr->cfg, &tr->reserved);
+            tr->walk = va2pa_pae;
+            break;
+        }
+#endif
+#if !defined(V2P_ONLY_LEGACY) && !defined(V2P_ONLY_PAE)
+        case IA32E: {
+            ia32e_reserved_masks(&tr->cfg, &tr->reserved);
+            tr->walk = va2pa_ia32e;
+            break;
+        }
+        case LA57: {
+            ia32e_reserved_masks(&tr->cfg, &tr->reserved);
+            tr->walk = va2pa_la57;
+            break;
+        }
+#endif
+        default:
+            tr->walk = walk_invalid;
+    }
+}
+
+static inline error_t
+translator_dispatch(const translator_t *const tr,
+                    const uint64_t virt_addr,
+                    uint64_t *const phys_addr,
+                    uint32_t *page_fault,
+                    page_size_t *const page_size) {
+#if defined(V2P_ONLY_LEGACY)
+    if (tr->cfg.level == LEGACY) {
+        return va2pa_legacy(tr, virt_addr, phys_addr, page_fault, page_size);
+    }
+    return INVALID_TRANSLATION_TYPE;
+#elif defined(V2P_ONLY_PAE)
+    if (tr->cfg.level == PAE) {
+        return va2pa_pae(tr, virt_addr, phys_addr, page_fault, page_size);
+    }
+    return INVALID_TRANSLATION_TYPE;
+#elif defined(V2P_ONLY_IA32E)
+    if (tr->cfg.level == IA32E) {
+        return va2pa_ia32e(tr, virt_addr, phys_addr, page_fault, page_size);
+    }
+    if (tr->cfg.level == LA57) {
+        return va2pa_la57(tr, virt_addr, phys_addr, page_fault, page_size);
+    }
+    return INVALID_TRANSLATION_TYPE;
+#else
+    return tr->walk(tr, virt_addr, phys_addr, page_fault, page_size);
+#endif
+}
+
+error_t
+translator_walk(const translator_t *const tr,
+                const uint64_t virt_addr,
+                uint64_t *const phys_addr,
+                uint32_t *page_fault,
+                page_size_t *const page_size) {
+#ifdef V2P_STATS
+    // The walk reads one entry per level, so its reads tell where it ended
+    v2p_stats_t *stats = stats_local();
+    uint64_t reads = stats->reads;
+    error_t err = translator_dispatch(tr, virt_addr, phys_addr, page_fault, page_size);
+    paging_level_t top = tr->cfg.level == LEGACY ? LEVEL_PDE
+                         : tr->cfg.level == PAE ? LEVEL_PDPTE
+                         : tr->cfg.level == IA32E ? LEVEL_PML4E : LEVEL_PML5E;
+    stats_walk(stats, top, stats->reads - reads, err,
+               err == PAGE_FAULT ? *page_fault : 0, err == SUCCESS ? *page_size : PAGE_4KB);
+    return err;
+#else
+    return translator_dispatch(tr, virt_addr, phys_addr, page_fault, page_size);
+#endif
+}
+
+error_t
+walk(const uint64_t virt_addr,
+     const config_t *const cfg,
+     uint64_t *const phys_addr,
+     uint32_t *page_fault,
+     page_size_t *const page_size) {
+    translator_t tr;
+    translator_setup(&tr, cfg);
+    return translator_walk(&tr, virt_addr, phys_addr, page_fault, page_size);
+}
+
+translator_t *
+v2p_translator_init(const config_t *const cfg) {
+    translator_t *tr = malloc(sizeof(translator_t));
+    if (tr == NULL) {
+        return NULL;
+    }
+    translator_setup(tr, cfg);
+    return tr;
+}
+
+void
+v2p_translator_free(translator_t *const tr) {
+    free(tr);
+}
+
+error_t
+v2p_translate(const translator_t *const tr,
+              const uint64_t virt_addr,
+              uint64_t *const phys_addr,
+              uint32_t *page_fault) {
+    page_size_t page_size;
+    return translator_walk(tr, virt_addr, phys_addr, page_fault, &page_size);
+}
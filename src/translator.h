@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "v2p.h"
+#include "internal.h"
+
+// Reserved bits of every kind of present paging-structure entry,
+// computed once from the config_t flags
+typedef struct reserved_masks {
+    // PML5E and PML4E
+    uint64_t pml4e;
+
+    // PDPTE referencing a page directory, or mapping a 1-GByte page
+    uint64_t pdpte;
+    uint64_t pdpte_1gb;
+
+    // PDE referencing a page table, or mapping a 2-MByte/4-MByte page
+    uint64_t pde;
+    uint64_t pde_large;
+
+    uint64_t pte;
+} reserved_masks_t;
+
+typedef error_t (*walk_func_t)(const translator_t *tr,
+                               uint64_t virt_addr,
+                               uint64_t *phys_addr,
+                               uint32_t *page_fault,
+                               page_size_t *page_size);
+
+// V2P_ONLY_LEGACY, V2P_ONLY_PAE or V2P_ONLY_IA32E (4- and 5-level) build the walker
+// of a single paging mode: it is called directly instead of through translator.walk,
+// and translators of every other mode fail with INVALID_TRANSLATION_TYPE
+struct translator {
+    config_t cfg;
+    reserved_masks_t reserved;
+
+    // walker of cfg.level
+    walk_func_t walk;
+};
+
+// Precomputes everything a walk needs from cfg
+V2P_INTERNAL void
+translator_setup(translator_t *tr, const config_t *cfg);
+
+// Walks virt_addr with the walker of tr->cfg.level
+V2P_INTERNAL error_t
+translator_walk(const translator_t *tr,
+                uint64_t virt_addr,
+                uint64_t *phys_addr,
+                uint32_t *page_fault,
+                page_size_t *page_size);
+
+// Builds a translator for cfg and walks virt_addr, reporting the size of the mapped page
+V2P_INTERNAL error_t
+walk(uint64_t virt_addr,
+     const config_t *cfg,
+     uint64_t *phys_addr,
+     uint32_t *page_fault,
+     page_size_t *page_size);
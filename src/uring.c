@@ -0,0 +1,211 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "v2p.h"
+
+// io_uring without liburing: the rings are mapped by hand and
+// io_uring_setup/io_uring_enter are called through syscall(2)
+struct uring_file {
+    int fd;
+    int ring_fd;
+    uint32_t depth;
+
+    // reads queued since the last reap, and submitted but not reaped
+    uint32_t queued;
+    uint32_t in_flight;
+
+    // reads of in_flight published in the submission ring but not yet
+    // taken by io_uring_enter, left over by a reap that failed
+    uint32_t unsubmitted;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    uint32_t *sq_tail;
+    uint32_t sq_mask;
+    uint32_t *sq_array;
+
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+};
+
+static bool
+uring_submit(void *const arg, void *const buf, const uint32_t size, const uint64_t physical_addr, const uint64_t tag) {
+    uring_file_t *u = arg;
+    // The completion ring must have room for every read in flight
+    if (u->queued + u->in_flight >= u->depth) {
+        return false;
+    }
+
+    uint32_t tail = *u->sq_tail + u->queued;
+    uint32_t index = tail & u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = u->fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = size;
+    sqe->off = physical_addr;
+    sqe->user_data = tag;
+    u->sq_array[index] = index;
+    ++u->queued;
+    return true;
+}
+
+static uint32_t
+uring_reap(void *const arg, uint64_t *const tags, int32_t *const results, const uint32_t max) {
+    uring_file_t *u = arg;
+
+    // Publish the queued reads, then send them and wait in one call
+    __atomic_store_n(u->sq_tail, *u->sq_tail + u->queued, __ATOMIC_RELEASE);
+    u->unsubmitted += u->queued;
+    u->in_flight += u->queued;
+    u->queued = 0;
+
+    uint32_t head = *u->cq_head;
+    while (true) {
+        bool ready = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) != head;
+        if (u->unsubmitted == 0 && (ready || u->in_flight == 0)) {
+            break;
+        }
+        long ret = syscall(__NR_io_uring_enter, u->ring_fd, u->unsubmitted, ready ? 0 : 1,
+                           IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            // Reads already taken by the kernel may still complete: they stay
+            // in flight, and the rest is submitted by the next reap
+            return 0;
+        }
+        u->unsubmitted -= (uint32_t) ret < u->unsubmitted ? (uint32_t) ret : u->unsubmitted;
+    }
+
+    uint32_t n = 0;
+    uint32_t tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail && n < max; ++head, ++n) {
+        const struct io_uring_cqe *cqe = &u->cqes[head & u->cq_mask];
+        tags[n] = cqe->user_data;
+        results[n] = cqe->res > 0 ? cqe->res : 0;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    u->in_flight -= n;
+    return n;
+}
+
+uring_file_t *
+v2p_uring_open(const char *const path, const uint32_t depth) {
+    uring_file_t *u = calloc(1, sizeof(uring_file_t));
+    if (u == NULL) {
+        return NULL;
+    }
+    u->ring_fd = -1;
+    u->fd = open(path, O_RDONLY);
+    if (u->fd < 0) {
+        v2p_uring_close(u);
+        return NULL;
+    }
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    u->ring_fd = (int) syscall(__NR_io_uring_setup, depth, &params);
+    if (u->ring_fd < 0) {
+        v2p_uring_close(u);
+        return NULL;
+    }
+    // The kernel rounds the depth up to a power of two
+    u->depth = params.sq_entries < params.cq_entries ? params.sq_entries : params.cq_entries;
+
+    u->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    u->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_size > u->sq_ring_size) {
+            u->sq_ring_size = u->cq_ring_size;
+        }
+        u->cq_ring_size = 0;
+    }
+    u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      u->ring_fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) {
+        u->sq_ring = NULL;
+        v2p_uring_close(u);
+        return NULL;
+    }
+    if (u->cq_ring_size == 0) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          u->ring_fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) {
+            u->cq_ring = NULL;
+            v2p_uring_close(u);
+            return NULL;
+        }
+    }
+    u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   u->ring_fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        v2p_uring_close(u);
+        return NULL;
+    }
+
+    uint8_t *sq = u->sq_ring;
+    u->sq_tail = (uint32_t *) (sq + params.sq_off.tail);
+    u->sq_mask = *(uint32_t *) (sq + params.sq_off.ring_mask);
+    u->sq_array = (uint32_t *) (sq + params.sq_off.array);
+
+    uint8_t *cq = u->cq_ring;
+    u->cq_head = (uint32_t *) (cq + params.cq_off.head);
+    u->cq_tail = (uint32_t *) (cq + params.cq_off.tail);
+    u->cq_mask = *(uint32_t *) (cq + params.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return u;
+}
+
+async_backend_t
+v2p_uring_backend(uring_file_t *const u) {
+    async_backend_t backend = {
+            .arg=u,
+            .submit=uring_submit,
+            .reap=uring_reap,
+    };
+    return backend;
+}
+
+void
+v2p_uring_close(uring_file_t *const u) {
+    if (u == NULL) {
+        return;
+    }
+    if (u->sqes != NULL) {
+        munmap(u->sqes, u->sqes_size);
+    }
+    if (u->cq_ring != NULL && u->cq_ring != u->sq_ring) {
+        munmap(u->cq_ring, u->cq_ring_size);
+    }
+    if (u->sq_ring != NULL) {
+        munmap(u->sq_ring, u->sq_ring_size);
+    }
+    if (u->ring_fd >= 0) {
+        close(u->ring_fd);
+    }
+    if (u->fd >= 0) {
+        close(u->fd);
+    }
+    free(u);
+}
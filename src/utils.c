@@ -1,30 +1,111 @@
 #include <cpuid.h>
+#include <string.h>
 
+#include "stats.h"
 #include "utils.h"
 
-uint64_t
-check_bit(const uint64_t x, const uint8_t N) {
-    return x & (1U << N);
+int32_t
+read_phys(const config_t *const cfg, void *const buf, const uint32_t size, const uint64_t physical_addr) {
+#ifdef V2P_STATS
+    v2p_stats_t *stats = stats_local();
+    STATS_ADD(stats, reads, 1);
+#endif
+    if (cfg->mem_base != NULL) {
+        // Reads outside of the mapped memory fail like an out-of-bounds read_func
+        if (physical_addr >= cfg->mem_size || size > cfg->mem_size - physical_addr) {
+            return 0;
+        }
+        memcpy(buf, (const uint8_t *) cfg->mem_base + physical_addr, size);
+        return (int32_t) size;
+    }
+    if (has_map(cfg)) {
+        uint64_t len = 0;
+        const void *p = call_map(cfg, physical_addr, &len);
+        if (p != NULL && len >= size) {
+            memcpy(buf, p, size);
+            return (int32_t) size;
+        }
+#if !defined(V2P_READ_FUNC) && !defined(V2P_READ_CTX_FUNC)
+        if (cfg->read_func == NULL && cfg->read_ctx_func == NULL) {
+            return 0;
+        }
+#endif
+    }
+#if defined(V2P_READ_CTX_FUNC)
+    // read_ctx_func chosen at compile time, so that it can be inlined into the walk
+    return V2P_READ_CTX_FUNC(cfg->ctx, buf, size, physical_addr);
+#elif defined(V2P_READ_FUNC)
+    // read_func chosen at compile time, so that it can be inlined into the walk
+    return V2P_READ_FUNC(buf, size, physical_addr);
+#else
+    if (cfg->read_ctx_func != NULL) {
+        return cfg->read_ctx_func(cfg->ctx, buf, size, physical_addr);
+    }
+    return cfg->read_func(buf, size, physical_addr);
+#endif
 }
 
-// Compute bit-mask with bits[l:r] set to 1
-uint64_t
-comp_mask(const uint8_t l, const uint8_t r) {
-    uint64_t a = r != 0 ? ~((1UL << r) - 1) : 0xffffffffffffffff;
-    uint64_t b;
-    if (l == 0) {
-        b = 0x1;
-    } else if (l == 63) {
-        b = 0xffffffffffffffff;
-    } else {
-        b = (1UL << (l + 1U)) - 1;
-    }
-    return a & b;
+const uint8_t *
+map_table(const config_t *const cfg, const uint64_t table_addr) {
+    if (cfg->mem_base != NULL) {
+        if (table_addr >= cfg->mem_size || 4096 > cfg->mem_size - table_addr) {
+            return NULL;
+        }
+        return (const uint8_t *) cfg->mem_base + table_addr;
+    }
+    if (has_map(cfg)) {
+        uint64_t len = 0;
+        const void *p = call_map(cfg, table_addr, &len);
+        if (p != NULL && len >= 4096) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+void
+read_many(const config_t *const cfg, const read_req_t *const reqs, const uint32_t n, int32_t *const results) {
+    if (has_readv(cfg) && cfg->mem_base == NULL && !has_map(cfg)) {
+        call_readv(cfg, reqs, n, results);
+        return;
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+        results[i] = read_phys(cfg, reqs[i].buf, reqs[i].size, reqs[i].physical_addr);
+    }
 }
 
-uint8_t
-min(uint8_t a, uint8_t b) {
-    return a < b ? a : b;
+uint32_t
+read_entries(const config_t *const cfg,
+             void *const buf,
+             const uint32_t entry_size,
+             const uint32_t count,
+             const uint64_t physical_addr) {
+    if (read_phys(cfg, buf, entry_size * count, physical_addr) == (int32_t) (entry_size * count)) {
+        return count;
+    }
+
+    // Find out exactly which entry could not be read
+    uint32_t i = 0;
+    if (has_readv(cfg) && cfg->mem_base == NULL && !has_map(cfg)) {
+        read_req_t reqs[1024];
+        int32_t results[1024];
+        for (uint32_t j = 0; j < count; ++j) {
+            reqs[j].buf = (uint8_t *) buf + j * entry_size;
+            reqs[j].size = entry_size;
+            reqs[j].physical_addr = physical_addr + j * entry_size;
+        }
+        call_readv(cfg, reqs, count, results);
+        while (i < count && results[i] > 0) {
+            ++i;
+        }
+        return i;
+    }
+    for (; i < count; ++i) {
+        if (read_phys(cfg, (uint8_t *) buf + i * entry_size, entry_size, physical_addr + i * entry_size) <= 0) {
+            break;
+        }
+    }
+    return i;
 }
 
 error_t
@@ -47,21 +128,52 @@ check_access(bool is_supervisor_addr,
     return SUCCESS;
 }
 
-void
-get_features(bool *pat, uint8_t *maxphyaddr) {
+// Results of the cpuid queries of get_features, 0 until the first call:
+// FEATURES_KNOWN | pat flags | maxphyaddr flags | maxphyaddr
+enum {
+    FEATURES_PAT_KNOWN = 1U << 8U,
+    FEATURES_PAT = 1U << 9U,
+    FEATURES_MAXPHYADDR_KNOWN = 1U << 10U,
+    FEATURES_KNOWN = 1U << 31U,
+};
+
+static uint32_t features_cache = 0;
+
+static uint32_t
+features_query(void) {
     uint32_t eax;
     uint32_t ebx;
     uint32_t ecx;
     uint32_t edx;
+    uint32_t features = FEATURES_KNOWN;
 
     // If CPUID.01H:EDX.PAT [bit 16] = 1, the 8-entry page-attribute table (PAT) is supported.
     if (__get_cpuid(0x1, &eax, &ebx, &ecx, &edx)) {
-        *pat = check_bit(edx, 16);
+        features |= FEATURES_PAT_KNOWN | (check_bit(edx, 16) ? FEATURES_PAT : 0);
     }
 
     // CPUID.80000008H:EAX[7:0] reports the physical-address width supported by the processor.
     // This width is referred to as MAXPHYADDR.
     if (__get_cpuid(0x80000008, &eax, &ebx, &ecx, &edx)) {
-        *maxphyaddr = eax & comp_mask(7, 0);
+        features |= FEATURES_MAXPHYADDR_KNOWN | (eax & comp_mask(7, 0));
+    }
+    return features;
+}
+
+void
+get_features(bool *pat, uint8_t *maxphyaddr) {
+    // cpuid exits to the hypervisor in a VM, so it runs on the first call only;
+    // racing first calls store the same value
+    uint32_t features = __atomic_load_n(&features_cache, __ATOMIC_RELAXED);
+    if (features == 0) {
+        features = features_query();
+        __atomic_store_n(&features_cache, features, __ATOMIC_RELAXED);
+    }
+
+    if (features & FEATURES_PAT_KNOWN) {
+        *pat = (features & FEATURES_PAT) != 0;
+    }
+    if (features & FEATURES_MAXPHYADDR_KNOWN) {
+        *maxphyaddr = (uint8_t) (features & comp_mask(7, 0));
     }
 }
@@ -4,20 +4,102 @@
 #include <stdbool.h>
 
 #include "v2p.h"
+#include "internal.h"
 
-inline uint64_t
-check_bit(uint64_t x, uint8_t N);
+static inline uint64_t
+check_bit(const uint64_t x, const uint8_t N) {
+    return x & (1U << N);
+}
 
-inline uint64_t
-comp_mask(uint8_t l, uint8_t r);
+// Compute bit-mask with bits[l:r] set to 1
+static inline uint64_t
+comp_mask(const uint8_t l, const uint8_t r) {
+    uint64_t a = r != 0 ? ~((1UL << r) - 1) : 0xffffffffffffffff;
+    uint64_t b;
+    if (l == 0) {
+        b = 0x1;
+    } else if (l == 63) {
+        b = 0xffffffffffffffff;
+    } else {
+        b = (1UL << (l + 1U)) - 1;
+    }
+    return a & b;
+}
 
-inline uint8_t
-min(uint8_t a, uint8_t b);
+static inline uint8_t
+min(uint8_t a, uint8_t b) {
+    return a < b ? a : b;
+}
 
-error_t
+// true if cfg has a vectored read, readv_func or readv_ctx_func
+static inline bool
+has_readv(const config_t *const cfg) {
+    return cfg->readv_func != NULL || cfg->readv_ctx_func != NULL;
+}
+
+static inline void
+call_readv(const config_t *const cfg, const read_req_t *const reqs, const uint32_t n, int32_t *const results) {
+    if (cfg->readv_ctx_func != NULL) {
+        cfg->readv_ctx_func(cfg->ctx, reqs, n, results);
+    } else {
+        cfg->readv_func(reqs, n, results);
+    }
+}
+
+// true if cfg has a direct map of physical memory, map_func or map_ctx_func
+static inline bool
+has_map(const config_t *const cfg) {
+    return cfg->map_func != NULL || cfg->map_ctx_func != NULL;
+}
+
+static inline const void *
+call_map(const config_t *const cfg, const uint64_t physical_addr, uint64_t *const len) {
+    if (cfg->map_ctx_func != NULL) {
+        return cfg->map_ctx_func(cfg->ctx, physical_addr, len);
+    }
+    return cfg->map_func(physical_addr, len);
+}
+
+// Reads physical memory: directly from cfg->mem_base or through cfg->map_func
+// if they are set, with read_func otherwise
+V2P_INTERNAL int32_t
+read_phys(const config_t *cfg, void *buf, uint32_t size, uint64_t physical_addr);
+
+// read_phys timed into cfg->profile
+V2P_INTERNAL int32_t
+profile_read(const config_t *cfg, void *buf, uint32_t size, uint64_t physical_addr, paging_level_t level);
+
+// read_phys of a paging-structure entry at level, profiled if cfg->profile is set
+static inline int32_t
+read_level(const config_t *const cfg,
+           void *const buf,
+           const uint32_t size,
+           const uint64_t physical_addr,
+           const paging_level_t level) {
+    if (cfg->profile != NULL) {
+        return profile_read(cfg, buf, size, physical_addr, level);
+    }
+    return read_phys(cfg, buf, size, physical_addr);
+}
+
+// Returns a host pointer to the whole 4KB table at table_addr,
+// or NULL if it is not directly accessible (read it with read_phys then)
+V2P_INTERNAL const uint8_t *
+map_table(const config_t *cfg, uint64_t table_addr);
+
+// Performs n reads with a single readv_func call if it is set, with read_phys otherwise
+V2P_INTERNAL void
+read_many(const config_t *cfg, const read_req_t *reqs, uint32_t n, int32_t *results);
+
+// Reads count consecutive paging-structure entries with a single read_func call
+// if possible, returns the number of entries read before the first failure
+V2P_INTERNAL uint32_t
+read_entries(const config_t *cfg, void *buf, uint32_t entry_size, uint32_t count, uint64_t physical_addr);
+
+V2P_INTERNAL error_t
 check_access(bool is_supervisor_addr,
              const config_t *cfg,
              uint32_t *page_fault);
 
-void
+V2P_INTERNAL void
 get_features(bool *pat, uint8_t *maxphyaddr);
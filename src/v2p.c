@@ -1,27 +1,62 @@
 #include "v2p.h"
+#include "translator.h"
 #include "legacy.h"
 #include "pae.h"
-
-// One of the few situations when magic numbers are not bad IMO
-static const uint8_t DIRECTORY_SHIFT = 32;
-static const uint8_t TABLE_SHIFT = 22;
-static const uint8_t PAGE_SHIFT = 12;
-
+#include "ia32e.h"
 
 error_t
 va2pa(const uint32_t virt_addr,
       const config_t *const cfg,
       uint64_t *const phys_addr,
       uint32_t *page_fault) {
-    switch (cfg->level) {
-        case LEGACY: {
-            return va2pa_legacy(virt_addr, cfg, phys_addr, page_fault);
+    page_size_t page_size;
+    return walk(virt_addr, cfg, phys_addr, page_fault, &page_size);
+}
+
+error_t
+va2pa64(const uint64_t virt_addr,
+        const config_t *const cfg,
+        uint64_t *const phys_addr,
+        uint32_t *page_fault) {
+    page_size_t page_size;
+    return walk(virt_addr, cfg, phys_addr, page_fault, &page_size);
+}
+
+error_t
+va2pa64_resume(const uint64_t virt_addr,
+               const paging_level_t level,
+               const uint64_t entry,
+               const config_t *const cfg,
+               uint64_t *const phys_addr,
+               uint32_t *page_fault) {
+    if (cfg->level != IA32E && cfg->level != LA57) {
+        return INVALID_TRANSLATION_TYPE;
+    }
+    if (!ia32e_is_canonical(virt_addr, cfg->level == LA57 ? 57 : 48)) {
+        return NON_CANONICAL_ADDRESS;
+    }
+
+    translator_t tr;
+    translator_setup(&tr, cfg);
+
+    page_size_t page_size;
+    switch (level) {
+        case LEVEL_PML5E: {
+            if (cfg->level != LA57) {
+                return INVALID_TRANSLATION_TYPE;
+            }
+            return ia32e_walk_pml4(virt_addr, entry, &tr, phys_addr, page_fault, &page_size);
         }
-        case PAE: {
-            return va2pa_pae(virt_addr, cfg, phys_addr, page_fault);
+        case LEVEL_PML4E: {
+            return ia32e_walk_pdpt(virt_addr, entry, &tr, phys_addr, page_fault, &page_size);
+        }
+        case LEVEL_PDPTE: {
+            return ia32e_walk_pd(virt_addr, entry, &tr, phys_addr, page_fault, &page_size);
+        }
+        case LEVEL_PDE: {
+            return ia32e_walk_pt(virt_addr, entry, &tr, phys_addr, page_fault, &page_size);
         }
         default:
             return INVALID_TRANSLATION_TYPE;
     }
 }
-
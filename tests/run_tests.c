@@ -3,6 +3,22 @@
 
 #include "test_v2p.h"
 #include "test_utils.h"
+#include "test_tlb.h"
+#include "test_shared_tlb.h"
+#include "test_flat.h"
+#include "test_batch.h"
+#include "test_range.h"
+#include "test_enumerate.h"
+#include "test_ia32e.h"
+#include "test_dump.h"
+#include "test_translator.h"
+#include "test_simd.h"
+#include "test_async.h"
+#include "test_scan.h"
+#include "test_rmap.h"
+#include "test_snapshot.h"
+#include "test_stats.h"
+#include "test_profile.h"
 
 void
 print_binary(uint32_t number) {
@@ -17,6 +33,23 @@ main() {
     bool ok = true;
     ok &= test_comp_mask();
     ok &= test_va2pa();
+    ok &= test_va2pa_ctx_threads();
+    ok &= test_tlb();
+    ok &= test_shared_tlb();
+    ok &= test_flat();
+    ok &= test_batch();
+    ok &= test_range();
+    ok &= test_enumerate();
+    ok &= test_ia32e();
+    ok &= test_dump();
+    ok &= test_translator();
+    ok &= test_simd();
+    ok &= test_async();
+    ok &= test_scan();
+    ok &= test_rmap();
+    ok &= test_snapshot();
+    ok &= test_stats();
+    ok &= test_profile();
 
     if (ok) {
         printf("OK\n");
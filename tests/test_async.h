@@ -0,0 +1,261 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "v2p.h"
+#include "test_mem.h"
+
+typedef struct async_result {
+    bool done;
+    uint64_t virt_addr;
+    error_t err;
+    uint64_t phys_addr;
+    uint32_t page_fault;
+} async_result_t;
+
+static int async_done_calls = 0;
+
+static void
+async_done(void *user_data, uint64_t virt_addr, error_t err, uint64_t phys_addr, uint32_t page_fault) {
+    async_result_t *r = user_data;
+    ++async_done_calls;
+    r->done = true;
+    r->virt_addr = virt_addr;
+    r->err = err;
+    r->phys_addr = phys_addr;
+    r->page_fault = page_fault;
+}
+
+// Backend over test_mem completing the queued reads newest first, at most 2 per reap
+static struct {
+    void *bufs[16];
+    uint32_t sizes[16];
+    uint64_t addrs[16];
+    uint64_t tags[16];
+    uint32_t n;
+    int reaps;
+
+    // number of reaps left to fail, keeping the queued reads
+    int fail;
+} async_mock;
+
+static bool
+async_mock_submit(void *arg, void *buf, uint32_t size, uint64_t physical_addr, uint64_t tag) {
+    if (async_mock.n == 16) {
+        return false;
+    }
+    async_mock.bufs[async_mock.n] = buf;
+    async_mock.sizes[async_mock.n] = size;
+    async_mock.addrs[async_mock.n] = physical_addr;
+    async_mock.tags[async_mock.n] = tag;
+    ++async_mock.n;
+    return true;
+}
+
+static uint32_t
+async_mock_reap(void *arg, uint64_t *tags, int32_t *results, uint32_t max) {
+    ++async_mock.reaps;
+    if (async_mock.fail > 0) {
+        --async_mock.fail;
+        return 0;
+    }
+    uint32_t n = 0;
+    while (async_mock.n > 0 && n < max && n < 2) {
+        uint32_t k = --async_mock.n;
+        tags[n] = async_mock.tags[k];
+        results[n] = test_mem_read_func(async_mock.bufs[k], async_mock.sizes[k], async_mock.addrs[k]);
+        ++n;
+    }
+    return n;
+}
+
+// Random entries pointing back into the first 16 pages, see simd_random_tables
+static void
+async_random_tables(uint64_t *const mem, const size_t n, uint64_t *const seed) {
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t x = *seed;
+        x ^= x << 13U;
+        x ^= x >> 7U;
+        x ^= x << 17U;
+        *seed = x;
+
+        uint64_t entry = (((x >> 12U) & 0xfU) << 12U) | (x & 0xfffU);
+        if (x % 4 != 0) {
+            entry |= 1U;
+        }
+        if (x % 8 == 0) {
+            entry |= (x << 20U) & 0xffff000000000000ULL;
+        }
+        mem[i] = entry;
+    }
+}
+
+bool
+test_async() {
+    bool ok = true;
+
+    // IA-32e: pml4e 0 -> pdpt at 0x1000, pdpte 0 -> pd at 0x2000, pdpte 1 -> 1GB page,
+    // pde 0 -> pt at 0x3000, pde 1 has a reserved bit set, pte 5 -> 0x123456000
+    test_mem_reset();
+    test_mem_write(0x0, 0x1000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000, 0x2000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000 + 8, 0x1c0000000ULL | 1U | (1U << 7U), sizeof(uint64_t));
+    test_mem_write(0x2000, 0x3000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x2000 + 8, 0x3000 | 1U | (1ULL << 50U), sizeof(uint64_t));
+    test_mem_write(0x3000 + 5 * 8, 0x123456000ULL | 1U, sizeof(uint64_t));
+
+    config_t cfg = {.level=IA32E, .root_addr=0, .read_func=test_mem_read_func, .pat=true, .maxphyaddr=40};
+    uint64_t virt_addrs[] = {0x5abc, 0x7fffffff, 0x200000, 0x4000, 0x0000800000000000ULL, 0x8000000000ULL, 0x5001};
+    enum { N = sizeof(virt_addrs) / sizeof(uint64_t) };
+    async_result_t results[N];
+    memset(results, 0, sizeof(results));
+    memset(&async_mock, 0, sizeof(async_mock));
+
+    async_backend_t mock = {.arg=NULL, .submit=async_mock_submit, .reap=async_mock_reap};
+    async_walker_t *w = v2p_async_init(&cfg, &mock, 4, async_done);
+    if (w == NULL) {
+        printf("async: init failed\n\n");
+        return false;
+    }
+
+    // Only 4 walks fit, the rest are submitted as the first ones finish
+    async_done_calls = 0;
+    int submitted = 0;
+    while (submitted < N) {
+        while (submitted < N && v2p_async_submit(w, virt_addrs[submitted], &results[submitted]) == SUCCESS) {
+            ++submitted;
+        }
+        v2p_async_poll(w);
+    }
+    v2p_async_drain(w);
+    v2p_async_free(w);
+
+    if (async_done_calls != N) {
+        printf("async: got %d completions, want %d\n\n", async_done_calls, N);
+        ok = false;
+    }
+    for (int i = 0; i < N; ++i) {
+        uint64_t want_phys = 0;
+        uint32_t want_page_fault = 0;
+        error_t want_err = va2pa64(virt_addrs[i], &cfg, &want_phys, &want_page_fault);
+        if (!results[i].done || results[i].virt_addr != virt_addrs[i] || results[i].err != want_err
+            || results[i].phys_addr != want_phys || results[i].page_fault != want_page_fault) {
+            printf("async: wrong result for %llx\ngot:  %d %llx %u\nwant: %d %llx %u\n\n",
+                   virt_addrs[i], results[i].err, results[i].phys_addr, results[i].page_fault,
+                   want_err, want_phys, want_page_fault);
+            ok = false;
+        }
+    }
+
+    // A failed reap fails the walks, but the ones with a read in flight keep
+    // their slots until the read is reaped, and finish only once
+    memset(results, 0, sizeof(results));
+    w = v2p_async_init(&cfg, &mock, 4, async_done);
+    async_done_calls = 0;
+    v2p_async_submit(w, virt_addrs[0], &results[0]);
+    v2p_async_submit(w, virt_addrs[3], &results[3]);
+    async_mock.fail = 1;
+    uint32_t active = v2p_async_poll(w);
+    bool failed = async_done_calls == 2 && results[0].err == READ_FAULT && results[3].err == READ_FAULT;
+    int fits = 0;
+    while (fits < 4 && v2p_async_submit(w, virt_addrs[1 + fits], &results[1 + fits]) == SUCCESS) {
+        ++fits;
+    }
+    if (active != 0 || !failed || fits != 2 || async_mock.n != 2) {
+        printf("async: failed reap: got %u active, %d completions, %d free walks and %u reads kept, "
+               "want 0, 2, 2 and 2\n\n", active, async_done_calls, fits, async_mock.n);
+        ok = false;
+    }
+    v2p_async_drain(w);
+    v2p_async_free(w);
+    if (async_done_calls != 4 || async_mock.n != 0 || !results[1].done || !results[2].done) {
+        printf("async: failed reap: got %d completions and %u reads left, want 4 and 0\n\n",
+               async_done_calls, async_mock.n);
+        ok = false;
+    }
+
+    cfg.level = 1;
+    if (v2p_async_init(&cfg, &mock, 4, async_done) != NULL) {
+        printf("async: invalid translation type accepted\n\n");
+        ok = false;
+    }
+
+    // io_uring over a file of random tables, against the walks of the same bytes in memory
+    enum { PAGES = 16, M = 1000 };
+    static uint64_t image[PAGES * 512];
+    char path[] = "/tmp/v2p_uring_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("async: could not create %s\n\n", path);
+        return false;
+    }
+
+    async_result_t *uring_results = malloc(M * sizeof(async_result_t));
+    paging_mode_t levels[] = {LEGACY, PAE, IA32E, LA57};
+    uint64_t seed = 0x2545f4914f6cdd1dULL;
+    for (int l = 0; l < sizeof(levels) / sizeof(paging_mode_t); ++l) {
+        async_random_tables(image, PAGES * 512, &seed);
+        if (pwrite(fd, image, sizeof(image), 0) != sizeof(image)) {
+            printf("async: could not write %s\n\n", path);
+            ok = false;
+            break;
+        }
+
+        uring_file_t *u = v2p_uring_open(path, 64);
+        if (u == NULL) {
+            // io_uring disabled in this kernel or sandbox
+            break;
+        }
+
+        config_t uring_cfg = {.level=levels[l], .root_addr=0x3000, .pse=true, .pat=true, .maxphyaddr=52};
+        async_backend_t backend = v2p_uring_backend(u);
+        w = v2p_async_init(&uring_cfg, &backend, 256, async_done);
+
+        uint64_t *uring_addrs = malloc(M * sizeof(uint64_t));
+        for (int i = 0; i < M; ++i) {
+            uint64_t x = seed * (i + 1);
+            // Mostly canonical, occasionally not
+            uring_addrs[i] = i % 16 == 0 ? x : (uint64_t) ((int64_t) x >> 17U);
+            if (levels[l] == PAE && i % 4 != 0) {
+                // PDPTEs of the other gigabytes are past the end of the file
+                uring_addrs[i] &= 0x3fffffffU;
+            }
+            uring_results[i].done = false;
+        }
+        for (int i = 0; i < M; ++i) {
+            while (v2p_async_submit(w, uring_addrs[i], &uring_results[i]) != SUCCESS) {
+                v2p_async_poll(w);
+            }
+        }
+        v2p_async_drain(w);
+        v2p_async_free(w);
+        v2p_uring_close(u);
+
+        uring_cfg.mem_base = image;
+        uring_cfg.mem_size = sizeof(image);
+        translator_t *tr = v2p_translator_init(&uring_cfg);
+        for (int i = 0; i < M; ++i) {
+            uint64_t want_phys = 0;
+            uint32_t want_page_fault = 0;
+            error_t want_err = v2p_translate(tr, uring_addrs[i], &want_phys, &want_page_fault);
+            const async_result_t *r = &uring_results[i];
+            if (!r->done || r->err != want_err || r->phys_addr != want_phys
+                || (want_err == PAGE_FAULT && r->page_fault != want_page_fault)) {
+                printf("async: uring, mode %d: wrong result for %llx\ngot:  %d %llx %u\nwant: %d %llx %u\n\n",
+                       levels[l], uring_addrs[i], r->err, r->phys_addr, r->page_fault,
+                       want_err, want_phys, want_page_fault);
+                ok = false;
+                break;
+            }
+        }
+        v2p_translator_free(tr);
+        free(uring_addrs);
+    }
+
+    free(uring_results);
+    close(fd);
+    unlink(path);
+    return ok;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "v2p.h"
+#include "test_mem.h"
+
+bool
+test_batch() {
+    bool ok = true;
+
+    // PAE: pde 0 -> page table at 0x2000, pde 1 -> 2MB page, pde 2 not present,
+    // pte 3 has a reserved bit set
+    test_mem_reset();
+    test_mem_write(0x0, 0x1000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000, 0x2000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000 + 8, 0x40000000ULL | 1U | (1U << PS_PDE2MB), sizeof(uint64_t));
+    test_mem_write(0x2000 + 1 * 8, 0x5000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x2000 + 2 * 8, 0x6000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x2000 + 3 * 8, 0x7000 | 1U | (1ULL << 60U), sizeof(uint64_t));
+
+    config_t cfg = {.level=PAE, .root_addr=0, .read_func=test_mem_read_func, .pat=true, .maxphyaddr=52};
+
+    uint32_t virt_addrs[] = {0x2010, 0x200123, 0x1000, 0x400000, 0x3000, 0x2020, 0x3fffff, 0x1fff, 0x0};
+    enum { N = sizeof(virt_addrs) / sizeof(uint32_t) };
+    uint64_t phys[N];
+    error_t errors[N];
+    uint32_t page_faults[N];
+
+    test_mem_reads = 0;
+    error_t err = va2pa_batch(virt_addrs, N, &cfg, phys, errors, page_faults);
+    // pdpte, pde 0, pde 1, pde 2, ptes 0..3
+    if (err != SUCCESS || test_mem_reads != 8) {
+        printf("batch: got %d with %d reads, want 8 reads\n\n", err, test_mem_reads);
+        ok = false;
+    }
+
+    for (int i = 0; i < N; ++i) {
+        uint64_t want_phys = 0;
+        uint32_t want_page_fault = 0;
+        error_t want_err = va2pa(virt_addrs[i], &cfg, &want_phys, &want_page_fault);
+        if (errors[i] != want_err
+            || (want_err == SUCCESS && phys[i] != want_phys)
+            || (want_err == PAGE_FAULT && page_faults[i] != want_page_fault)) {
+            printf("batch: wrong result for %u\ngot:  %d %llu %u\nwant: %d %llu %u\n\n",
+                   virt_addrs[i], errors[i], phys[i], page_faults[i], want_err, want_phys, want_page_fault);
+            ok = false;
+        }
+    }
+
+    // One vectored read per level
+    uint64_t phys_v[N];
+    error_t errors_v[N];
+    uint32_t page_faults_v[N];
+    cfg.readv_func = test_mem_readv_func;
+    test_mem_reads = 0;
+    test_mem_readv_calls = 0;
+    va2pa_batch(virt_addrs, N, &cfg, phys_v, errors_v, page_faults_v);
+    if (test_mem_reads != 0 || test_mem_readv_calls != 3) {
+        printf("batch: readv: got %d reads and %d vectored reads, want 0 and 3\n\n",
+               test_mem_reads, test_mem_readv_calls);
+        ok = false;
+    }
+    for (int i = 0; i < N; ++i) {
+        if (errors_v[i] != errors[i] || phys_v[i] != phys[i] || page_faults_v[i] != page_faults[i]) {
+            printf("batch: readv: wrong result for %u\n\n", virt_addrs[i]);
+            ok = false;
+        }
+    }
+
+    // Entries are indexed straight from the mapped tables: one map per table
+    cfg.readv_func = NULL;
+    cfg.map_func = test_mem_map_func;
+    test_mem_reads = 0;
+    test_mem_maps = 0;
+    va2pa_batch(virt_addrs, N, &cfg, phys_v, errors_v, page_faults_v);
+    if (test_mem_reads != 0 || test_mem_maps != 3) {
+        printf("batch: map: got %d reads and %d maps, want 0 and 3\n\n", test_mem_reads, test_mem_maps);
+        ok = false;
+    }
+    for (int i = 0; i < N; ++i) {
+        if (errors_v[i] != errors[i] || phys_v[i] != phys[i] || page_faults_v[i] != page_faults[i]) {
+            printf("batch: map: wrong result for %u\n\n", virt_addrs[i]);
+            ok = false;
+        }
+    }
+
+    // The ctx variants are used instead and get config_t.ctx
+    int ctx_calls[2] = {0, 0};
+    cfg.map_func = NULL;
+    for (int v = 0; v < 2; ++v) {
+        cfg.readv_func = test_mem_readv_func;
+        cfg.readv_ctx_func = v == 0 ? test_mem_readv_ctx_func : NULL;
+        cfg.map_ctx_func = v == 1 ? test_mem_map_ctx_func : NULL;
+        cfg.ctx = &ctx_calls[v];
+        test_mem_readv_calls = 0;
+        test_mem_maps = 0;
+        va2pa_batch(virt_addrs, N, &cfg, phys_v, errors_v, page_faults_v);
+        if (ctx_calls[v] != 3 || test_mem_readv_calls != 3 - 3 * v || test_mem_maps != 3 * v) {
+            printf("batch: ctx %d: got %d ctx calls, %d vectored reads and %d maps\n\n",
+                   v, ctx_calls[v], test_mem_readv_calls, test_mem_maps);
+            ok = false;
+        }
+        for (int i = 0; i < N; ++i) {
+            if (errors_v[i] != errors[i] || phys_v[i] != phys[i] || page_faults_v[i] != page_faults[i]) {
+                printf("batch: ctx %d: wrong result for %u\n\n", v, virt_addrs[i]);
+                ok = false;
+            }
+        }
+    }
+    cfg.readv_func = NULL;
+    cfg.readv_ctx_func = NULL;
+    cfg.map_ctx_func = NULL;
+
+    // Interleaved walks, through read_func and through the mapped tables
+    size_t in_flights[] = {0, 1, 3, N, 1000};
+    for (int m = 0; m < 2; ++m) {
+        cfg.map_func = m == 0 ? NULL : test_mem_map_func;
+        for (int f = 0; f < sizeof(in_flights) / sizeof(size_t); ++f) {
+            err = va2pa_batch_interleaved(virt_addrs, N, &cfg, in_flights[f], phys_v, errors_v, page_faults_v);
+            if (err != SUCCESS) {
+                printf("batch: interleaved: got %d\n\n", err);
+                ok = false;
+            }
+            for (int i = 0; i < N; ++i) {
+                if (errors_v[i] != errors[i] || phys_v[i] != phys[i] || page_faults_v[i] != page_faults[i]) {
+                    printf("batch: interleaved %zu (map %d): wrong result for %u\n\n", in_flights[f], m, virt_addrs[i]);
+                    ok = false;
+                }
+            }
+        }
+    }
+
+    // Legacy: pde 0 -> page table at 0x3000, pde 1 -> 4MB page, pde 2 not present
+    test_mem_reset();
+    test_mem_write(0x1000, 0x3000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x1000 + 4, 0x800000 | 1U | (1U << PS_PDE4MB), sizeof(uint32_t));
+    test_mem_write(0x3000 + 1 * 4, 0x5000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x3000 + 2 * 4, 0x6000 | 1U, sizeof(uint32_t));
+    config_t legacy_cfg = {.level=LEGACY, .root_addr=0x1000, .read_func=test_mem_read_func, .pse=true};
+    uint32_t legacy_addrs[] = {0x1010, 0x400123, 0x2fff, 0x800000, 0x3000, 0x7fffff, 0x0};
+    enum { L = sizeof(legacy_addrs) / sizeof(uint32_t) };
+    va2pa_batch_interleaved(legacy_addrs, L, &legacy_cfg, 2, phys_v, errors_v, page_faults_v);
+    for (int i = 0; i < L; ++i) {
+        uint64_t want_phys = 0;
+        uint32_t want_page_fault = 0;
+        error_t want_err = va2pa(legacy_addrs[i], &legacy_cfg, &want_phys, &want_page_fault);
+        if (errors_v[i] != want_err || phys_v[i] != want_phys || page_faults_v[i] != want_page_fault) {
+            printf("batch: interleaved legacy: wrong result for %u\n\n", legacy_addrs[i]);
+            ok = false;
+        }
+    }
+
+    cfg.level = 1;
+    if (va2pa_batch_interleaved(virt_addrs, N, &cfg, 4, phys, errors, page_faults) != INVALID_TRANSLATION_TYPE) {
+        printf("batch: interleaved: invalid translation type accepted\n\n");
+        ok = false;
+    }
+    if (va2pa_batch(virt_addrs, N, &cfg, phys, errors, page_faults) != INVALID_TRANSLATION_TYPE) {
+        printf("batch: invalid translation type accepted\n\n");
+        ok = false;
+    }
+
+    return ok;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "v2p.h"
+
+bool
+test_dump() {
+    // PAE: pdpte 0 -> pd at 0x1000, pde 0 -> pt at 0x2000, pde 1 -> pt past the end of the dump
+    static uint64_t image[3 * 512];
+    image[0] = 0x1000 | 1U;
+    image[512] = 0x2000 | 1U;
+    image[512 + 1] = 0x100000 | 1U;
+    image[1024 + 7] = 0xabcde000ULL | 1U;
+
+    char path[] = "/tmp/v2p_dump_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, image, sizeof(image)) != sizeof(image)) {
+        printf("dump: could not create %s\n\n", path);
+        return false;
+    }
+    close(fd);
+
+    bool ok = true;
+    dump_t dump;
+    if (v2p_dump_open(path, DUMP_RANDOM, &dump) != SUCCESS || dump.size != sizeof(image)) {
+        printf("dump: could not open %s\n\n", path);
+        unlink(path);
+        return false;
+    }
+
+    // read_func must not be called
+    config_t cfg = {.level=PAE, .read_func=NULL, .pat=true, .maxphyaddr=52};
+    v2p_dump_attach(&dump, &cfg);
+
+    uint64_t phys = 0;
+    uint32_t page_fault = 0;
+    error_t err = va2pa(0x7123, &cfg, &phys, &page_fault);
+    if (err != SUCCESS || phys != 0xabcde123ULL) {
+        printf("dump: got %d %llu, want %d %llu\n\n", err, phys, SUCCESS, 0xabcde123ULL);
+        ok = false;
+    }
+    err = va2pa(0x200000, &cfg, &phys, &page_fault);
+    if (err != READ_FAULT) {
+        printf("dump: read past the end: got %d, want %d\n\n", err, READ_FAULT);
+        ok = false;
+    }
+
+    v2p_dump_close(&dump);
+    unlink(path);
+
+    if (v2p_dump_open(path, DUMP_SEQUENTIAL, &dump) != READ_FAULT) {
+        printf("dump: opened a missing file\n\n");
+        ok = false;
+    }
+
+    return ok;
+}
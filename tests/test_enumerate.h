@@ -0,0 +1,99 @@
+#pragma once
+
+#include "v2p.h"
+#include "test_mem.h"
+
+typedef struct {
+    mapping_t mappings[8];
+    int n;
+    int max;
+} test_mappings_t;
+
+bool
+collect_mapping(const mapping_t *mapping, void *arg) {
+    test_mappings_t *c = arg;
+    if (c->n < 8) {
+        c->mappings[c->n] = *mapping;
+    }
+    return ++c->n < c->max;
+}
+
+bool
+test_enumerate() {
+    bool ok = true;
+
+    // LEGACY: pde 0 -> page table at 0x1000, pde 1 -> 4MB page, pde 2 has a reserved bit set,
+    // pde 1023 -> page table at 0x401000
+    test_mem_reset();
+    test_mem_write(0x0, 0x1000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x4, 0x800000 | 1U | (1U << PS_PDE4MB), sizeof(uint32_t));
+    test_mem_write(0x8, 0x400000 | 1U | (1U << 13U), sizeof(uint32_t));
+    test_mem_write(0xffc, 0x401000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x1000 + 3 * 4, 0x7000 | 0x63U, sizeof(uint32_t));
+    test_mem_write(0x1000 + 9 * 4, 0x8000 | 1U | (1U << PAT_PTE), sizeof(uint32_t));
+    test_mem_write(0x401000 + 1023 * 4, 0x9000 | 0x7U, sizeof(uint32_t));
+
+    config_t cfg = {.level=LEGACY, .root_addr=0, .read_func=test_mem_read_func, .pse=true, .pat=true, .maxphyaddr=52};
+
+    mapping_t want[] = {
+            {0x3000,     0x7000,   PAGE_4KB, 0x63},
+            {0x9000,     0x8000,   PAGE_4KB, 0x81},
+            {0x400000,   0x800000, PAGE_4MB, 0x81},
+            {0xfffff000, 0x9000,   PAGE_4KB, 0x7},
+    };
+    int n = sizeof(want) / sizeof(mapping_t);
+
+    test_mappings_t got = {.max=8};
+    test_mem_reads = 0;
+    error_t err = v2p_enumerate(&cfg, collect_mapping, &got);
+    // page directory and two page tables
+    if (err != SUCCESS || got.n != n || test_mem_reads != 3) {
+        printf("enumerate: got %d, %d mappings with %d reads\nwant: %d, %d mappings with 3 reads\n\n",
+               err, got.n, test_mem_reads, SUCCESS, n);
+        ok = false;
+    }
+    for (int i = 0; i < n && i < got.n; ++i) {
+        mapping_t *m = &got.mappings[i];
+        if (m->virt_addr != want[i].virt_addr || m->phys_addr != want[i].phys_addr
+            || m->page_size != want[i].page_size || m->flags != want[i].flags) {
+            printf("enumerate: wrong mapping %d\ngot:  %llu -> %llu (%d, %llu)\nwant: %llu -> %llu (%d, %llu)\n\n",
+                   i, m->virt_addr, m->phys_addr, m->page_size, m->flags,
+                   want[i].virt_addr, want[i].phys_addr, want[i].page_size, want[i].flags);
+            ok = false;
+        }
+    }
+
+    // Both page tables are fetched with one vectored read
+    cfg.readv_func = test_mem_readv_func;
+    got = (test_mappings_t) {.max=8};
+    test_mem_reads = 0;
+    test_mem_readv_calls = 0;
+    v2p_enumerate(&cfg, collect_mapping, &got);
+    if (got.n != n || test_mem_reads != 1 || test_mem_readv_calls != 1) {
+        printf("enumerate: readv: got %d mappings with %d reads and %d vectored reads\n\n",
+               got.n, test_mem_reads, test_mem_readv_calls);
+        ok = false;
+    }
+
+    // Page tables are used in place
+    cfg.readv_func = NULL;
+    cfg.read_func = NULL;
+    cfg.map_func = test_mem_map_func;
+    got = (test_mappings_t) {.max=8};
+    test_mem_maps = 0;
+    err = v2p_enumerate(&cfg, collect_mapping, &got);
+    if (err != SUCCESS || got.n != n || test_mem_maps != 3) {
+        printf("enumerate: map: got %d, %d mappings with %d maps\n\n", err, got.n, test_mem_maps);
+        ok = false;
+    }
+
+    // The visitor can stop the enumeration
+    got = (test_mappings_t) {.max=2};
+    v2p_enumerate(&cfg, collect_mapping, &got);
+    if (got.n != 2) {
+        printf("enumerate: visitor was called %d times after stopping\n\n", got.n);
+        ok = false;
+    }
+
+    return ok;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+#include "test_scan.h"
+
+bool
+test_flat() {
+    bool ok = true;
+
+    enum { MEM_SIZE = 1 << 20 };
+    scan_mem_t m = {.mem=malloc(MEM_SIZE), .size=MEM_SIZE, .root_addr=0x1000};
+
+    paging_mode_t levels[] = {LEGACY, PAE};
+    for (int l = 0; l < sizeof(levels) / sizeof(paging_mode_t); ++l) {
+        m.level = levels[l];
+        config_t cfg = {
+                .level=m.level,
+                .root_addr=m.root_addr,
+                .pse=m.level != LEGACY,
+                .pat=true,
+                .maxphyaddr=36,
+                .mem_base=m.mem,
+                .mem_size=MEM_SIZE,
+        };
+
+        // Runs of 4KB pages in two page tables, a large page and a reserved bit;
+        // the PDPTEs of the other PAE gigabytes are past the end of memory
+        memset(m.mem, 0, MEM_SIZE);
+        m.next = 0x2000;
+        for (int i = 0; i < 300; ++i) {
+            scan_mem_map(&m, 0x10000000 + i * 0x3000, 0x40000000 + i * 0x1000, PAGE_4KB);
+            scan_mem_map(&m, 0x20001000 + i * 0x1000, 0x80000000 + i * 0x5000, PAGE_4KB);
+        }
+        if (m.level == PAE) {
+            scan_mem_map(&m, 0x10400000, 0x60000000, PAGE_2MB);
+            scan_mem_map(&m, 0x10600000, 0x7000, PAGE_4KB);
+            uint64_t pdpte = 0x1000 | 1U;
+            memcpy(m.mem, &pdpte, sizeof(pdpte));
+            uint64_t reserved = 0x40000000 | 3U | (1ULL << 40U);
+            memcpy(m.mem + 0x1000 + (0x10600000 >> 21U) * 8, &reserved, sizeof(reserved));
+        }
+
+        // Every page translates like va2pa, with and without huge pages
+        for (int huge = 0; huge < 2; ++huge) {
+            flat_table_t flat;
+            error_t err = v2p_flat_build(&cfg, huge, &flat);
+            if (err != SUCCESS) {
+                printf("flat: mode %d: build got %d, want %d\n\n", m.level, err, SUCCESS);
+                ok = false;
+                continue;
+            }
+            int wrong = 0;
+            for (uint64_t page = 0; page < V2P_FLAT_PAGES; ++page) {
+                uint32_t virt_addr = (page << 12U) | ((page * 37) & 0xfffU);
+                uint64_t phys = 0;
+                uint32_t page_fault = 0;
+                err = v2p_flat_translate(&flat, virt_addr, &phys, &page_fault);
+                uint64_t want_phys = 0;
+                uint32_t want_page_fault = 0;
+                error_t want_err = va2pa(virt_addr, &cfg, &want_phys, &want_page_fault);
+                if (err != want_err || (err == SUCCESS && phys != want_phys)
+                    || (err == PAGE_FAULT && page_fault != want_page_fault)) {
+                    if (wrong++ == 0) {
+                        printf("flat: mode %d: %x: got %d %llx %u, want %d %llx %u\n\n",
+                               m.level, virt_addr, err, phys, page_fault, want_err, want_phys, want_page_fault);
+                    }
+                }
+            }
+            ok &= wrong == 0;
+            v2p_flat_free(&flat);
+        }
+    }
+
+    config_t cfg = {.level=IA32E};
+    flat_table_t flat;
+    if (v2p_flat_build(&cfg, false, &flat) != INVALID_TRANSLATION_TYPE || flat.entries != NULL) {
+        printf("flat: IA32E accepted\n\n");
+        ok = false;
+    }
+
+    free(m.mem);
+    return ok;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "v2p.h"
+#include "test_mem.h"
+
+bool
+test_ia32e() {
+    // pml4e 0 -> pdpt at 0x1000, pml4e 256 -> pdpt at 0x2000, pml4e 1 has PS set
+    // pdpte 0 -> pd at 0x3000, pdpte 1 -> 1GB page at 0x1c0000000, pdpte 2 has bit 40 set
+    // pde 0 -> pt at 0x4000, pde 1 -> 2MB page at 0x200000000, pde 2 has XD set
+    // pte 5 -> 0x123456000, pte 6 has the PAT bit set
+    test_mem_reset();
+    test_mem_write(0x0, 0x1000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x8, 0x5000 | 1U | (1U << 7U), sizeof(uint64_t));
+    test_mem_write(256 * 8, 0x2000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000, 0x3000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000 + 8, 0x1c0000000ULL | 1U | (1U << 7U), sizeof(uint64_t));
+    test_mem_write(0x1000 + 16, 0x3000 | 1U | (1ULL << 40U), sizeof(uint64_t));
+    test_mem_write(0x2000, 0x3000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x3000, 0x4000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x3000 + 8, 0x200000000ULL | 1U | (1U << 7U), sizeof(uint64_t));
+    test_mem_write(0x3000 + 16, 0x4000 | 1U | (1ULL << 63U), sizeof(uint64_t));
+    test_mem_write(0x4000 + 5 * 8, 0x123456000ULL | 1U, sizeof(uint64_t));
+    test_mem_write(0x4000 + 6 * 8, 0x7000 | 1U | (1U << 7U), sizeof(uint64_t));
+
+    typedef struct {
+        const char *name;
+        uint64_t virt_addr;
+        bool nxe;
+        bool pat;
+        uint8_t maxphyaddr;
+        uint64_t want_phys;
+        error_t want_err;
+        page_fault_t want_page_fault;
+    } test_case;
+
+    test_case t[] = {
+            {"4kb",                    0x5abc,                false, true,  52, 0x123456abcULL, SUCCESS},
+            {"2mb",                    0x3fffff,              false, true,  52, 0x2001fffffULL, SUCCESS},
+            {"1gb",                    0x7fffffff,            false, true,  52, 0x1ffffffffULL, SUCCESS},
+            {"upper half",             0xffff800000005001ULL, false, true,  52, 0x123456001ULL, SUCCESS},
+            {"non-canonical",          0x0000800000000000ULL, false, true,  52, 0, NON_CANONICAL_ADDRESS},
+            {"pte not present",        0x4000,                false, true,  52, 0, PAGE_FAULT, NOT_PRESENT},
+            {"pml4e ps reserved",      0x8000000000ULL,       false, true,  52, 0, PAGE_FAULT, RESERVED_BIT_VIOLATION},
+            {"pdpte above maxphyaddr", 0x80000000,            false, true,  40, 0, PAGE_FAULT, RESERVED_BIT_VIOLATION},
+            {"pdpte below maxphyaddr", 0x80000000,            false, true,  41, 0, PAGE_FAULT, NOT_PRESENT},
+            {"1gb above maxphyaddr",   0x40000000,            false, true,  32, 0, PAGE_FAULT, RESERVED_BIT_VIOLATION},
+            {"xd without nxe",         0x400000,              false, true,  52, 0, PAGE_FAULT, RESERVED_BIT_VIOLATION},
+            {"xd with nxe",            0x406000,              true,  true,  52, 0x7000,         SUCCESS},
+            {"pat not supported",      0x6000,                false, false, 52, 0, PAGE_FAULT, RESERVED_BIT_VIOLATION},
+    };
+    int n = sizeof(t) / sizeof(test_case);
+
+    bool ok = true;
+    for (int i = 0; i < n; ++i) {
+        config_t cfg = {
+                .level=IA32E,
+                .root_addr=0,
+                .read_func=test_mem_read_func,
+                .nxe=t[i].nxe,
+                .pat=t[i].pat,
+                .maxphyaddr=t[i].maxphyaddr,
+        };
+
+        uint64_t phys = 0;
+        uint32_t page_fault = 0;
+        error_t err = va2pa64(t[i].virt_addr, &cfg, &phys, &page_fault);
+        if (err != t[i].want_err
+            || phys != t[i].want_phys
+            || (err == PAGE_FAULT && page_fault != t[i].want_page_fault)) {
+            printf("wrong result for ia32e test '%s'\ngot:  %d %llu %u\nwant: %d %llu %u\n\n",
+                   t[i].name, err, phys, page_fault, t[i].want_err, t[i].want_phys, t[i].want_page_fault);
+            ok = false;
+        }
+    }
+
+    // A walk resumed from the PDE only reads the PTE
+    config_t cfg = {.level=IA32E, .read_func=test_mem_read_func, .pat=true, .maxphyaddr=52};
+    uint64_t phys = 0;
+    uint32_t page_fault = 0;
+    test_mem_reads = 0;
+    error_t err = va2pa64_resume(0x5123, LEVEL_PDE, 0x4000 | 1U, &cfg, &phys, &page_fault);
+    if (err != SUCCESS || phys != 0x123456123ULL || test_mem_reads != 1) {
+        printf("ia32e: resume: got %d %llu with %d reads\n\n", err, phys, test_mem_reads);
+        ok = false;
+    }
+
+    // LA57: pml5e 0 and 256 -> the pml4 at 0x0
+    test_mem_write(0x6000, 0x0 | 1U, sizeof(uint64_t));
+    test_mem_write(0x6000 + 256 * 8, 0x0 | 1U, sizeof(uint64_t));
+    cfg.level = LA57;
+    cfg.root_addr = 0x6000;
+
+    typedef struct {
+        uint64_t virt_addr;
+        uint64_t want_phys;
+        error_t want_err;
+    } la57_case;
+
+    la57_case t57[] = {
+            {0x5abc,                0x123456abcULL, SUCCESS},
+            {0x0000800000005abcULL, 0x123456abcULL, SUCCESS},
+            {0xff00000000005abcULL, 0x123456abcULL, SUCCESS},
+            {0x0100000000000000ULL, 0,              NON_CANONICAL_ADDRESS},
+            {0x0001000000000000ULL, 0,              PAGE_FAULT},
+    };
+    n = sizeof(t57) / sizeof(la57_case);
+
+    for (int i = 0; i < n; ++i) {
+        phys = 0;
+        err = va2pa64(t57[i].virt_addr, &cfg, &phys, &page_fault);
+        if (err != t57[i].want_err || phys != t57[i].want_phys) {
+            printf("wrong result for la57 %llu\ngot:  %d %llu\nwant: %d %llu\n\n",
+                   t57[i].virt_addr, err, phys, t57[i].want_err, t57[i].want_phys);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string.h>
+
+#include "v2p.h"
+
+// Sparse physical memory for tests that need real page tables:
+// pages are allocated on first write, everything else reads as zero
+#define TEST_MEM_PAGES 64
+
+static struct {
+    uint64_t pfn;
+    bool used;
+    uint8_t data[4096];
+} test_mem[TEST_MEM_PAGES];
+
+// number of test_mem_read_func calls since the last test_mem_reset
+static int test_mem_reads = 0;
+
+// number of test_mem_readv_func calls since the last test_mem_reset
+static int test_mem_readv_calls = 0;
+
+// number of test_mem_map_func calls since the last test_mem_reset
+static int test_mem_maps = 0;
+
+void
+test_mem_reset() {
+    memset(test_mem, 0, sizeof(test_mem));
+    test_mem_reads = 0;
+    test_mem_readv_calls = 0;
+    test_mem_maps = 0;
+}
+
+uint8_t *
+test_mem_page(const uint64_t physical_addr, const bool alloc) {
+    uint64_t pfn = physical_addr >> 12U;
+    for (int i = 0; i < TEST_MEM_PAGES; ++i) {
+        if (test_mem[i].used && test_mem[i].pfn == pfn) {
+            return test_mem[i].data;
+        }
+    }
+    if (!alloc) {
+        return NULL;
+    }
+    for (int i = 0; i < TEST_MEM_PAGES; ++i) {
+        if (!test_mem[i].used) {
+            test_mem[i].used = true;
+            test_mem[i].pfn = pfn;
+            return test_mem[i].data;
+        }
+    }
+    return NULL;
+}
+
+void
+test_mem_write(const uint64_t physical_addr, const uint64_t val, const uint32_t size) {
+    uint8_t *page = test_mem_page(physical_addr, true);
+    memcpy(page + (physical_addr & 0xfffU), &val, size);
+}
+
+int32_t
+test_mem_read_func(void *buf, const uint32_t size, const uint64_t physical_addr) {
+    ++test_mem_reads;
+    if ((physical_addr & 0xfffU) + size > 4096) {
+        return 0;
+    }
+    uint8_t *page = test_mem_page(physical_addr, false);
+    if (page == NULL) {
+        memset(buf, 0, size);
+    } else {
+        memcpy(buf, page + (physical_addr & 0xfffU), size);
+    }
+    return size;
+}
+
+void
+test_mem_readv_func(const read_req_t *reqs, const uint32_t n, int32_t *results) {
+    ++test_mem_readv_calls;
+    for (uint32_t i = 0; i < n; ++i) {
+        results[i] = test_mem_read_func(reqs[i].buf, reqs[i].size, reqs[i].physical_addr);
+    }
+    test_mem_reads -= n;
+}
+
+const void *
+test_mem_map_func(const uint64_t physical_addr, uint64_t *len) {
+    ++test_mem_maps;
+    uint8_t *page = test_mem_page(physical_addr, false);
+    if (page == NULL) {
+        return NULL;
+    }
+    *len = 4096 - (physical_addr & 0xfffU);
+    return page + (physical_addr & 0xfffU);
+}
+
+// test_mem_readv_func counting its calls in the int at ctx
+void
+test_mem_readv_ctx_func(void *ctx, const read_req_t *reqs, const uint32_t n, int32_t *results) {
+    ++*(int *) ctx;
+    test_mem_readv_func(reqs, n, results);
+}
+
+// test_mem_map_func counting its calls in the int at ctx
+const void *
+test_mem_map_ctx_func(void *ctx, const uint64_t physical_addr, uint64_t *len) {
+    ++*(int *) ctx;
+    return test_mem_map_func(physical_addr, len);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+#include "test_mem.h"
+
+bool
+test_profile() {
+    bool ok = true;
+    v2p_profile_t *profile = calloc(1, sizeof(v2p_profile_t));
+
+    // Percentiles of known cycles are within the width of their bucket
+    for (uint64_t cycles = 1; cycles <= 1000; ++cycles) {
+        v2p_profile_record(profile, LEVEL_PDE, cycles);
+    }
+    v2p_profile_record(profile, 7, 1);
+    double percentiles[] = {0, 1, 50, 90, 99, 99.9, 100};
+    for (int i = 0; i < sizeof(percentiles) / sizeof(double); ++i) {
+        uint64_t want = percentiles[i] < 0.1 ? 1 : (uint64_t) (percentiles[i] * 10);
+        uint64_t got = v2p_profile_percentile(profile, LEVEL_PDE, percentiles[i]);
+        if (got < want || got > want + want / 8) {
+            printf("profile: p%g of 1..1000 cycles: got %llu, want %llu (+12.5%%)\n\n",
+                   percentiles[i], got, want);
+            ok = false;
+        }
+    }
+    if (profile->samples[LEVEL_PDE] != 1000 || v2p_profile_percentile(profile, LEVEL_PTE, 50) != 0
+        || v2p_profile_percentile(profile, 0, 50) != 0) {
+        printf("profile: wrong samples of recorded, empty or invalid levels\n\n");
+        ok = false;
+    }
+    v2p_profile_record(profile, LEVEL_PTE, UINT64_MAX);
+    if (v2p_profile_percentile(profile, LEVEL_PTE, 100) != UINT64_MAX) {
+        printf("profile: largest cycles not in the last bucket\n\n");
+        ok = false;
+    }
+
+    // Single walks time one read per level they reach (the IA-32e walk ends at a not-present PDE)
+    test_mem_reset();
+    test_mem_write(0x0, 0x1000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000, 0x2000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000 + 8, 0x40000000ULL | 1U | (1U << PS_PDE2MB), sizeof(uint64_t));
+    test_mem_write(0x2000 + 1 * 8, 0x5000 | 1U, sizeof(uint64_t));
+
+    v2p_profile_reset(profile);
+    config_t cfg = {.level=PAE, .read_func=test_mem_read_func, .pat=true, .maxphyaddr=52, .profile=profile};
+    uint64_t phys = 0;
+    uint32_t page_fault = 0;
+    va2pa(0x1abc, &cfg, &phys, &page_fault);
+    va2pa(0x200000, &cfg, &phys, &page_fault);
+    cfg.level = IA32E;
+    va2pa64(0x1abc, &cfg, &phys, &page_fault);
+    uint64_t want[LEVEL_PML5E + 1] = {[LEVEL_PTE]=1, [LEVEL_PDE]=3, [LEVEL_PDPTE]=3, [LEVEL_PML4E]=1};
+    if (memcmp(profile->samples, want, sizeof(want)) != 0) {
+        printf("profile: got %llu %llu %llu %llu samples from PTE up, want 1 3 3 1\n\n",
+               profile->samples[LEVEL_PTE], profile->samples[LEVEL_PDE],
+               profile->samples[LEVEL_PDPTE], profile->samples[LEVEL_PML4E]);
+        ok = false;
+    }
+
+    // One in sample_every reads is timed
+    v2p_profile_reset(profile);
+    profile->sample_every = 4;
+    cfg.level = PAE;
+    for (int i = 0; i < 8; ++i) {
+        va2pa(0x1abc, &cfg, &phys, &page_fault);
+    }
+    uint64_t samples = profile->samples[LEVEL_PTE] + profile->samples[LEVEL_PDE] + profile->samples[LEVEL_PDPTE];
+    if (samples != 6) {
+        printf("profile: got %llu samples of 24 reads with sample_every 4, want 6\n\n", samples);
+        ok = false;
+    }
+
+    FILE *out = tmpfile();
+    if (out != NULL) {
+        v2p_profile_dump(profile, out);
+        long len = ftell(out);
+        fclose(out);
+        if (len <= 0) {
+            printf("profile: empty dump\n\n");
+            ok = false;
+        }
+    }
+
+    free(profile);
+    return ok;
+}
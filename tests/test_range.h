@@ -0,0 +1,122 @@
+#pragma once
+
+#include "v2p.h"
+#include "test_mem.h"
+
+bool
+test_range() {
+    bool ok = true;
+
+    // LEGACY: pde 0 -> page table at 0x1000, pde 1 -> 4MB page at 0x800000,
+    // pde 2 -> page table at 0x401000 following the 4MB page, pde 1023 -> 4MB page at 0x1000000
+    test_mem_reset();
+    test_mem_write(0x0, 0x1000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x4, 0x800000 | 1U | (1U << PS_PDE4MB), sizeof(uint32_t));
+    test_mem_write(0x8, 0x401000 | 1U, sizeof(uint32_t));
+    test_mem_write(0xffc, 0x1000000 | 1U | (1U << PS_PDE4MB), sizeof(uint32_t));
+    test_mem_write(0x1000 + 1020 * 4, 0x10000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x1000 + 1021 * 4, 0x11000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x1000 + 1022 * 4, 0x30000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x1000 + 1023 * 4, 0x7ff000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x401000, 0xc00000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x401000 + 4, 0xc01000 | 1U, sizeof(uint32_t));
+
+    config_t cfg = {.level=LEGACY, .root_addr=0, .read_func=test_mem_read_func, .pse=true, .pat=true, .maxphyaddr=52};
+
+    typedef struct {
+        const char *name;
+        uint32_t virt_addr;
+        uint64_t len;
+        size_t max_extents;
+        error_t want_err;
+        uint64_t want_done;
+        extent_t want[3];
+        size_t want_n;
+    } test_case;
+
+    test_case t[] = {
+            {
+                    "merged across 4kb, 4mb and 4kb pages",
+                    0x3fc010,
+                    0x3ff0 + 0x400000 + 0x1fe0,
+                    3,
+                    SUCCESS,
+                    0x3ff0 + 0x400000 + 0x1fe0,
+                    {{0x10010, 0x1ff0}, {0x30000, 0x1000}, {0x7ff000, 0x1000 + 0x400000 + 0x1fe0}},
+                    3,
+            },
+            {
+                    "fault offset",
+                    0x3ff800,
+                    0x400000 + 0x3000,
+                    3,
+                    PAGE_FAULT,
+                    0x800 + 0x400000 + 0x2000,
+                    {{0x7ff800, 0x800 + 0x400000 + 0x2000}},
+                    1,
+            },
+            {
+                    "length past the end of the address space",
+                    0x3ff800,
+                    UINT64_MAX,
+                    3,
+                    PAGE_FAULT,
+                    0x800 + 0x400000 + 0x2000,
+                    {{0x7ff800, 0x800 + 0x400000 + 0x2000}},
+                    1,
+            },
+            {
+                    "truncated at the end of the address space",
+                    0xfffff800,
+                    UINT64_MAX - 0x100,
+                    3,
+                    SUCCESS,
+                    0x800,
+                    {{0x13ff800, 0x800}},
+                    1,
+            },
+            {
+                    "out of extents",
+                    0x3fc000,
+                    0x3000,
+                    1,
+                    INSUFFICIENT_BUFFER,
+                    0x2000,
+                    {{0x10000, 0x2000}},
+                    1,
+            },
+    };
+    int n = sizeof(t) / sizeof(test_case);
+
+    for (int i = 0; i < n; ++i) {
+        extent_t extents[3] = {0};
+        size_t n_extents = 0;
+        uint64_t done = 0;
+        uint32_t page_fault = 0;
+        error_t err = va2pa_range(t[i].virt_addr, t[i].len, &cfg, extents, t[i].max_extents,
+                                  &n_extents, &done, &page_fault);
+        bool same = err == t[i].want_err && done == t[i].want_done && n_extents == t[i].want_n;
+        for (size_t j = 0; same && j < n_extents; ++j) {
+            same = extents[j].phys_addr == t[i].want[j].phys_addr && extents[j].len == t[i].want[j].len;
+        }
+        if (!same) {
+            printf("wrong result for range test '%s'\ngot:  %d, done %llu, %zu extents\nwant: %d, done %llu, %zu extents\n\n",
+                   t[i].name, err, done, n_extents, t[i].want_err, t[i].want_done, t[i].want_n);
+            ok = false;
+        }
+    }
+
+    // One read per table span: pdes 0..2, ptes 1020..1023, ptes 0..1
+    extent_t extents[3];
+    size_t n_extents;
+    uint64_t done;
+    uint32_t page_fault;
+    test_mem_reads = 0;
+    va2pa_range(0x3fc000, 0x400000 + 0x6000, &cfg, extents, 3, &n_extents, &done, &page_fault);
+    if (test_mem_reads != 3) {
+        printf("range: got %d reads, want 3\n\n", test_mem_reads);
+        ok = false;
+    }
+
+    return ok;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+#include "test_scan.h"
+
+// Aliased pages below base (8 frames shared by 200 pages, large pages over the same
+// frames), then pages of one of two layouts inside the window at changed
+static void
+rmap_fill(scan_mem_t *const m, const uint64_t base, const uint64_t changed, const int layout) {
+    memset(m->mem, 0, m->size);
+    m->next = 0x2000;
+    for (int i = 0; i < 200; ++i) {
+        uint64_t virt_addr = base + (i % 20) * 0x1000 + (i / 20) * 0x400000;
+        scan_mem_map(m, virt_addr, 0x40000000 + (i % 8) * 0x1000, PAGE_4KB);
+    }
+    if (m->level != LEGACY) {
+        scan_mem_map(m, base + 0x8000000, 0x40000000, PAGE_2MB);
+        scan_mem_map(m, base + 0x8200000, 0x40000000, PAGE_2MB);
+    }
+    if (m->level == IA32E || m->level == LA57) {
+        scan_mem_map(m, base + 0x40000000, 0x40000000, PAGE_1GB);
+    }
+
+    for (int i = 0; i < (layout == 0 ? 40 : 25); ++i) {
+        uint64_t phys_addr = layout == 0 ? 0x40000000 + (i % 8) * 0x1000 : 0x50000000 + i * 0x1000;
+        scan_mem_map(m, changed + i * 0x3000 + layout * 0x1000, phys_addr, PAGE_4KB);
+    }
+    if (layout == 1 && m->level != LEGACY) {
+        scan_mem_map(m, changed + 0x200000, 0x40000000, PAGE_2MB);
+    }
+
+    uint64_t pdpte = 0x1000 | 1U;
+    memcpy(m->mem, &pdpte, sizeof(pdpte));
+}
+
+bool
+test_rmap() {
+    bool ok = true;
+
+    enum { MEM_SIZE = 1 << 20, MAX_MAPPINGS = 512, MAX_RANGES = 64 };
+    scan_mem_t m = {.mem=malloc(MEM_SIZE), .size=MEM_SIZE, .root_addr=0x1000};
+    scan_collected_t mappings = {.mappings=malloc(MAX_MAPPINGS * sizeof(mapping_t)), .max=MAX_MAPPINGS};
+    rmap_range_t got[MAX_RANGES];
+    rmap_range_t want[MAX_RANGES];
+
+    paging_mode_t levels[] = {LEGACY, PAE, IA32E, LA57};
+    for (int l = 0; l < sizeof(levels) / sizeof(paging_mode_t); ++l) {
+        m.level = levels[l];
+        bool wide = m.level == IA32E || m.level == LA57;
+        uint64_t base = wide ? 0xffff800000000000ULL : 0x10000000;
+        uint64_t changed = wide ? 0x00007f0000000000ULL : 0x30000000;
+        config_t cfg = {
+                .level=m.level,
+                .root_addr=m.root_addr,
+                .pse=m.level != LEGACY,
+                .pat=true,
+                .maxphyaddr=40,
+                .mem_base=m.mem,
+                .mem_size=MEM_SIZE,
+        };
+
+        // The PDPTEs of the other PAE gigabytes are past the end of memory
+        error_t want_err = m.level == PAE ? READ_FAULT : SUCCESS;
+
+        rmap_fill(&m, base, changed, 0);
+        rmap_t *rmap = NULL;
+        error_t err = v2p_rmap_build(&cfg, &rmap);
+        mappings.n = 0;
+        v2p_enumerate_parallel(&cfg, 1, scan_collect, &mappings);
+        if (err != want_err || rmap == NULL || v2p_rmap_size(rmap) != mappings.n) {
+            printf("rmap: mode %d: got %d with %zu pages, want %d with %d\n\n",
+                   m.level, err, rmap == NULL ? 0 : v2p_rmap_size(rmap), want_err, mappings.n);
+            v2p_rmap_free(rmap);
+            ok = false;
+            continue;
+        }
+
+        // Every page containing the address is found, the mapping of each is a translation
+        for (int i = 0; i < mappings.n; ++i) {
+            uint64_t phys_addr = mappings.mappings[i].phys_addr + 0x123;
+            uint32_t n = 0;
+            err = v2p_rmap_lookup(rmap, phys_addr, got, MAX_RANGES, &n);
+
+            uint32_t n_want = 0;
+            for (int j = 0; j < mappings.n; ++j) {
+                const mapping_t *mapping = &mappings.mappings[j];
+                n_want += phys_addr >= mapping->phys_addr
+                          && phys_addr - mapping->phys_addr < (1ULL << mapping->page_size);
+            }
+            if (err != SUCCESS || n != n_want) {
+                printf("rmap: mode %d: lookup of %llx: got %d with %u ranges, want %d with %u\n\n",
+                       m.level, phys_addr, err, n, SUCCESS, n_want);
+                ok = false;
+                break;
+            }
+            for (uint32_t k = 0; k < n; ++k) {
+                uint64_t phys = 0;
+                uint32_t page_fault = 0;
+                err = va2pa64(got[k].virt_addr + (phys_addr - got[k].phys_addr), &cfg, &phys, &page_fault);
+                if (err != SUCCESS || phys != phys_addr || got[k].phys_addr > phys_addr
+                    || phys_addr - got[k].phys_addr >= got[k].len) {
+                    printf("rmap: mode %d: range %llx -> %llx (%llx) does not map %llx\n\n",
+                           m.level, got[k].virt_addr, got[k].phys_addr, got[k].len, phys_addr);
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        uint32_t n = 0;
+        if (v2p_rmap_lookup(rmap, 0x40000000, got, 2, &n) != INSUFFICIENT_BUFFER || n != 2
+            || v2p_rmap_lookup(rmap, 0x7000000, got, MAX_RANGES, &n) != SUCCESS || n != 0) {
+            printf("rmap: mode %d: wrong lookup of a shared or an unmapped frame\n\n", m.level);
+            ok = false;
+        }
+
+        // Only the changed window is walked again, the result matches a map built from scratch
+        rmap_fill(&m, base, changed, 1);
+        err = v2p_rmap_rebuild(rmap, &cfg, changed, 0x400000);
+        rmap_t *fresh = NULL;
+        error_t fresh_err = v2p_rmap_build(&cfg, &fresh);
+        if (err != SUCCESS || fresh_err != want_err || v2p_rmap_size(rmap) != v2p_rmap_size(fresh)) {
+            printf("rmap: mode %d: rebuild got %d/%d with %zu pages, want %d/%d with %zu\n\n",
+                   m.level, err, fresh_err, v2p_rmap_size(rmap),
+                   SUCCESS, want_err, fresh == NULL ? 0 : v2p_rmap_size(fresh));
+            ok = false;
+        } else {
+            uint64_t frames[] = {0x40000000, 0x40001000, 0x40007000, 0x40100000, 0x50000000, 0x50018000};
+            for (int i = 0; i < sizeof(frames) / sizeof(uint64_t); ++i) {
+                uint32_t n_got = 0;
+                uint32_t n_want = 0;
+                v2p_rmap_lookup(rmap, frames[i], got, MAX_RANGES, &n_got);
+                v2p_rmap_lookup(fresh, frames[i], want, MAX_RANGES, &n_want);
+                if (n_got != n_want || memcmp(got, want, n_got * sizeof(rmap_range_t)) != 0) {
+                    printf("rmap: mode %d: rebuilt lookup of %llx: got %u ranges, want %u\n\n",
+                           m.level, frames[i], n_got, n_want);
+                    ok = false;
+                }
+            }
+        }
+        v2p_rmap_free(fresh);
+        v2p_rmap_free(rmap);
+    }
+
+    config_t cfg = {.level=1};
+    rmap_t *rmap = NULL;
+    if (v2p_rmap_build(&cfg, &rmap) != INVALID_TRANSLATION_TYPE || rmap != NULL) {
+        printf("rmap: invalid translation type accepted\n\n");
+        ok = false;
+    }
+
+    free(mappings.mappings);
+    free(m.mem);
+    return ok;
+}
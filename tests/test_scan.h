@@ -0,0 +1,196 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+
+// Page tables generated in a flat buffer, read through mem_base
+typedef struct scan_mem {
+    uint8_t *mem;
+    uint64_t size;
+    uint64_t next;
+    uint64_t root_addr;
+    paging_mode_t level;
+} scan_mem_t;
+
+static uint64_t
+scan_mem_entry(const scan_mem_t *const m, const uint64_t addr, const uint32_t entry_size) {
+    uint64_t entry = 0;
+    memcpy(&entry, m->mem + addr, entry_size);
+    return entry;
+}
+
+// Maps one page, returns false if the page would overlap an existing mapping
+static bool
+scan_mem_map(scan_mem_t *const m, const uint64_t virt_addr, const uint64_t phys_addr, const page_size_t page_size) {
+    uint32_t entry_size = m->level == LEGACY ? 4 : 8;
+    uint32_t index_bits = m->level == LEGACY ? 10 : 9;
+    uint8_t top = m->level == LEGACY ? 22 : m->level == PAE ? 21 : m->level == IA32E ? 39 : 48;
+
+    // The PDPTE of the first gigabyte of PAE is read at physical address 0
+    uint64_t table = m->level == PAE ? 0x1000 : m->root_addr;
+    for (uint8_t shift = top; shift > page_size; shift -= index_bits) {
+        uint64_t addr = table + ((virt_addr >> shift) & ((1U << index_bits) - 1)) * entry_size;
+        uint64_t entry = scan_mem_entry(m, addr, entry_size);
+        if (entry & 1U) {
+            if (entry & (1U << 7U)) {
+                return false;
+            }
+            table = entry & 0x000ffffffffff000ULL;
+            continue;
+        }
+        if (m->next + 4096 > m->size) {
+            return false;
+        }
+        entry = m->next | 3U;
+        m->next += 4096;
+        memcpy(m->mem + addr, &entry, entry_size);
+        table = entry & 0x000ffffffffff000ULL;
+    }
+
+    uint64_t addr = table + ((virt_addr >> page_size) & ((1U << index_bits) - 1)) * entry_size;
+    if (scan_mem_entry(m, addr, entry_size) & 1U) {
+        return false;
+    }
+    uint64_t leaf = phys_addr | 3U | (page_size != PAGE_4KB ? 1U << 7U : 0);
+    memcpy(m->mem + addr, &leaf, entry_size);
+    return true;
+}
+
+typedef struct scan_collected {
+    mapping_t *mappings;
+    int n;
+    int max;
+} scan_collected_t;
+
+static bool
+scan_collect(const mapping_t *mapping, void *arg) {
+    scan_collected_t *c = arg;
+    if (c->n < c->max) {
+        c->mappings[c->n++] = *mapping;
+    }
+    return true;
+}
+
+bool
+test_scan() {
+    bool ok = true;
+
+    enum { MEM_SIZE = 4 << 20, PAGES = 3000 };
+    scan_mem_t m = {.mem=malloc(MEM_SIZE), .size=MEM_SIZE};
+    scan_collected_t want = {.mappings=malloc(PAGES * sizeof(mapping_t)), .max=PAGES};
+    scan_collected_t got = {.mappings=malloc(PAGES * sizeof(mapping_t)), .max=PAGES};
+
+    paging_mode_t levels[] = {LEGACY, PAE, IA32E, LA57};
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (int l = 0; l < sizeof(levels) / sizeof(paging_mode_t); ++l) {
+        memset(m.mem, 0, MEM_SIZE);
+        m.level = levels[l];
+        m.root_addr = 0x1000;
+        m.next = 0x2000;
+
+        // Pages spread over the address space in clusters, some of them large
+        int mapped = 0;
+        uint64_t cluster = 0;
+        for (int i = 0; i < PAGES; ++i) {
+            seed ^= seed << 13U;
+            seed ^= seed >> 7U;
+            seed ^= seed << 17U;
+            if (i % 64 == 0) {
+                cluster = seed;
+            }
+            uint64_t virt_addr = (cluster & ~0x3fffffULL) | ((seed & 0x3ffU) << 12U);
+            if (m.level == PAE) {
+                virt_addr &= 0x3fffffffU;
+            } else if (m.level == LEGACY) {
+                virt_addr &= 0xffffffffU;
+            } else {
+                uint8_t shift = m.level == IA32E ? 16 : 7;
+                virt_addr = (uint64_t) ((int64_t) (virt_addr << shift) >> shift);
+            }
+
+            // Legacy runs without PSE, whose reserved bits 21:13 the generated directory entries would hit
+            page_size_t page_size = PAGE_4KB;
+            if (i % 50 == 0 && m.level != LEGACY) {
+                page_size = PAGE_2MB;
+            } else if (i % 301 == 0 && m.level != LEGACY && m.level != PAE) {
+                page_size = PAGE_1GB;
+            }
+            virt_addr &= ~((1ULL << page_size) - 1);
+            mapped += scan_mem_map(&m, virt_addr, (seed & 0xfffc00000ULL), page_size);
+        }
+
+        // A table past the end of memory is a read fault, skipped with its subtree
+        uint32_t entry_size = m.level == LEGACY ? 4 : 8;
+        uint64_t unreadable = MEM_SIZE | 1U;
+        memcpy(m.mem + (m.level == PAE ? 0x1000 : m.root_addr) + 5 * entry_size, &unreadable, entry_size);
+
+        config_t cfg = {
+                .level=m.level,
+                .root_addr=m.root_addr,
+                .pse=m.level != LEGACY,
+                .pat=true,
+                .maxphyaddr=40,
+                .mem_base=m.mem,
+                .mem_size=MEM_SIZE,
+        };
+        uint64_t pdpte = 0x1000 | 1U;
+        memcpy(m.mem, &pdpte, sizeof(pdpte));
+
+        // Single thread as the reference for 64-bit modes, v2p_enumerate for the others
+        want.n = 0;
+        error_t want_err = levels[l] == IA32E || levels[l] == LA57
+                           ? v2p_enumerate_parallel(&cfg, 1, scan_collect, &want)
+                           : v2p_enumerate(&cfg, scan_collect, &want);
+        if (want_err != READ_FAULT || want.n == 0 || mapped < PAGES / 2) {
+            printf("scan: mode %d: got %d with %d of %d mappings, want %d\n\n",
+                   m.level, want_err, want.n, mapped, READ_FAULT);
+            ok = false;
+        }
+
+        uint32_t threads[] = {2, 4, 0};
+        for (int t = 0; t < sizeof(threads) / sizeof(uint32_t); ++t) {
+            got.n = 0;
+            error_t err = v2p_enumerate_parallel(&cfg, threads[t], scan_collect, &got);
+            if (err != want_err || got.n != want.n) {
+                printf("scan: mode %d, %u threads: got %d with %d mappings, want %d with %d\n\n",
+                       m.level, threads[t], err, got.n, want_err, want.n);
+                ok = false;
+                continue;
+            }
+            for (int i = 0; i < got.n; ++i) {
+                const mapping_t *a = &got.mappings[i];
+                const mapping_t *b = &want.mappings[i];
+                if (a->virt_addr != b->virt_addr || a->phys_addr != b->phys_addr
+                    || a->page_size != b->page_size || a->flags != b->flags) {
+                    printf("scan: mode %d, %u threads: wrong mapping %d\ngot:  %llx -> %llx (%d, %llx)\n"
+                           "want: %llx -> %llx (%d, %llx)\n\n",
+                           m.level, threads[t], i, a->virt_addr, a->phys_addr, a->page_size, a->flags,
+                           b->virt_addr, b->phys_addr, b->page_size, b->flags);
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        // Every mapping is a translation of the walk, in ascending order
+        for (int i = 0; i < got.n; ++i) {
+            uint64_t phys = 0;
+            uint32_t page_fault = 0;
+            error_t err = va2pa64(got.mappings[i].virt_addr, &cfg, &phys, &page_fault);
+            if (err != SUCCESS || phys != got.mappings[i].phys_addr
+                || (i > 0 && got.mappings[i].virt_addr <= got.mappings[i - 1].virt_addr)) {
+                printf("scan: mode %d: mapping %d of %llx is not a translation in order\n\n",
+                       m.level, i, got.mappings[i].virt_addr);
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    free(got.mappings);
+    free(want.mappings);
+    free(m.mem);
+    return ok;
+}
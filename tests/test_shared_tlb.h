@@ -0,0 +1,130 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+
+// Legacy tables in flat memory: 4 page tables at 0x1000-0x4fff mapping
+// the first 16MB to scattered frames, everything above not present
+enum { SHARED_TLB_PAGES = 4 * 1024 };
+
+static uint32_t shared_tlb_mem[5 * 1024];
+
+static uint64_t
+shared_tlb_frame(const uint32_t page) {
+    return (uint64_t) ((page * 7919U) % 0x10000U + 0x100U) << 12U;
+}
+
+typedef struct shared_tlb_thread {
+    shared_tlb_t *tlb;
+    const config_t *cfg;
+    uint64_t seed;
+    bool flusher;
+    bool ok;
+} shared_tlb_thread_t;
+
+static void *
+shared_tlb_run(void *arg) {
+    shared_tlb_thread_t *t = arg;
+    for (int i = 0; i < 200000; ++i) {
+        t->seed = t->seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t page = (t->seed >> 33U) % (SHARED_TLB_PAGES + 64);
+        if (t->flusher && i % 1000 == 0) {
+            v2p_shared_tlb_flush(t->tlb);
+        } else if (t->flusher && i % 100 == 0) {
+            v2p_shared_tlb_invlpg(t->tlb, page << 12U);
+        }
+
+        uint64_t phys = 0;
+        uint32_t page_fault = 0;
+        error_t err = va2pa_shared_tlb((page << 12U) | 0x321, t->cfg, t->tlb, &phys, &page_fault);
+        bool mapped = page < SHARED_TLB_PAGES;
+        if (mapped ? err != SUCCESS || phys != (shared_tlb_frame(page) | 0x321) : err != PAGE_FAULT) {
+            t->ok = false;
+        }
+    }
+    return NULL;
+}
+
+bool
+test_shared_tlb() {
+    bool ok = true;
+
+    memset(shared_tlb_mem, 0, sizeof(shared_tlb_mem));
+    for (uint32_t i = 0; i < 4; ++i) {
+        shared_tlb_mem[i] = ((i + 1) << 12U) | 1U;
+    }
+    for (uint32_t page = 0; page < SHARED_TLB_PAGES; ++page) {
+        shared_tlb_mem[1024 + page] = (uint32_t) shared_tlb_frame(page) | 1U;
+    }
+    config_t cfg = {
+            .level=LEGACY,
+            .mem_base=shared_tlb_mem,
+            .mem_size=sizeof(shared_tlb_mem),
+            .maxphyaddr=32,
+    };
+
+    shared_tlb_t *tlb = v2p_shared_tlb_init(1000);
+
+    // A cached translation survives a change of the tables until it is invalidated
+    uint64_t phys = 0;
+    uint32_t page_fault = 0;
+    error_t err = va2pa_shared_tlb(0x5123, &cfg, tlb, &phys, &page_fault);
+    shared_tlb_mem[1024 + 5] = 0x777000 | 1U;
+    uint64_t cached = 0;
+    va2pa_shared_tlb(0x5fff, &cfg, tlb, &cached, &page_fault);
+    if (err != SUCCESS || phys != (shared_tlb_frame(5) | 0x123) || cached != (shared_tlb_frame(5) | 0xfff)) {
+        printf("shared tlb: got %d %llx, then %llx from the cache, want %d %llx\n\n",
+               err, phys, cached, SUCCESS, shared_tlb_frame(5) | 0x123);
+        ok = false;
+    }
+    v2p_shared_tlb_invlpg(tlb, 0x5000);
+    va2pa_shared_tlb(0x5000, &cfg, tlb, &phys, &page_fault);
+    if (phys != 0x777000) {
+        printf("shared tlb: invlpg kept %llx\n\n", phys);
+        ok = false;
+    }
+    shared_tlb_mem[1024 + 5] = (uint32_t) shared_tlb_frame(5) | 1U;
+    v2p_shared_tlb_flush(tlb);
+    va2pa_shared_tlb(0x5000, &cfg, tlb, &phys, &page_fault);
+    if (phys != shared_tlb_frame(5)) {
+        printf("shared tlb: flush kept %llx\n\n", phys);
+        ok = false;
+    }
+
+    // Other cr3s and faults are not served from the cache
+    config_t other = cfg;
+    other.root_addr = 0x8000;
+    if (va2pa_shared_tlb(0x5000, &other, tlb, &phys, &page_fault) != READ_FAULT) {
+        printf("shared tlb: translation of another cr3 served from the cache\n\n");
+        ok = false;
+    }
+    shared_tlb_mem[1024 + 6] = 0;
+    va2pa_shared_tlb(0x6000, &cfg, tlb, &phys, &page_fault);
+    shared_tlb_mem[1024 + 6] = (uint32_t) shared_tlb_frame(6) | 1U;
+    if (va2pa_shared_tlb(0x6000, &cfg, tlb, &phys, &page_fault) != SUCCESS || phys != shared_tlb_frame(6)) {
+        printf("shared tlb: page fault cached\n\n");
+        ok = false;
+    }
+
+    // Concurrent lookups and fills, with invalidations from one of the threads
+    enum { THREADS = 4 };
+    shared_tlb_thread_t threads[THREADS];
+    pthread_t handles[THREADS];
+    for (int k = 0; k < THREADS; ++k) {
+        threads[k] = (shared_tlb_thread_t) {.tlb=tlb, .cfg=&cfg, .seed=k + 1, .flusher=k == 0, .ok=true};
+        pthread_create(&handles[k], NULL, shared_tlb_run, &threads[k]);
+    }
+    for (int k = 0; k < THREADS; ++k) {
+        pthread_join(handles[k], NULL);
+        if (!threads[k].ok) {
+            printf("shared tlb: thread %d got a wrong translation\n\n", k);
+            ok = false;
+        }
+    }
+
+    v2p_shared_tlb_free(tlb);
+    return ok;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+#include "simd.h"
+
+// Random entries pointing back into the first 16 pages of mem,
+// mostly present and occasionally with reserved or large bits set
+static void
+simd_random_tables(uint8_t *const mem, const size_t size, uint64_t *const seed) {
+    for (size_t addr = 0; addr < size; addr += 8) {
+        uint64_t x = *seed;
+        x ^= x << 13U;
+        x ^= x >> 7U;
+        x ^= x << 17U;
+        *seed = x;
+
+        uint64_t entry = (((x >> 12U) & 0xfU) << 12U) | (x & 0xfffU);
+        if (x % 4 != 0) {
+            entry |= 1U;
+        }
+        if (x % 8 == 0) {
+            entry |= (x << 20U) & 0xffff000000000000ULL;
+        }
+        if (x % 8 == 1) {
+            entry |= (x << 4U) & 0x0000000fffe00000ULL;
+        }
+        memcpy(mem + addr, &entry, sizeof(entry));
+    }
+}
+
+bool
+test_simd() {
+    bool ok = true;
+
+    // 16 pages of tables, part of the last one is cut off to fault reads
+    enum { MEM_SIZE = 16 * 4096 - 12, N = 1000 };
+    uint8_t *mem = malloc(16 * 4096);
+    uint32_t *virt_addrs = malloc(N * sizeof(uint32_t));
+    uint64_t *phys = malloc(N * sizeof(uint64_t));
+    error_t *errors = malloc(N * sizeof(error_t));
+    uint32_t *page_faults = malloc(N * sizeof(uint32_t));
+
+    config_t cfgs[] = {
+            {.level=LEGACY, .pse=false},
+            {.level=LEGACY, .pse=true, .pat=false, .maxphyaddr=36},
+            {.level=LEGACY, .pse=true, .pse36=true, .pat=true, .maxphyaddr=40},
+            {.level=PAE, .pat=true, .nxe=true, .maxphyaddr=52},
+            {.level=PAE, .pat=false, .nxe=false, .maxphyaddr=36},
+    };
+    int n_cfgs = sizeof(cfgs) / sizeof(config_t);
+
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (int c = 0; c < n_cfgs; ++c) {
+        simd_random_tables(mem, 16 * 4096, &seed);
+        for (int i = 0; i < N; ++i) {
+            virt_addrs[i] = (uint32_t) (seed * (i + 1) >> 17U);
+            if (cfgs[c].level == PAE && i % 4 != 0) {
+                // PDPTEs of the other gigabytes are past the end of mem
+                virt_addrs[i] &= 0x3fffffffU;
+            }
+        }
+
+        config_t cfg = cfgs[c];
+        cfg.root_addr = 0x3000;
+        cfg.mem_base = mem;
+        cfg.mem_size = MEM_SIZE;
+        translator_t tr;
+        translator_setup(&tr, &cfg);
+
+        // Every kernel the cpu has, on a length that is not a multiple of the vector width
+        for (simd_kernel_t kernel = SIMD_SCALAR; kernel <= simd_detect(); ++kernel) {
+            if (!simd_batch(kernel, &tr, virt_addrs, N - 3, phys, errors, page_faults)) {
+                printf("simd: kernel %d not used for config %d\n\n", kernel, c);
+                ok = false;
+                continue;
+            }
+            for (int i = 0; i < N - 3; ++i) {
+                uint64_t want_phys = 0;
+                uint32_t want_page_fault = 0;
+                error_t want_err = va2pa(virt_addrs[i], &cfg, &want_phys, &want_page_fault);
+                if (errors[i] != want_err || phys[i] != want_phys || page_faults[i] != want_page_fault) {
+                    printf("simd: kernel %d, config %d: wrong result for %x\ngot:  %d %llx %u\nwant: %d %llx %u\n\n",
+                           kernel, c, virt_addrs[i], errors[i], phys[i], page_faults[i],
+                           want_err, want_phys, want_page_fault);
+                    ok = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    free(page_faults);
+    free(errors);
+    free(phys);
+    free(virt_addrs);
+    free(mem);
+    return ok;
+}
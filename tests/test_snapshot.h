@@ -0,0 +1,209 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "v2p.h"
+#include "test_scan.h"
+
+typedef struct snapshot_ranges {
+    diff_range_t ranges[64];
+    int n;
+    int max;
+} snapshot_ranges_t;
+
+static bool
+snapshot_collect(const diff_range_t *range, void *arg) {
+    snapshot_ranges_t *r = arg;
+    if (r->n < 64) {
+        r->ranges[r->n] = *range;
+    }
+    ++r->n;
+    return r->n < r->max;
+}
+
+// address of the entry translating bits shift and up of virt_addr, 0 if a table on the way is missing
+static uint64_t
+snapshot_entry_addr(const scan_mem_t *const m, const uint64_t virt_addr, const uint8_t shift) {
+    uint32_t entry_size = m->level == LEGACY ? 4 : 8;
+    uint32_t index_bits = m->level == LEGACY ? 10 : 9;
+    uint8_t top = m->level == LEGACY ? 22 : m->level == PAE ? 21 : m->level == IA32E ? 39 : 48;
+    uint64_t table = m->level == PAE ? 0x1000 : m->root_addr;
+    for (uint8_t s = top; s > shift; s -= index_bits) {
+        uint64_t entry = scan_mem_entry(m, table + ((virt_addr >> s) & ((1U << index_bits) - 1)) * entry_size, entry_size);
+        if ((entry & 1U) == 0) {
+            return 0;
+        }
+        table = entry & 0x000ffffffffff000ULL;
+    }
+    return table + ((virt_addr >> shift) & ((1U << index_bits) - 1)) * entry_size;
+}
+
+static void
+snapshot_set(scan_mem_t *const m, const uint64_t virt_addr, const uint8_t shift, const uint64_t entry) {
+    memcpy(m->mem + snapshot_entry_addr(m, virt_addr, shift), &entry, m->level == LEGACY ? 4 : 8);
+}
+
+// Changes between two sorted enumerations, merged like v2p_snapshot_update does
+static void
+snapshot_want(const scan_collected_t *const before, const scan_collected_t *const after, snapshot_ranges_t *const want) {
+    want->n = 0;
+    int i = 0;
+    int j = 0;
+    while (i < before->n || j < after->n) {
+        const mapping_t *a = i < before->n ? &before->mappings[i] : NULL;
+        const mapping_t *b = j < after->n ? &after->mappings[j] : NULL;
+        diff_range_t r;
+        if (a != NULL && b != NULL && a->virt_addr == b->virt_addr && a->page_size == b->page_size) {
+            ++i;
+            ++j;
+            if (a->phys_addr == b->phys_addr && ((a->flags ^ b->flags) & ~0x60ULL) == 0) {
+                continue;
+            }
+            r = (diff_range_t) {DIFF_REMAPPED, a->virt_addr, 1ULL << a->page_size};
+        } else if (b == NULL || (a != NULL && a->virt_addr <= b->virt_addr)) {
+            r = (diff_range_t) {DIFF_REMOVED, a->virt_addr, 1ULL << a->page_size};
+            ++i;
+        } else {
+            r = (diff_range_t) {DIFF_ADDED, b->virt_addr, 1ULL << b->page_size};
+            ++j;
+        }
+
+        diff_range_t *last = want->n > 0 ? &want->ranges[want->n - 1] : NULL;
+        if (last != NULL && last->kind == r.kind && last->virt_addr + last->len == r.virt_addr) {
+            last->len += r.len;
+        } else if (want->n < 64) {
+            want->ranges[want->n++] = r;
+        }
+    }
+}
+
+bool
+test_snapshot() {
+    bool ok = true;
+
+    enum { MEM_SIZE = 1 << 20, MAX_MAPPINGS = 4096 };
+    scan_mem_t m = {.mem=malloc(MEM_SIZE), .size=MEM_SIZE, .root_addr=0x1000};
+    scan_collected_t before = {.mappings=malloc(MAX_MAPPINGS * sizeof(mapping_t)), .max=MAX_MAPPINGS};
+    scan_collected_t after = {.mappings=malloc(MAX_MAPPINGS * sizeof(mapping_t)), .max=MAX_MAPPINGS};
+    snapshot_ranges_t got;
+    snapshot_ranges_t want;
+
+    paging_mode_t levels[] = {LEGACY, PAE, IA32E, LA57};
+    for (int l = 0; l < sizeof(levels) / sizeof(paging_mode_t); ++l) {
+        m.level = levels[l];
+        bool wide = m.level == IA32E || m.level == LA57;
+        uint64_t base = wide ? 0xffff800000000000ULL : 0x10000000;
+        uint64_t other = wide ? 0x00007f0000000000ULL : 0x30000000;
+        uint8_t pde_shift = m.level == LEGACY ? 22 : 21;
+        config_t cfg = {
+                .level=m.level,
+                .root_addr=m.root_addr,
+                .pse=m.level != LEGACY,
+                .pat=true,
+                .maxphyaddr=40,
+                .mem_base=m.mem,
+                .mem_size=MEM_SIZE,
+        };
+        // The PDPTEs of the other PAE gigabytes are past the end of memory
+        error_t want_err = m.level == PAE ? READ_FAULT : SUCCESS;
+
+        // Two page tables worth of pages, then a few at the other end of the address space
+        memset(m.mem, 0, MEM_SIZE);
+        m.next = 0x2000;
+        for (int i = 0; i < 800; ++i) {
+            scan_mem_map(&m, base + i * 0x1000, 0x40000000 + i * 0x1000, PAGE_4KB);
+        }
+        for (int i = 0; i < 40; ++i) {
+            scan_mem_map(&m, other + (uint64_t) i * 0x401000, 0x50000000 + i * 0x1000, PAGE_4KB);
+        }
+        if (m.level != LEGACY) {
+            scan_mem_map(&m, base + 0x1000000, 0x60000000, PAGE_2MB);
+        }
+        uint64_t pdpte = 0x1000 | 1U;
+        memcpy(m.mem, &pdpte, sizeof(pdpte));
+
+        snapshot_t *snapshot = NULL;
+        error_t err = v2p_snapshot_take(&cfg, &snapshot);
+        got = (snapshot_ranges_t) {.max=64};
+        error_t update_err = snapshot == NULL ? err : v2p_snapshot_update(snapshot, &cfg, snapshot_collect, &got);
+        if (err != want_err || update_err != want_err || got.n != 0) {
+            printf("snapshot: mode %d: got %d, %d with %d changes, want %d without changes\n\n",
+                   m.level, err, update_err, got.n, want_err);
+            v2p_snapshot_free(snapshot);
+            ok = false;
+            continue;
+        }
+        before.n = 0;
+        v2p_enumerate_parallel(&cfg, 1, scan_collect, &before);
+
+        // Added pages in new tables, two adjacent pages removed, a remapped page,
+        // an accessed bit, a whole page table removed, another large page and
+        // a large page split into 4KB pages (removed, then added)
+        for (int i = 0; i < 30; ++i) {
+            scan_mem_map(&m, other + 0x10000000 + i * 0x1000, 0x70000000 + i * 0x1000, PAGE_4KB);
+        }
+        snapshot_set(&m, base + 10 * 0x1000, PAGE_4KB, 0);
+        snapshot_set(&m, base + 11 * 0x1000, PAGE_4KB, 0);
+        snapshot_set(&m, base + 20 * 0x1000, PAGE_4KB, 0x48000000 | 3U);
+        snapshot_set(&m, base + 21 * 0x1000, PAGE_4KB, (0x40000000 + 21 * 0x1000) | 3U | (1U << 5U));
+        snapshot_set(&m, other + 7 * 0x401000, pde_shift, 0);
+        if (m.level != LEGACY) {
+            scan_mem_map(&m, base + 0x1200000, 0x60200000, PAGE_2MB);
+            uint64_t pde;
+            memcpy(&pde, m.mem + snapshot_entry_addr(&m, base, pde_shift), sizeof(pde));
+            snapshot_set(&m, base + 0x1000000, pde_shift, pde);
+        }
+        after.n = 0;
+        v2p_enumerate_parallel(&cfg, 1, scan_collect, &after);
+        snapshot_want(&before, &after, &want);
+
+        got.n = 0;
+        err = v2p_snapshot_update(snapshot, &cfg, snapshot_collect, &got);
+        bool same = got.n == want.n;
+        for (int i = 0; same && i < want.n; ++i) {
+            same = got.ranges[i].kind == want.ranges[i].kind && got.ranges[i].virt_addr == want.ranges[i].virt_addr
+                   && got.ranges[i].len == want.ranges[i].len;
+        }
+        // a full after would have cut the expected changes short
+        if (err != want_err || !same || want.n < 4 || after.n == MAX_MAPPINGS) {
+            printf("snapshot: mode %d: got %d with %d changes, want %d with %d\n",
+                   m.level, err, got.n, want_err, want.n);
+            for (int i = 0; i < got.n && i < 64; ++i) {
+                printf("got:  %d %llx %llx\n", got.ranges[i].kind, got.ranges[i].virt_addr, got.ranges[i].len);
+            }
+            for (int i = 0; i < want.n; ++i) {
+                printf("want: %d %llx %llx\n", want.ranges[i].kind, want.ranges[i].virt_addr, want.ranges[i].len);
+            }
+            printf("\n");
+            ok = false;
+        }
+
+        // Stopping the reports still updates the whole snapshot
+        for (int i = 0; i < 5; ++i) {
+            snapshot_set(&m, base + (100 + 2 * i) * 0x1000, PAGE_4KB, 0);
+        }
+        got = (snapshot_ranges_t) {.max=1};
+        v2p_snapshot_update(snapshot, &cfg, snapshot_collect, &got);
+        int stopped = got.n;
+        got = (snapshot_ranges_t) {.max=64};
+        v2p_snapshot_update(snapshot, &cfg, snapshot_collect, &got);
+        if (stopped != 1 || got.n != 0) {
+            printf("snapshot: mode %d: got %d reports before the stop and %d after, want 1 and 0\n\n",
+                   m.level, stopped, got.n);
+            ok = false;
+        }
+
+        cfg.level = m.level == LEGACY ? PAE : LEGACY;
+        if (v2p_snapshot_update(snapshot, &cfg, snapshot_collect, &got) != INVALID_TRANSLATION_TYPE) {
+            printf("snapshot: mode %d: update in another paging mode accepted\n\n", m.level);
+            ok = false;
+        }
+        v2p_snapshot_free(snapshot);
+    }
+
+    free(after.mappings);
+    free(before.mappings);
+    free(m.mem);
+    return ok;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <pthread.h>
+#include <string.h>
+
+#include "v2p.h"
+#include "test_mem.h"
+
+// Field-by-field difference of two snapshots of the counters
+static void
+stats_delta(const v2p_stats_t *const before, const v2p_stats_t *const after, v2p_stats_t *const delta) {
+    const uint64_t *b = (const uint64_t *) before;
+    const uint64_t *a = (const uint64_t *) after;
+    uint64_t *d = (uint64_t *) delta;
+    for (size_t i = 0; i < sizeof(v2p_stats_t) / sizeof(uint64_t); ++i) {
+        d[i] = a[i] - b[i];
+    }
+}
+
+// 4KB page, 2MB page, reserved bit, not-present PTE, not-present PDPTE,
+// then a read fault and a non-canonical address
+static void *
+stats_walks(void *const arg) {
+    (void) arg;
+    uint64_t phys = 0;
+    uint32_t page_fault = 0;
+    config_t cfg = {.level=PAE, .read_func=test_mem_read_func, .pat=true, .maxphyaddr=36};
+    uint32_t virt_addrs[] = {0x1abc, 0x200000, 0x3abc, 0x4abc, 0x40000000};
+    for (int i = 0; i < sizeof(virt_addrs) / sizeof(uint32_t); ++i) {
+        page_fault = 0;
+        va2pa(virt_addrs[i], &cfg, &phys, &page_fault);
+    }
+
+    uint8_t mem[64] = {0};
+    config_t small = {.level=LEGACY, .root_addr=0x1000, .mem_base=mem, .mem_size=sizeof(mem), .maxphyaddr=40};
+    va2pa(0x1000, &small, &phys, &page_fault);
+    config_t ia32e = {.level=IA32E, .read_func=test_mem_read_func, .maxphyaddr=52};
+    va2pa64(0x0000800000000000ULL, &ia32e, &phys, &page_fault);
+    return NULL;
+}
+
+bool
+test_stats() {
+    bool ok = true;
+
+    v2p_stats_t before;
+    v2p_stats_t after;
+    v2p_stats_t got;
+    if (!v2p_stats_get(&before)) {
+        // Compiled out: nothing is counted
+        const v2p_stats_t zero = {0};
+        if (memcmp(&before, &zero, sizeof(v2p_stats_t)) != 0) {
+            printf("stats: counters are not zeroed without V2P_STATS\n\n");
+            ok = false;
+        }
+        return ok;
+    }
+
+    test_mem_reset();
+    test_mem_write(0x0, 0x1000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000, 0x2000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000 + 8, 0x40000000ULL | 1U | (1U << PS_PDE2MB), sizeof(uint64_t));
+    test_mem_write(0x2000 + 1 * 8, 0x5000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x2000 + 3 * 8, 0x7000 | 1U | (1ULL << 40U), sizeof(uint64_t));
+
+    v2p_stats_t want = {
+            .walks=7,
+            .walk_reads=3 + 2 + 3 + 3 + 1 + 1,
+            .reads=3 + 2 + 3 + 3 + 1 + 1,
+            .ended_at={[LEVEL_PTE]=3, [LEVEL_PDE]=2, [LEVEL_PDPTE]=1},
+            .pages_4kb=1,
+            .pages_2mb=1,
+            .not_present=2,
+            .reserved_bit=1,
+            .read_faults=1,
+            .non_canonical=1,
+    };
+
+    // The walks of this thread
+    v2p_stats_get(&before);
+    stats_walks(NULL);
+    v2p_stats_get(&after);
+    stats_delta(&before, &after, &got);
+    if (memcmp(&got, &want, sizeof(v2p_stats_t)) != 0) {
+        printf("stats: got %llu walks with %llu reads, want %llu with %llu\n\n",
+               got.walks, got.walk_reads, want.walks, want.walk_reads);
+        ok = false;
+    }
+
+    // The counters of a thread are kept after it exits
+    pthread_t thread;
+    v2p_stats_get(&before);
+    pthread_create(&thread, NULL, stats_walks, NULL);
+    pthread_join(thread, NULL);
+    v2p_stats_get(&after);
+    stats_delta(&before, &after, &got);
+    if (memcmp(&got, &want, sizeof(v2p_stats_t)) != 0) {
+        printf("stats: got %llu walks of an exited thread, want %llu\n\n", got.walks, want.walks);
+        ok = false;
+    }
+
+    return ok;
+}
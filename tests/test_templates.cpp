@@ -0,0 +1,142 @@
+#include <cstdio>
+
+#include "v2p.hpp"
+#include "test_mem.h"
+
+static uint64_t
+rand64(uint64_t *state) {
+    // xorshift64
+    uint64_t x = *state;
+    x ^= x << 13U;
+    x ^= x >> 7U;
+    x ^= x << 17U;
+    return *state = x;
+}
+
+// Fills physical pages 0..15 with random entries pointing back into them,
+// mostly present and occasionally with high (reserved) bits set
+static void
+random_tables(uint64_t *const seed) {
+    test_mem_reset();
+    for (uint64_t addr = 0; addr < 16 * 4096; addr += 8) {
+        uint64_t r = rand64(seed);
+        uint64_t entry = ((r >> 12U) & 0xfU) << 12U;
+        entry |= r & 0xfffU;
+        if (r % 4 != 0) {
+            entry |= 1U;
+        }
+        if (r % 16 == 0) {
+            entry |= rand64(seed) & 0xfff0000000000000ULL;
+        }
+        if (r % 16 == 1) {
+            entry |= rand64(seed) & 0x0000fff000000000ULL;
+        }
+        test_mem_write(addr, entry, sizeof(uint64_t));
+    }
+}
+
+// read_ctx_func over a flat copy of memory at ctx, 64KB long
+static int32_t
+flat_read(void *ctx, void *buf, const uint32_t size, const uint64_t physical_addr) {
+    if (physical_addr >= 16 * 4096 || size > 16 * 4096 - physical_addr) {
+        return 0;
+    }
+    memcpy(buf, static_cast<const uint8_t *>(ctx) + physical_addr, size);
+    return size;
+}
+
+// Compares v2p::translate with va2pa64 for Mode and F on random tables
+template <paging_mode_t Mode, typename F>
+static bool
+test_translate(const char *const name) {
+    bool ok = true;
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    for (int round = 0; round < 8; ++round) {
+        random_tables(&seed);
+
+        // the same memory through the flat backend
+        static uint8_t flat[16 * 4096];
+        for (uint64_t addr = 0; addr < sizeof(flat); addr += 8) {
+            test_mem_read_func(flat + addr, sizeof(uint64_t), addr);
+        }
+        v2p::memory_backend mem{flat, sizeof(flat)};
+        v2p::callback_backend callback{test_mem_read_func};
+        v2p::callback_ctx_backend callback_ctx{flat_read, flat};
+
+        config_t cfg = {};
+        cfg.level = Mode;
+        cfg.root_addr = (rand64(&seed) % 16) << 12U;
+        cfg.read_func = test_mem_read_func;
+        cfg.pse = F::pse;
+        cfg.pse36 = F::pse36;
+        cfg.pat = F::pat;
+        cfg.nxe = F::nxe;
+        cfg.maxphyaddr = F::maxphyaddr;
+
+        for (int i = 0; i < 4096; ++i) {
+            uint64_t virt_addr = rand64(&seed);
+            if (i % 4 != 0) {
+                // mostly canonical
+                uint8_t shift = Mode == LA57 ? 7 : 16;
+                virt_addr = (uint64_t) ((int64_t) (virt_addr << shift) >> shift);
+            }
+            if (Mode == PAE) {
+                virt_addr &= 0x3fffffffU;
+            }
+
+            uint64_t want_phys = 0;
+            uint32_t want_page_fault = 0;
+            error_t want_err = va2pa64(virt_addr, &cfg, &want_phys, &want_page_fault);
+
+            uint64_t phys = 0;
+            uint32_t page_fault = 0;
+            error_t err = v2p::translate<Mode, F>(callback, cfg.root_addr, virt_addr, &phys, &page_fault);
+
+            uint64_t mem_phys = 0;
+            uint32_t mem_page_fault = 0;
+            error_t mem_err = v2p::translate<Mode, F>(mem, cfg.root_addr, virt_addr, &mem_phys, &mem_page_fault);
+
+            uint64_t ctx_phys = 0;
+            uint32_t ctx_page_fault = 0;
+            error_t ctx_err = v2p::translate<Mode, F>(callback_ctx, cfg.root_addr, virt_addr, &ctx_phys, &ctx_page_fault);
+
+            // test_mem reads unallocated memory as zeros (not present),
+            // while the flat copy ends at 64KB
+            bool past_flat = mem_err == READ_FAULT && want_err == PAGE_FAULT && want_page_fault == NOT_PRESENT;
+            if (err != want_err || phys != want_phys || page_fault != want_page_fault
+                || (!past_flat && (mem_err != want_err || mem_phys != want_phys || mem_page_fault != want_page_fault))
+                || ctx_err != mem_err || ctx_phys != mem_phys || ctx_page_fault != mem_page_fault) {
+                printf("templates: wrong result for %s, %llx\ngot:  %d %llx %u (memory: %d %llx %u)\nwant: %d %llx %u\n\n",
+                       name, (unsigned long long) virt_addr,
+                       err, (unsigned long long) phys, page_fault,
+                       mem_err, (unsigned long long) mem_phys, mem_page_fault,
+                       want_err, (unsigned long long) want_phys, want_page_fault);
+                ok = false;
+                break;
+            }
+        }
+    }
+    return ok;
+}
+
+int
+main() {
+    bool ok = true;
+    ok &= test_translate<LEGACY, v2p::features<false, false, false, false, 32>>("legacy");
+    ok &= test_translate<LEGACY, v2p::features<true, false, false, false, 36>>("legacy pse");
+    ok &= test_translate<LEGACY, v2p::features<true, true, true, false, 36>>("legacy pse-36");
+    ok &= test_translate<LEGACY, v2p::features<true, true, false, false, 52>>("legacy pse-36 maxphyaddr 52");
+    ok &= test_translate<PAE, v2p::features<true, false, true, true, 52>>("pae");
+    ok &= test_translate<PAE, v2p::features<true, false, false, false, 36>>("pae no pat, nxe");
+    ok &= test_translate<IA32E, v2p::features<true, false, true, true, 52>>("ia32e");
+    ok &= test_translate<IA32E, v2p::features<true, false, false, false, 46>>("ia32e no pat, nxe");
+    ok &= test_translate<LA57, v2p::features<true, false, true, true, 52>>("la57");
+    ok &= test_translate<LA57, v2p::features<true, false, false, true, 40>>("la57 maxphyaddr 40");
+
+    if (ok) {
+        printf("OK\n");
+    } else {
+        printf("Errors occurred");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "v2p.h"
+#include "test_mem.h"
+
+bool
+test_tlb() {
+    bool ok = true;
+
+    // LEGACY: pde 0 -> page table at 0x1000, pde 1 -> 4MB page at 0x800000
+    test_mem_reset();
+    test_mem_write(0x0, 0x1000 | 1U, sizeof(uint32_t));
+    test_mem_write(0x4, 0x800000 | 1U | (1U << PS_PDE4MB), sizeof(uint32_t));
+    test_mem_write(0x1000 + 5 * 4, 0x7000 | 1U, sizeof(uint32_t));
+
+    config_t cfg = {.level=LEGACY, .root_addr=0, .read_func=test_mem_read_func, .pse=true, .pat=true, .maxphyaddr=52};
+    tlb_t tlb;
+    v2p_tlb_init(&tlb);
+
+    typedef struct {
+        const char *name;
+        uint32_t virt_addr;
+        uint64_t want_phys;
+        int want_reads;
+    } test_case;
+
+    test_case t[] = {
+            {"4kb miss",               0x5123,   0x7123,   2},
+            {"4kb hit",                0x5fff,   0x7fff,   0},
+            {"4mb miss",               0x400010, 0x800010, 1},
+            {"4mb hit",                0x7fffff, 0xbfffff, 0},
+            {"pde cache hit",          0x6000,   0,        1},
+    };
+    int n = sizeof(t) / sizeof(test_case);
+
+    for (int i = 0; i < n; ++i) {
+        test_mem_reads = 0;
+        uint64_t phys = 0;
+        uint32_t page_fault = 0;
+        error_t err = va2pa_tlb(t[i].virt_addr, &cfg, &tlb, &phys, &page_fault);
+        error_t want_err = t[i].want_phys ? SUCCESS : PAGE_FAULT;
+        if (err != want_err || phys != t[i].want_phys || test_mem_reads != t[i].want_reads) {
+            printf("wrong result for tlb test '%s'\ngot:  %d %llu %d reads\nwant: %d %llu %d reads\n\n",
+                   t[i].name, err, phys, test_mem_reads, want_err, t[i].want_phys, t[i].want_reads);
+            ok = false;
+        }
+    }
+
+    // Faults are not cached
+    test_mem_reads = 0;
+    uint64_t phys = 0;
+    uint32_t page_fault = 0;
+    va2pa_tlb(0x6000, &cfg, &tlb, &phys, &page_fault);
+    if (test_mem_reads != 1) {
+        printf("tlb: fault was cached\n\n");
+        ok = false;
+    }
+
+    // invlpg drops only the given page
+    v2p_tlb_invlpg(&tlb, 0x5000);
+    test_mem_reads = 0;
+    va2pa_tlb(0x5000, &cfg, &tlb, &phys, &page_fault);
+    va2pa_tlb(0x400000, &cfg, &tlb, &phys, &page_fault);
+    if (test_mem_reads != 2) {
+        printf("tlb: invlpg: got %d reads, want 2\n\n", test_mem_reads);
+        ok = false;
+    }
+
+    // Entries are tagged with cr3
+    config_t other = cfg;
+    other.root_addr = 0x2000;
+    test_mem_reads = 0;
+    va2pa_tlb(0x5000, &other, &tlb, &phys, &page_fault);
+    if (test_mem_reads != 1) {
+        printf("tlb: hit for another cr3\n\n");
+        ok = false;
+    }
+
+    v2p_tlb_flush_root(&tlb, 0);
+    test_mem_reads = 0;
+    va2pa_tlb(0x5000, &cfg, &tlb, &phys, &page_fault);
+    va2pa_tlb(0x400000, &cfg, &tlb, &phys, &page_fault);
+    if (test_mem_reads != 3) {
+        printf("tlb: flush_root: got %d reads, want 3\n\n", test_mem_reads);
+        ok = false;
+    }
+
+    // PAE: pde 1 -> 2MB page at 0x40000000, pde 2 -> page table at 0x4000
+    test_mem_reset();
+    test_mem_write(0x0, 0x3000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x3000 + 8, 0x40000000ULL | 1U | (1U << PS_PDE2MB), sizeof(uint64_t));
+    test_mem_write(0x3000 + 16, 0x4000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x4000, 0x9000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x4000 + 8, 0xa000 | 1U, sizeof(uint64_t));
+    cfg.level = PAE;
+    v2p_tlb_flush(&tlb);
+
+    va2pa_tlb(0x200000, &cfg, &tlb, &phys, &page_fault);
+    test_mem_reads = 0;
+    va2pa_tlb(0x3fffff, &cfg, &tlb, &phys, &page_fault);
+    if (test_mem_reads != 0 || phys != 0x401fffffULL) {
+        printf("tlb: 2mb: got %llu with %d reads\n\n", phys, test_mem_reads);
+        ok = false;
+    }
+
+    // The PDPTE is cached, then the PDE referencing the page table
+    test_mem_reads = 0;
+    va2pa_tlb(0x400000, &cfg, &tlb, &phys, &page_fault);
+    if (test_mem_reads != 2 || phys != 0x9000) {
+        printf("tlb: pdpte cache: got %llu with %d reads\n\n", phys, test_mem_reads);
+        ok = false;
+    }
+    test_mem_reads = 0;
+    va2pa_tlb(0x401234, &cfg, &tlb, &phys, &page_fault);
+    if (test_mem_reads != 1 || phys != 0xa234) {
+        printf("tlb: pde cache: got %llu with %d reads\n\n", phys, test_mem_reads);
+        ok = false;
+    }
+
+    return ok;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "v2p.h"
+#include "test_mem.h"
+
+bool
+test_translator() {
+    bool ok = true;
+
+    // PAE: pde 0 -> page table at 0x2000, pde 1 -> 2MB page with bit 12 set,
+    // pte 1 -> 0x5000, pte 2 has the PAT bit set, pte 3 has a reserved bit set
+    test_mem_reset();
+    test_mem_write(0x0, 0x1000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000, 0x2000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x1000 + 8, 0x40000000ULL | 1U | (1U << PS_PDE2MB) | (1U << 12U), sizeof(uint64_t));
+    test_mem_write(0x2000 + 1 * 8, 0x5000 | 1U, sizeof(uint64_t));
+    test_mem_write(0x2000 + 2 * 8, 0x6000 | 1U | (1U << 7U), sizeof(uint64_t));
+    test_mem_write(0x2000 + 3 * 8, 0x7000 | 1U | (1ULL << 40U), sizeof(uint64_t));
+
+    uint64_t virt_addrs[] = {0x0, 0x1abc, 0x2abc, 0x3abc, 0x200000, 0x3fffff, 0x400000};
+    int n = sizeof(virt_addrs) / sizeof(uint64_t);
+
+    config_t cfgs[] = {
+            {.level=PAE, .read_func=test_mem_read_func, .pat=true, .maxphyaddr=52},
+            {.level=PAE, .read_func=test_mem_read_func, .pat=false, .maxphyaddr=52},
+            {.level=PAE, .read_func=test_mem_read_func, .pat=true, .maxphyaddr=36},
+            {.level=LEGACY, .read_func=test_mem_read_func, .pse=true, .pat=false, .maxphyaddr=40},
+            {.level=IA32E, .read_func=test_mem_read_func, .pat=true, .maxphyaddr=52},
+            {.level=0, .read_func=test_mem_read_func},
+    };
+    int n_cfgs = sizeof(cfgs) / sizeof(config_t);
+
+    // Translating with a translator is the same as translating with its config
+    for (int c = 0; c < n_cfgs; ++c) {
+        translator_t *tr = v2p_translator_init(&cfgs[c]);
+        for (int i = 0; i < n; ++i) {
+            uint64_t phys = 0;
+            uint32_t page_fault = 0;
+            error_t err = v2p_translate(tr, virt_addrs[i], &phys, &page_fault);
+
+            uint64_t want_phys = 0;
+            uint32_t want_page_fault = 0;
+            error_t want_err = va2pa64(virt_addrs[i], &cfgs[c], &want_phys, &want_page_fault);
+            if (err != want_err || phys != want_phys || page_fault != want_page_fault) {
+                printf("translator: wrong result for config %d, %llu\ngot:  %d %llu %u\nwant: %d %llu %u\n\n",
+                       c, virt_addrs[i], err, phys, page_fault, want_err, want_phys, want_page_fault);
+                ok = false;
+            }
+        }
+        v2p_translator_free(tr);
+    }
+
+    // The config is copied, later changes to it are not seen
+    config_t cfg = {.level=PAE, .read_func=test_mem_read_func, .pat=true, .maxphyaddr=52};
+    translator_t *tr = v2p_translator_init(&cfg);
+    cfg.pat = false;
+    cfg.root_addr = 0x1000;
+    uint64_t phys = 0;
+    uint32_t page_fault = 0;
+    error_t err = v2p_translate(tr, 0x2abc, &phys, &page_fault);
+    if (err != SUCCESS || phys != 0x6abc) {
+        printf("translator: copy of config: got %d %llu, want 0 %llu\n\n", err, phys, 0x6abcULL);
+        ok = false;
+    }
+    v2p_translator_free(tr);
+
+    return ok;
+}
@@ -1,20 +1,25 @@
 #pragma once
 
+#include <pthread.h>
 #include <string.h>
 
 #include "v2p.h"
 #include "utils.h"
 
-// Mask for every part of the translation (pdpte, pde, pte)
-static uint64_t mock_read_mask[] = {0, 0, 0};
-static int mock_read_part = 0;
-static int32_t mock_read_return[] = {sizeof(uint64_t), sizeof(uint64_t), sizeof(uint64_t)};
+// Entries read by a walk, passed as config_t.ctx: every read returns its address
+// with the mask of its part of the translation (pdpte, pde, pte) set
+typedef struct mock_read {
+    uint64_t mask[3];
+    int32_t ret[3];
+    int part;
+} mock_read_t;
 
 int32_t
-mock_read_func(void *buf, const uint32_t size, const uint64_t physical_addr) {
-    uint64_t val = physical_addr | mock_read_mask[mock_read_part];
+mock_read_func(void *ctx, void *buf, const uint32_t size, const uint64_t physical_addr) {
+    mock_read_t *mock = ctx;
+    uint64_t val = physical_addr | mock->mask[mock->part];
     memcpy(buf, &val, size);
-    return mock_read_return[mock_read_part++];
+    return mock->ret[mock->part++];
 }
 
 bool
@@ -39,7 +44,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             .root_addr=777777777,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=true,
                             .maxphyaddr=52,
                     },
@@ -54,7 +59,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=true,
                             .pse=true,
                             .maxphyaddr=52,
@@ -70,7 +75,7 @@ test_va2pa() {
                     {
                             .level = LEGACY,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat = true,
                             .maxphyaddr = 52,
                     },
@@ -86,7 +91,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=true,
                             .maxphyaddr=52,
                     },
@@ -101,7 +106,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=false,
                             .maxphyaddr=52,
                     },
@@ -117,7 +122,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=true,
                             .pse36=true,
                             .pse=true,
@@ -135,7 +140,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=false,
                             .pse=true,
                             .maxphyaddr=52,
@@ -155,7 +160,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=false,
                             .pse=true,
                             .maxphyaddr=52,
@@ -173,7 +178,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=true,
                             .pse=true,
                             .maxphyaddr=52,
@@ -189,7 +194,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=false,
                             .pse=true,
                             .maxphyaddr=52,
@@ -206,7 +211,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=false,
                             .pse=true,
                             .maxphyaddr=52,
@@ -222,7 +227,7 @@ test_va2pa() {
                     {
                             .level=LEGACY,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=false,
                             .pse=true,
                             .maxphyaddr=52,
@@ -239,7 +244,7 @@ test_va2pa() {
                     {
                             .level=PAE,
                             .root_addr=777777777,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=true,
                             .maxphyaddr=52,
                     },
@@ -254,7 +259,7 @@ test_va2pa() {
                     {
                             .level=PAE,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=true,
                             .maxphyaddr=52,
                     },
@@ -269,7 +274,7 @@ test_va2pa() {
                     {
                             .level=PAE,
                             .root_addr=0,
-                            .read_func=mock_read_func,
+                            .read_ctx_func=mock_read_func,
                             .pat=true,
                             .maxphyaddr=52,
                     },
@@ -283,14 +288,11 @@ test_va2pa() {
 
     bool ok = true;
     for (int i = 0; i < n; ++i) {
-        // initialize mock_read_func
-        mock_read_part = 0;
-        mock_read_mask[0] = t[i].read_mask[0];
-        mock_read_mask[1] = t[i].read_mask[1];
-        mock_read_mask[2] = t[i].read_mask[2];
-        mock_read_return[0] = t[i].read_return[0];
-        mock_read_return[1] = t[i].read_return[1];
-        mock_read_return[2] = t[i].read_return[2];
+        mock_read_t mock = {
+                .mask={t[i].read_mask[0], t[i].read_mask[1], t[i].read_mask[2]},
+                .ret={t[i].read_return[0], t[i].read_return[1], t[i].read_return[2]},
+        };
+        t[i].cfg.ctx = &mock;
 
         uint64_t phys = 0;
         uint32_t page_fault = 0;
@@ -314,3 +316,66 @@ test_va2pa() {
 
     return ok;
 }
+
+// Legacy tables of one thread: the page directory at 0 points to the page table
+// at 0x1000, whose pages are at (id << 22) + (i << 12)
+typedef struct ctx_thread {
+    uint32_t mem[2 * 1024];
+    uint32_t id;
+    bool ok;
+} ctx_thread_t;
+
+int32_t
+ctx_thread_read(void *ctx, void *buf, const uint32_t size, const uint64_t physical_addr) {
+    ctx_thread_t *t = ctx;
+    if (physical_addr >= sizeof(t->mem) || size > sizeof(t->mem) - physical_addr) {
+        return 0;
+    }
+    memcpy(buf, (const uint8_t *) t->mem + physical_addr, size);
+    return size;
+}
+
+static void *
+ctx_thread_walk(void *arg) {
+    ctx_thread_t *t = arg;
+    config_t cfg = {.level=LEGACY, .read_ctx_func=ctx_thread_read, .ctx=t, .maxphyaddr=32};
+    for (uint32_t i = 0; i < 1024 * 64; ++i) {
+        uint32_t virt_addr = ((i % 1024) << 12U) | 0x123;
+        uint64_t phys = 0;
+        uint32_t page_fault = 0;
+        if (va2pa(virt_addr, &cfg, &phys, &page_fault) != SUCCESS
+            || phys != ((uint64_t) t->id << 22U) + ((i % 1024) << 12U) + 0x123) {
+            t->ok = false;
+        }
+    }
+    return NULL;
+}
+
+// Walks of concurrent threads each reading its own tables through its ctx
+bool
+test_va2pa_ctx_threads() {
+    enum { THREADS = 4 };
+    static ctx_thread_t threads[THREADS];
+    pthread_t handles[THREADS];
+    for (uint32_t k = 0; k < THREADS; ++k) {
+        ctx_thread_t *t = &threads[k];
+        memset(t->mem, 0, sizeof(t->mem));
+        t->mem[0] = 0x1000 | 1U;
+        for (uint32_t i = 0; i < 1024; ++i) {
+            t->mem[1024 + i] = ((k << 22U) + (i << 12U)) | 1U;
+        }
+        t->id = k;
+        t->ok = true;
+        pthread_create(&handles[k], NULL, ctx_thread_walk, t);
+    }
+
+    bool ok = true;
+    for (uint32_t k = 0; k < THREADS; ++k) {
+        pthread_join(handles[k], NULL);
+        if (!threads[k].ok) {
+            printf("va2pa: thread %u translated through another thread's ctx\n\n", k);
+            ok = false;
+        }
+    }
+    return ok;
+}